@@ -1,4 +1,5 @@
 root.Vfs = {
+    IndexCacheDir: "games/chlcc/cache",
     Mounts: {
         "script": ["games/chlcc/gamedata/script.cpk"],
         "system": ["games/chlcc/gamedata/system.cpk"],
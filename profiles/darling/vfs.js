@@ -1,4 +1,5 @@
 root.Vfs = {
+    IndexCacheDir: "games/darling/cache",
     Mounts: {
         "script": ["games/darling/gamedata/script.cls"],
         "system": ["games/darling/gamedata/system.cpk"],
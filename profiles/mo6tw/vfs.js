@@ -1,4 +1,5 @@
 root.Vfs = {
+    IndexCacheDir: "games/mo6tw/cache",
     Mounts: {
         "script": ["games/mo6tw/gamedata/script.cls"],
         "system": ["games/mo6tw/gamedata/system.cpk"],
@@ -1,4 +1,5 @@
 root.Vfs = {
+    IndexCacheDir: "games/mo7/cache",
     Mounts: {
         "script": ["games/mo7/gamedata/script.cls"],
         "system": ["games/mo7/gamedata/system.cpk"],
@@ -1,4 +1,5 @@
 root.Vfs = {
+    IndexCacheDir: "games/rne/cache",
     Mounts: {
         "script": ["games/rne/gamedata/script.cls"],
         "system": ["games/rne/gamedata/system.cpk"],
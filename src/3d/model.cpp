@@ -37,6 +37,12 @@ uint32_t* g_BackgroundModelIds;
 char** g_BackgroundModelNames;
 uint32_t g_BackgroundModelCount;
 
+// Model archives get mounted under a name derived from the model file, so loads
+// running concurrently on different workers must not overlap
+static SDL_mutex* LoadLock = 0;
+
+void Model::Init() { LoadLock = SDL_CreateMutex(); }
+
 bool AnimationIsBlacklisted(uint32_t modelId, int16_t animId) {
   for (auto p : Profile::Scene3D::AnimationParseBlacklist) {
     if (p.first == modelId && p.second == animId) return true;
@@ -91,6 +97,9 @@ Model::~Model() {
   if (VertexBuffers) free(VertexBuffers);
   if (MorphVertexBuffers) free(MorphVertexBuffers);
   if (Indices) free(Indices);
+  for (int i = 0; i < TextureCount; i++) {
+    if (Textures[i].Buffer) free(Textures[i].Buffer);
+  }
   for (auto animation : Animations) {
     if (animation.second) delete animation.second;
   }
@@ -137,20 +146,19 @@ static IoError MountModel(uint32_t modelId, std::string& outMountpoint) {
            modelId);
     return err;
   }
-  void* arcMem;
-  int64_t arcSz;
-  err = VfsSlurp("model", modelId, &arcMem, &arcSz);
+  VfsView arcView;
+  err = VfsSlurpView("model", modelId, &arcView);
   if (err != IoError_OK) {
     ImpLog(LL_Error, LC_ModelLoad, "Could not open model archive for %d\n",
            modelId);
     return err;
   }
   std::string modelMountpoint = "model_" + arcMeta.FileName;
-  err = VfsMountMemory(modelMountpoint, arcMeta.FileName, arcMem, arcSz, true);
+  // VfsMountView() takes care of releasing arcView, even when mounting fails
+  err = VfsMountView(modelMountpoint, arcMeta.FileName, &arcView);
   if (err != IoError_OK) {
     ImpLog(LL_Error, LC_ModelLoad, "Could not open model archive for %d\n",
            modelId);
-    free(arcMem);
     return err;
   }
 
@@ -226,9 +234,12 @@ Model* Model::Load(uint32_t modelId) {
 
   ImpLogSlow(LL_Debug, LC_ModelLoad, "Loading model %d\n", modelId);
 
+  SDL_LockMutex(LoadLock);
+
   std::string modelMountpoint;
   IoError err = MountModel(modelId, modelMountpoint);
   if (err != IoError_OK) {
+    SDL_UnlockMutex(LoadLock);
     return NULL;
   }
 
@@ -239,6 +250,7 @@ Model* Model::Load(uint32_t modelId) {
     ImpLog(LL_Error, LC_ModelLoad, "Could not read model file for %d\n",
            modelId);
     UnmountModel(modelId);
+    SDL_UnlockMutex(LoadLock);
     return NULL;
   }
 
@@ -643,6 +655,7 @@ Model* Model::Load(uint32_t modelId) {
   }
 
   UnmountModel(modelId);
+  SDL_UnlockMutex(LoadLock);
 
   return result;
 }
@@ -184,9 +184,11 @@ class ModelAnimation;
 
 class Model {
  public:
+  static void Init();
   static void EnumerateModels();
 
-  // Parses a R;NE model file. No GPU submission happens in this class.
+  // Parses a R;NE model file. No GPU submission happens in this class, texture
+  // buffers stay allocated until the model is deleted.
   static Model* Load(uint32_t modelId);
   // Ground plane
   static Model* MakePlane();
@@ -8,6 +8,8 @@
 #include "camera.h"
 #include "../shader.h"
 #include "../log.h"
+#include "../assetcache.h"
+#include "../window.h"
 
 #include "../profile/scene3d.h"
 
@@ -212,13 +214,43 @@ void Renderable3D::BeginFrame(Camera* camera) {
   ViewProjection = camera->ViewProjection;
 }
 
+static void FreeModel(void* data) { delete (Model*)data; }
+
+static int64_t GetModelCacheSize(Model const* model) {
+  int64_t vertexSize;
+  if (model->Type == ModelType_Background) {
+    vertexSize = sizeof(BgVertexBuffer);
+  } else if (Profile::Scene3D::Version == +LKMVersion::DaSH) {
+    vertexSize = sizeof(VertexBufferDaSH);
+  } else {
+    vertexSize = sizeof(VertexBuffer);
+  }
+
+  int64_t size = sizeof(Model);
+  size += model->VertexCount * vertexSize;
+  size += model->MorphVertexCount * sizeof(MorphVertexBuffer);
+  size += model->IndexCount * sizeof(uint16_t);
+  for (int i = 0; i < model->TextureCount; i++) {
+    size += model->Textures[i].BufferSize;
+  }
+  return size;
+}
+
 bool Renderable3D::LoadSync(uint32_t modelId) {
   assert(IsUsed == false);
 
   ImpLog(LL_Info, LC_Renderable3D, "Creating renderable (model ID %d)\n",
          modelId);
 
-  StaticModel = Model::Load(modelId);
+  StaticModel = (Model*)AssetCache::Acquire("model", modelId);
+  if (!StaticModel) {
+    Model* model = Model::Load(modelId);
+    if (model) {
+      StaticModel = (Model*)AssetCache::Insert(
+          "model", modelId, model, GetModelCacheSize(model), &FreeModel);
+    }
+  }
+  StaticModelIsCached = StaticModel != 0;
   ModelTransform = Transform();
   PrevPoseWeight = 0.0f;
 
@@ -243,6 +275,7 @@ void Renderable3D::MakePlane() {
   assert(IsUsed == false);
 
   StaticModel = Model::MakePlane();
+  StaticModelIsCached = false;
   ModelTransform = Transform();
   PrevPoseWeight = 0.0f;
 
@@ -708,8 +741,13 @@ void Renderable3D::UnloadSync() {
       glDeleteTextures(StaticModel->TextureCount, TexBuffers);
       glDeleteBuffers(1, &UBOModel);
     }
-    delete StaticModel;
+    if (StaticModelIsCached) {
+      AssetCache::Release("model", StaticModel->Id);
+    } else {
+      delete StaticModel;
+    }
     StaticModel = 0;
+    StaticModelIsCached = false;
   }
   if (CurrentMorphedVertices) {
     free(CurrentMorphedVertices);
@@ -723,6 +761,7 @@ void Renderable3D::UnloadSync() {
 
 void Renderable3D::MainThreadOnLoad() {
   assert(IsSubmitted == false);
+  if (Window::NoGL) return;
 
   ImpLog(LL_Info, LC_Renderable3D, "Submitting data to GPU for model ID %d\n",
          StaticModel->Id);
@@ -819,7 +858,7 @@ void Renderable3D::MainThreadOnLoad() {
   }
 
   for (int i = 0; i < StaticModel->TextureCount; i++) {
-    TexBuffers[i] = StaticModel->Textures[i].Submit();
+    TexBuffers[i] = StaticModel->Textures[i].Upload();
     if (TexBuffers[i] == 0) {
       ImpLog(LL_Fatal, LC_Renderable3D,
              "Submitting texture %d for model %d failed\n", i, StaticModel->Id);
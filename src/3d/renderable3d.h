@@ -31,8 +31,8 @@ enum RenderPass { RP_Outline = 0, RP_First = 1, RP_Second = 2, RP_Count };
 class ModelAnimator;
 class Camera;
 
-class Renderable3D : public Loadable<Renderable3D> {
-  friend class Loadable<Renderable3D>;
+class Renderable3D : public Loadable<Renderable3D, WorkQueue::WP_Model> {
+  friend class Loadable<Renderable3D, WorkQueue::WP_Model>;
 
  public:
   static void Init();
@@ -49,6 +49,8 @@ class Renderable3D : public Loadable<Renderable3D> {
 
   void SwitchAnimation(int16_t animId, float transitionTime);
 
+  // Shared with other renderables through the asset cache (unless it's the
+  // plane), so it must not be modified
   Model* StaticModel = 0;
 
   // Per-frame results of vertex animation
@@ -80,6 +82,8 @@ class Renderable3D : public Loadable<Renderable3D> {
   void SetTextures(int id, int const* textureUnits, int count);
   void DrawMesh(int id, RenderPass pass);
 
+  bool StaticModelIsCached = false;
+
   GLuint UBOModel;
 
   GLuint VAOs[ModelMaxMeshesPerModel];
@@ -63,10 +63,14 @@ void Init() {
 
   Renderables = new Renderable3D[Profile::Scene3D::MaxRenderables];
 
-  Renderable3D::Init();
-
+  Model::Init();
   MainCamera.Init();
 
+  // Models still load (CPU-side) so the VM sees the same scene
+  if (Window::NoGL) return;
+
+  Renderable3D::Init();
+
   glGenVertexArrays(1, &VAOScreenFillingTriangle);
   glBindVertexArray(VAOScreenFillingTriangle);
   glGenBuffers(1, &VBOScreenFillingTriangle);
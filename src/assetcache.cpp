@@ -0,0 +1,207 @@
+#include "assetcache.h"
+
+#include <flat_hash_map.hpp>
+
+#include "impacto.h"
+#include "log.h"
+#include "io/vfs.h"
+#include "texture/texture.h"
+
+namespace Impacto {
+namespace AssetCache {
+
+struct CacheEntry {
+  std::string Key;
+  void* Data;
+  int64_t Size;
+  FreeProc Free;
+  int Pins;
+
+  // Unpinned entries only, Newest is the most recently released
+  CacheEntry* Older;
+  CacheEntry* Newer;
+};
+
+static SDL_mutex* Lock = 0;
+static ska::flat_hash_map<std::string, CacheEntry*> Entries;
+static CacheEntry* Oldest = 0;
+static CacheEntry* Newest = 0;
+static CacheStats Stats;
+
+static std::string MakeKey(std::string const& mountpoint, uint32_t id) {
+  return mountpoint + ":" + std::to_string(id);
+}
+
+static void Unlink(CacheEntry* entry) {
+  if (entry->Older) {
+    entry->Older->Newer = entry->Newer;
+  } else {
+    Oldest = entry->Newer;
+  }
+  if (entry->Newer) {
+    entry->Newer->Older = entry->Older;
+  } else {
+    Newest = entry->Older;
+  }
+  entry->Older = 0;
+  entry->Newer = 0;
+}
+
+static void LinkNewest(CacheEntry* entry) {
+  entry->Older = Newest;
+  entry->Newer = 0;
+  if (Newest) {
+    Newest->Newer = entry;
+  } else {
+    Oldest = entry;
+  }
+  Newest = entry;
+}
+
+static void Pin(CacheEntry* entry) {
+  if (entry->Pins++ == 0) Unlink(entry);
+}
+
+static void Destroy(CacheEntry* entry) {
+  Unlink(entry);
+  Entries.erase(entry->Key);
+  Stats.Size -= entry->Size;
+  Stats.Entries--;
+  entry->Free(entry->Data);
+  delete entry;
+}
+
+// Call with Lock held
+static void Trim(int64_t budget) {
+  while (Stats.Size > budget && Oldest) {
+    ImpLogSlow(LL_Trace, LC_IO, "Evicting %s from asset cache\n",
+               Oldest->Key.c_str());
+    Destroy(Oldest);
+    Stats.Evictions++;
+  }
+}
+
+void Init(int64_t budget) {
+  Lock = SDL_CreateMutex();
+  memset(&Stats, 0, sizeof(Stats));
+  Stats.Budget = budget;
+}
+
+void Shutdown() {
+  SDL_LockMutex(Lock);
+  ImpLog(LL_Info, LC_IO,
+         "Asset cache: %lld hits, %lld misses, %lld evictions, %d entries "
+         "(%lld/%lld bytes)\n",
+         (long long)Stats.Hits, (long long)Stats.Misses,
+         (long long)Stats.Evictions, Stats.Entries, (long long)Stats.Size,
+         (long long)Stats.Budget);
+  Trim(0);
+  SDL_UnlockMutex(Lock);
+}
+
+void* Acquire(std::string const& mountpoint, uint32_t id) {
+  std::string key = MakeKey(mountpoint, id);
+  void* result = NULL;
+
+  SDL_LockMutex(Lock);
+  auto it = Entries.find(key);
+  if (it != Entries.end()) {
+    Pin(it->second);
+    result = it->second->Data;
+    Stats.Hits++;
+  } else {
+    Stats.Misses++;
+  }
+  SDL_UnlockMutex(Lock);
+
+  return result;
+}
+
+void* Insert(std::string const& mountpoint, uint32_t id, void* data,
+             int64_t size, FreeProc freeProc) {
+  std::string key = MakeKey(mountpoint, id);
+
+  SDL_LockMutex(Lock);
+  auto it = Entries.find(key);
+  if (it != Entries.end()) {
+    Pin(it->second);
+    void* existing = it->second->Data;
+    SDL_UnlockMutex(Lock);
+    freeProc(data);
+    return existing;
+  }
+
+  CacheEntry* entry = new CacheEntry;
+  entry->Key = key;
+  entry->Data = data;
+  entry->Size = size;
+  entry->Free = freeProc;
+  entry->Pins = 1;
+  entry->Older = 0;
+  entry->Newer = 0;
+  Entries[key] = entry;
+  Stats.Size += size;
+  Stats.Entries++;
+  Trim(Stats.Budget);
+  SDL_UnlockMutex(Lock);
+
+  return data;
+}
+
+void Release(std::string const& mountpoint, uint32_t id) {
+  std::string key = MakeKey(mountpoint, id);
+
+  SDL_LockMutex(Lock);
+  auto it = Entries.find(key);
+  if (it != Entries.end() && it->second->Pins > 0) {
+    CacheEntry* entry = it->second;
+    if (--entry->Pins == 0) {
+      LinkNewest(entry);
+      Trim(Stats.Budget);
+    }
+  }
+  SDL_UnlockMutex(Lock);
+}
+
+void GetStats(CacheStats* out) {
+  SDL_LockMutex(Lock);
+  *out = Stats;
+  SDL_UnlockMutex(Lock);
+}
+
+static void FreeTexture(void* data) {
+  Texture* texture = (Texture*)data;
+  free(texture->Buffer);
+  delete texture;
+}
+
+bool LoadTexture(std::string const& mountpoint, uint32_t id, Texture* out) {
+  Texture* cached = (Texture*)Acquire(mountpoint, id);
+  if (!cached) {
+    Io::InputStream* stream;
+    IoError err = Io::VfsOpen(mountpoint, id, &stream);
+    if (err != IoError_OK) {
+      out->Load1x1();
+      return false;
+    }
+
+    Texture* texture = new Texture;
+    bool loaded = texture->Load(stream);
+    delete stream;
+    if (!loaded) {
+      if (texture->Buffer) free(texture->Buffer);
+      delete texture;
+      out->Load1x1();
+      return false;
+    }
+
+    cached = (Texture*)Insert(mountpoint, id, texture, texture->BufferSize,
+                              &FreeTexture);
+  }
+
+  *out = *cached;
+  return true;
+}
+
+}  // namespace AssetCache
+}  // namespace Impacto
\ No newline at end of file
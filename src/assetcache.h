@@ -0,0 +1,59 @@
+#pragma once
+
+#include <string>
+#include <SDL.h>
+
+namespace Impacto {
+
+struct Texture;
+
+namespace AssetCache {
+typedef void (*FreeProc)(void* data);
+
+struct CacheStats {
+  int64_t Hits;
+  int64_t Misses;
+  int64_t Evictions;
+  int64_t Size;
+  int64_t Budget;
+  int Entries;
+};
+
+// Memory-budgeted cache of decoded assets (texture pixel buffers, parsed
+// character layouts, models), keyed by VFS mountpoint and file id, so loading
+// the same asset again (e.g. a background the script flips back to) does not
+// decode it again.
+//
+// Entries are refcounted: Acquire() and Insert() pin the entry and every pin
+// must be undone by Release(). Only unpinned entries are evicted, least
+// recently released first, whenever the total size exceeds the budget - so
+// pinned entries may push the cache over budget temporarily. Cached data is
+// shared between all users and must be treated as read-only.
+//
+// All functions are threadsafe.
+
+void Init(int64_t budget);
+// Logs statistics and frees all unpinned entries
+void Shutdown();
+
+// Returns the cached data for mountpoint/id and pins it, or NULL on a miss
+void* Acquire(std::string const& mountpoint, uint32_t id);
+// Takes ownership of data (freed with freeProc on eviction) and returns it
+// pinned. If another thread inserted the same asset in the meantime, data is
+// freed right away and the existing entry is returned pinned instead.
+void* Insert(std::string const& mountpoint, uint32_t id, void* data,
+             int64_t size, FreeProc freeProc);
+// Unpins the entry, does nothing if there is none
+void Release(std::string const& mountpoint, uint32_t id);
+
+void GetStats(CacheStats* out);
+
+// Gets the decoded texture in mountpoint/id from the cache, decoding and
+// inserting it on a miss. out is a copy sharing the cached pixel buffer, so
+// upload it with Texture::Upload() (not Submit()) and Release() the entry
+// afterwards. On failure out is a caller-owned 1x1 texture, nothing is pinned
+// and false is returned.
+bool LoadTexture(std::string const& mountpoint, uint32_t id, Texture* out);
+}  // namespace AssetCache
+
+}  // namespace Impacto
\ No newline at end of file
@@ -65,31 +65,65 @@ void AdxAudioStream::SetCoefficients(double cutoff, double sample_rate) {
 }
 
 // https://github.com/kode54/vgmstream/blob/master/src/coding/adx_decoder.c
-bool AdxAudioStream::DecodeBuffer() {
-  int16_t* output = DecodedBuffer;
-  uint8_t* input = EncodedBuffer;
-
-  for (int c = 0; c < ChannelCount; c++) {
-    /* the +1 becomes important on quiet ADXs */
-    int scale = SDL_SwapBE16(*(uint16_t*)input) + 1;
-    input += 2;
-
-    for (int i = 0; i < SamplesPerBuffer; i++) {
-      /* this byte contains nibbles for two samples */
-      int sample_byte = input[i / 2];
-
-      output[i * ChannelCount + c] =
-          clamp16((i & 1 ? get_low_nibble_signed(sample_byte)
-                         : get_high_nibble_signed(sample_byte)) *
-                      scale +
-                  (Coef1 * Hist1[c] >> 12) + (Coef2 * Hist2[c] >> 12));
-
-      Hist2[c] = Hist1[c];
-      Hist1[c] = output[i * ChannelCount + c];
+// Channels are decoded in lockstep, so their (independent) predictor chains
+// overlap instead of running one after the other, and samples are written
+// interleaved as they come.
+template <int Channels>
+static void DecodeFrames(uint8_t const* input, int frameSize, int32_t coef1,
+                         int32_t coef2, int32_t* hist1, int32_t* hist2,
+                         int16_t* output) {
+  /* the +1 becomes important on quiet ADXs */
+  int scale[Channels];
+  int32_t h1[Channels];
+  int32_t h2[Channels];
+  for (int c = 0; c < Channels; c++) {
+    scale[c] = SDL_SwapBE16(*(uint16_t*)(input + c * frameSize)) + 1;
+    h1[c] = hist1[c];
+    h2[c] = hist2[c];
+  }
+
+  for (int i = 2; i < frameSize; i++) {
+    /* each byte contains nibbles for two samples */
+    for (int n = 0; n < 2; n++) {
+      for (int c = 0; c < Channels; c++) {
+        uint8_t sample_byte = input[c * frameSize + i];
+        int32_t sample = clamp16(
+            (n ? get_low_nibble_signed(sample_byte)
+               : get_high_nibble_signed(sample_byte)) *
+                scale[c] +
+            (coef1 * h1[c] >> 12) + (coef2 * h2[c] >> 12));
+        h2[c] = h1[c];
+        h1[c] = sample;
+        *output++ = sample;
+      }
     }
-    input += SamplesPerBuffer / 2;
   }
 
+  for (int c = 0; c < Channels; c++) {
+    hist1[c] = h1[c];
+    hist2[c] = h2[c];
+  }
+}
+
+bool AdxAudioStream::DecodeBuffer(uint8_t* out) {
+  int block = ReadPosition / SamplesPerBuffer;
+  int loopBlock = LoopStart / SamplesPerBuffer;
+  if (block > SeekPoints.back().Block &&
+      (block % SeekPointSpacing == 0 || block == loopBlock)) {
+    SeekPoint point;
+    point.Block = block;
+    memcpy(point.Hist1, Hist1, sizeof(Hist1));
+    memcpy(point.Hist2, Hist2, sizeof(Hist2));
+    SeekPoints.push_back(point);
+  }
+
+  if (ChannelCount == 2) {
+    DecodeFrames<2>(EncodedBuffer, FrameSize, Coef1, Coef2, Hist1, Hist2,
+                    (int16_t*)out);
+  } else {
+    DecodeFrames<1>(EncodedBuffer, FrameSize, Coef1, Coef2, Hist1, Hist2,
+                    (int16_t*)out);
+  }
   return true;
 }
 
@@ -199,13 +233,15 @@ AdxAudioStream::~AdxAudioStream() {}
 void AdxAudioStream::InitWithInfo(AdxHeaderInfo* info) {
   ChannelCount = info->ChannelCount;
   SampleRate = info->SampleRate;
-  EncodedBytesPerBuffer = info->FrameSize * ChannelCount;
+  FrameSize = info->FrameSize;
+  EncodedBytesPerBuffer = FrameSize * ChannelCount;
   StreamDataOffset = info->StreamDataOffset;
   Hist1[0] = info->Hist1_L;
   Hist1[1] = info->Hist1_R;
   Hist2[0] = info->Hist2_L;
   Hist2[1] = info->Hist2_R;
-  SamplesPerBuffer = (info->FrameSize - 2) * 2;
+  SeekPoints.push_back({0, {Hist1[0], Hist1[1]}, {Hist2[0], Hist2[1]}});
+  SamplesPerBuffer = (FrameSize - 2) * 2;
   Duration = info->SampleCount;
   LoopStart = info->HasLoop ? info->LoopStart : 0;
   LoopEnd = info->HasLoop ? info->LoopEnd : Duration;
@@ -217,11 +253,25 @@ void AdxAudioStream::InitWithInfo(AdxHeaderInfo* info) {
 }
 
 int AdxAudioStream::Read(void* buffer, int samples) {
-  return ReadBuffered((int16_t*)buffer, samples);
+  return ReadBuffered((uint8_t*)buffer, samples);
 }
 
 void AdxAudioStream::Seek(int samples) { SeekBuffered(samples); }
 
+// Without the right history, the start of the target block would come out
+// distorted (clicking at every loop). Playback always decodes the loop start
+// block before wrapping around to it, so loops restore its exact history.
+// Seeks past what was decoded so far continue from the last point taken.
+void AdxAudioStream::SeekToBlock(int block) {
+  auto next = std::upper_bound(
+      SeekPoints.begin(), SeekPoints.end(), block,
+      [](int block, SeekPoint const& point) { return block < point.Block; });
+  SeekPoint const& point = *(next - 1);
+  memcpy(Hist1, point.Hist1, sizeof(Hist1));
+  memcpy(Hist2, point.Hist2, sizeof(Hist2));
+  SeekToBlockFrom(point.Block, block);
+}
+
 bool AdxAudioStream::_registered =
     AudioStream::AddAudioStreamCreator(&AdxAudioStream::Create);
 
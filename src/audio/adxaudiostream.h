@@ -1,5 +1,7 @@
 #pragma once
 
+#include <vector>
+
 #include "audiostream.h"
 #include "../impacto.h"
 #include "buffering.h"
@@ -10,8 +12,8 @@ namespace Audio {
 struct AdxHeaderInfo;
 
 class AdxAudioStream : public AudioStream,
-                       public Buffering<AdxAudioStream, int16_t> {
-  friend class Buffering<AdxAudioStream, int16_t>;
+                       public Buffering<AdxAudioStream> {
+  friend class Buffering<AdxAudioStream>;
 
  public:
   ~AdxAudioStream();
@@ -20,7 +22,8 @@ class AdxAudioStream : public AudioStream,
   void Seek(int samples) override;
 
  protected:
-  bool DecodeBuffer();
+  bool DecodeBuffer(uint8_t* out);
+  void SeekToBlock(int block);
   int16_t DecodedBuffer[127] = {0};
   uint8_t EncodedBuffer[256] = {0};
 
@@ -30,12 +33,25 @@ class AdxAudioStream : public AudioStream,
   void InitWithInfo(AdxHeaderInfo* info);
   void SetCoefficients(double cutoff, double sampleRate);
 
+  int FrameSize;
+
   int32_t Coef1;
   int32_t Coef2;
 
   int32_t Hist1[2];
   int32_t Hist2[2];
 
+  // Predictor history going into a block
+  struct SeekPoint {
+    int Block;
+    int32_t Hist1[2];
+    int32_t Hist2[2];
+  };
+  // Taken while decoding, every SeekPointSpacing blocks and at the loop start,
+  // sorted by Block
+  std::vector<SeekPoint> SeekPoints;
+  static int const SeekPointSpacing = 256;
+
   static bool _registered;
 };
 
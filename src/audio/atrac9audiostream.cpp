@@ -195,9 +195,10 @@ void Atrac9AudioStream::InitWithInfo(At9ContainerInfo* container,
   SamplesPerFrame = codecinfo->frameSamples;
   FramesPerSuperframe = codecinfo->framesInSuperframe;
   SamplesPerBuffer = SamplesPerFrame * FramesPerSuperframe;
+  // MDCT frames overlap their predecessor
+  PrimingBlocks = 1;
 
-  DecodedBuffer =
-      (int16_t*)malloc(sizeof(int16_t) * ChannelCount * SamplesPerBuffer);
+  DecodedBuffer = (uint8_t*)malloc(BytesPerSample() * SamplesPerBuffer);
   EncodedBytesPerBuffer = codecinfo->superframeSize;
   EncodedBuffer = (uint8_t*)malloc(EncodedBytesPerBuffer);
 
@@ -220,12 +221,12 @@ Atrac9AudioStream::~Atrac9AudioStream() {
 // probably kinda slow
 
 int Atrac9AudioStream::Read(void* buffer, int samples) {
-  return ReadBuffered((int16_t*)buffer, samples);
+  return ReadBuffered((uint8_t*)buffer, samples);
 }
 
-bool Atrac9AudioStream::DecodeBuffer() {
+bool Atrac9AudioStream::DecodeBuffer(uint8_t* out) {
   uint8_t* encoded = EncodedBuffer;
-  int16_t* decoded = DecodedBuffer;
+  int16_t* decoded = (int16_t*)out;
   // Atrac9Decode always decodes one frame
   for (int i = 0; i < FramesPerSuperframe; i++) {
     int bytesUsed;
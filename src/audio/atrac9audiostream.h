@@ -11,8 +11,8 @@ namespace Audio {
 struct At9ContainerInfo;
 
 class Atrac9AudioStream : public AudioStream,
-                          public Buffering<Atrac9AudioStream, int16_t> {
-  friend class Buffering<Atrac9AudioStream, int16_t>;
+                          public Buffering<Atrac9AudioStream> {
+  friend class Buffering<Atrac9AudioStream>;
 
  public:
   ~Atrac9AudioStream();
@@ -21,7 +21,7 @@ class Atrac9AudioStream : public AudioStream,
   void Seek(int samples) override;
 
  protected:
-  bool DecodeBuffer();
+  bool DecodeBuffer(uint8_t* out);
 
  private:
   static AudioStream* Create(Io::InputStream* stream);
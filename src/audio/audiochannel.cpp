@@ -3,12 +3,79 @@
 #include "audiochannel.h"
 #include "audiosystem.h"
 #include "audiostream.h"
+#include "pcmcache.h"
 #include "../log.h"
+#include "../workqueue.h"
+#include "../io/vfs.h"
 
 namespace Impacto {
 namespace Audio {
 
-static ALenum ToALFormat(int channels, int bitdepth) {
+struct AudioStreamLoad {
+  std::string Mountpoint;
+  uint32_t FileId;
+  bool Loop;
+  float FadeInDuration;
+  // Decode short files whole into the PCM cache
+  bool Cacheable;
+
+  // Set by the worker before Done, Clip or Stream
+  PcmClip* Clip;
+  AudioStream* Stream;
+  uint8_t* Preroll;
+  int PrerollSamples;
+
+  SDL_atomic_t Done;
+  // Worker (released on completion) and audio thread
+  SDL_atomic_t Refs;
+};
+
+static void ReleaseLoad(AudioStreamLoad* load) {
+  if (!SDL_AtomicDecRef(&load->Refs)) return;
+  if (load->Clip) PcmCacheRelease(load->Clip);
+  if (load->Stream) delete load->Stream;
+  if (load->Preroll) free(load->Preroll);
+  delete load;
+}
+
+static void LoadStream(void* ptr) {
+  AudioStreamLoad* load = (AudioStreamLoad*)ptr;
+
+  if (load->Cacheable) {
+    load->Clip = PcmCacheAcquire(load->Mountpoint, load->FileId);
+  }
+
+  Io::InputStream* stream;
+  if (!load->Clip &&
+      Io::VfsOpen(load->Mountpoint, load->FileId, &stream) == IoError_OK) {
+    load->Stream = AudioStream::Create(stream);
+    if (!load->Stream) delete stream;
+  }
+
+  if (load->Stream && load->Cacheable) {
+    load->Clip = PcmCacheInsert(load->Mountpoint, load->FileId, load->Stream);
+    if (load->Clip) {
+      delete load->Stream;
+      load->Stream = 0;
+    }
+  }
+
+  AudioStream* audio = load->Stream;
+  if (audio) {
+    int samples = AudioChannel::AudioBufferSize / audio->BytesPerSample();
+    if (load->Loop && audio->LoopEnd > 0) {
+      samples = std::min(samples, audio->LoopEnd);
+    }
+    load->Preroll = (uint8_t*)malloc(samples * audio->BytesPerSample());
+    load->PrerollSamples = audio->Read(load->Preroll, samples);
+  }
+
+  SDL_AtomicSet(&load->Done, 1);
+}
+
+static void OnStreamLoaded(void* ptr) { ReleaseLoad((AudioStreamLoad*)ptr); }
+
+ALenum ToALFormat(int channels, int bitdepth) {
   if (channels == 2 && bitdepth == 16) return AL_FORMAT_STEREO16;
   if (channels == 2 && bitdepth == 32) return AL_FORMAT_STEREO_FLOAT32;
   if (channels == 1 && bitdepth == 16) return AL_FORMAT_MONO16;
@@ -21,7 +88,7 @@ static ALenum ToALFormat(int channels, int bitdepth) {
 
 AudioChannel::~AudioChannel() {
   if (!IsInit) return;
-  Stop(0.0f);
+  StopPlayback(0.0f);
   alDeleteSources(1, &Source);
   alDeleteBuffers(AudioBufferCount, BufferIds);
 }
@@ -31,7 +98,13 @@ void AudioChannel::Init(AudioChannelId id, AudioChannelGroup group) {
   Id = id;
   Group = group;
   State = ACS_Stopped;
+  MixState = ACS_Stopped;
   CurrentStream = 0;
+  RequestSerial = 0;
+  AppliedSerial = 0;
+  SDL_AtomicSet(&PublishedSerial, 0);
+  SDL_AtomicSet(&PublishedState, ACS_Stopped);
+  SDL_AtomicSet(&PublishedPosition, 0);
 
   alGenSources(1, &Source);
   alSourcef(Source, AL_PITCH, 1);
@@ -45,11 +118,153 @@ void AudioChannel::Init(AudioChannelId id, AudioChannelGroup group) {
   IsInit = true;
 }
 
-// TODO AudioStream creation on background thread
+float AudioChannel::TargetGain() const {
+  return MasterVolume * GroupVolumes[Group] * Volume;
+}
+
+void AudioChannel::PushRequest(AudioRequestType type, AudioStream* stream,
+                               AudioStreamLoad* load, bool loop,
+                               float duration) {
+  AudioRequest request;
+  request.Type = type;
+  request.Channel = Id;
+  request.Serial = ++RequestSerial;
+  request.Stream = stream;
+  request.Load = load;
+  request.Loop = loop;
+  request.Duration = duration;
+  request.Gain = RequestedGain = TargetGain();
+  QueueRequest(request);
+}
+
 void AudioChannel::Play(AudioStream* stream, bool loop, float fadeInDuration) {
+  if (!IsInit) {
+    // We own the stream now
+    delete stream;
+    return;
+  }
+  assert(fadeInDuration >= 0.0f);
+  if (!stream) {
+    Stop(0.0f);
+    return;
+  }
+
+  // The stream is the audio thread's from here on
+  StreamDuration = stream->Duration;
+  StreamSampleRate = stream->SampleRate;
+  State = ACS_FadingIn;
+  Position = 0;
+  PushRequest(ART_Play, stream, 0, loop, fadeInDuration);
+}
+
+void AudioChannel::Play(std::string const& mountpoint, uint32_t fileId,
+                        bool loop, float fadeInDuration) {
   if (!IsInit) return;
   assert(fadeInDuration >= 0.0f);
-  Stop(0.0f);
+
+  AudioStreamLoad* load = new AudioStreamLoad;
+  load->Mountpoint = mountpoint;
+  load->FileId = fileId;
+  load->Loop = loop;
+  load->FadeInDuration = fadeInDuration;
+  load->Cacheable = Group == ACG_SE;
+  load->Clip = 0;
+  load->Stream = 0;
+  load->Preroll = 0;
+  load->PrerollSamples = 0;
+  SDL_AtomicSet(&load->Done, 0);
+  SDL_AtomicSet(&load->Refs, 2);
+
+  StreamDuration = 0;
+  StreamSampleRate = 0;
+  State = ACS_FadingIn;
+  Position = 0;
+  // Queued first so the audio thread never sees it before it is running
+  PushRequest(ART_Play, 0, load, loop, fadeInDuration);
+  WorkQueue::Push(load, &LoadStream, &OnStreamLoaded, WorkQueue::WP_Audio);
+}
+
+void AudioChannel::Stop(float fadeOutDuration) {
+  if (!IsInit) return;
+  assert(fadeOutDuration >= 0.0f);
+  if (State == ACS_Stopped) return;
+  if (fadeOutDuration == 0.0f) {
+    State = ACS_Stopped;
+    Position = 0;
+  } else {
+    State = ACS_FadingOut;
+  }
+  PushRequest(ART_Stop, 0, 0, false, fadeOutDuration);
+}
+
+void AudioChannel::Update(float dt) {
+  if (!IsInit) return;
+
+  if (TargetGain() != RequestedGain) {
+    PushRequest(ART_SetGain, 0, 0, false, 0.0f);
+  }
+
+  // Older state would undo the requests still in flight
+  if ((uint32_t)SDL_AtomicGet(&PublishedSerial) == RequestSerial) {
+    State = (AudioChannelState)SDL_AtomicGet(&PublishedState);
+    Position = SDL_AtomicGet(&PublishedPosition);
+    StreamDuration = SDL_AtomicGet(&PublishedDuration);
+    StreamSampleRate = SDL_AtomicGet(&PublishedSampleRate);
+  }
+}
+
+float AudioChannel::PositionInSeconds() const {
+  if (State == ACS_Stopped || StreamSampleRate == 0) return 0;
+  return (float)Position / (float)StreamSampleRate;
+}
+float AudioChannel::DurationInSeconds() const {
+  if (State == ACS_Stopped || StreamSampleRate == 0) return 0;
+  return (float)StreamDuration / (float)StreamSampleRate;
+}
+
+void AudioChannel::Apply(AudioRequest const& request) {
+  AppliedSerial = request.Serial;
+  Gain = request.Gain;
+  switch (request.Type) {
+    case ART_Play:
+      if (request.Load) {
+        StopPlayback(0.0f);
+        PendingLoad = request.Load;
+        MixState = ACS_FadingIn;
+      } else {
+        StartPlayback(request.Stream, request.Loop, request.Duration);
+      }
+      break;
+    case ART_Stop:
+      StopPlayback(request.Duration);
+      break;
+    case ART_SetGain:
+      ApplyGain();
+      break;
+  }
+}
+
+void AudioChannel::Publish() {
+  SDL_AtomicSet(&PublishedState, MixState);
+  SDL_AtomicSet(&PublishedPosition, MixPosition);
+  int duration = 0;
+  int sampleRate = 0;
+  if (CurrentStream) {
+    duration = CurrentStream->Duration;
+    sampleRate = CurrentStream->SampleRate;
+  } else if (CurrentClip) {
+    duration = CurrentClip->SampleCount;
+    sampleRate = CurrentClip->SampleRate;
+  }
+  SDL_AtomicSet(&PublishedDuration, duration);
+  SDL_AtomicSet(&PublishedSampleRate, sampleRate);
+  // Last, so the game side never takes the state above for a newer request's
+  SDL_AtomicSet(&PublishedSerial, AppliedSerial);
+}
+
+void AudioChannel::StartPlayback(AudioStream* stream, bool loop,
+                                 float fadeInDuration) {
+  StopPlayback(0.0f);
 
   CurrentStream = stream;
   Looping = loop;
@@ -57,9 +272,9 @@ void AudioChannel::Play(AudioStream* stream, bool loop, float fadeInDuration) {
   FirstFreeBuffer = 0;
   memset(BufferStartPositions, 0, sizeof(BufferStartPositions));
   FinishedDecode = false;
-  Position = 0;
+  MixPosition = 0;
 
-  State = ACS_FadingIn;
+  MixState = ACS_FadingIn;
   FadeDuration = fadeInDuration;
   if (fadeInDuration > 0.0f) {
     FadeCompletion = 0.0f;
@@ -67,19 +282,65 @@ void AudioChannel::Play(AudioStream* stream, bool loop, float fadeInDuration) {
     // Still FadingIn so FillBuffers doesn't think we're underrunning
     FadeCompletion = 1.0f;
   }
-  SetGain();
+  ApplyGain();
 
   FillBuffers();
   alSourcePlay(Source);
 }
 
+void AudioChannel::StartLoadedPlayback() {
+  AudioStreamLoad* load = PendingLoad;
+  PendingLoad = 0;
+  // Nothing for StartPlayback() to stop, so the preroll stays
+  MixState = ACS_Stopped;
+  if (load->Clip) {
+    PcmClip* clip = load->Clip;
+    load->Clip = 0;
+    StartClipPlayback(clip, load->Loop, load->FadeInDuration);
+  } else if (load->Stream) {
+    Preroll = load->Preroll;
+    PrerollSamples = load->PrerollSamples;
+    load->Preroll = 0;
+    AudioStream* stream = load->Stream;
+    load->Stream = 0;
+    StartPlayback(stream, load->Loop, load->FadeInDuration);
+  } else {
+    ImpLog(LL_Error, LC_Audio, "Could not play file %u from %s\n",
+           load->FileId, load->Mountpoint.c_str());
+  }
+  ReleaseLoad(load);
+}
+
+void AudioChannel::StartClipPlayback(PcmClip* clip, bool loop,
+                                     float fadeInDuration) {
+  StopPlayback(0.0f);
+
+  CurrentClip = clip;
+  Looping = loop;
+  MixPosition = 0;
+
+  MixState = ACS_FadingIn;
+  FadeDuration = fadeInDuration;
+  FadeCompletion = fadeInDuration > 0.0f ? 0.0f : 1.0f;
+  ApplyGain();
+
+  alSourcei(Source, AL_BUFFER, PcmClipBuffer(clip));
+  alSourcei(Source, AL_LOOPING, loop ? AL_TRUE : AL_FALSE);
+  alSourcePlay(Source);
+}
+
 // TODO what to do when already fading out?
-void AudioChannel::Stop(float fadeOutDuration) {
-  if (!IsInit) return;
-  assert(fadeOutDuration >= 0.0f);
-  if (State == ACS_Stopped) return;
+void AudioChannel::StopPlayback(float fadeOutDuration) {
+  if (PendingLoad) {
+    // Nothing to hear yet
+    ReleaseLoad(PendingLoad);
+    PendingLoad = 0;
+    MixState = ACS_Stopped;
+    return;
+  }
+  if (MixState == ACS_Stopped) return;
   if (fadeOutDuration == 0.0f) {
-    State = ACS_Stopped;
+    MixState = ACS_Stopped;
     // unqueue all buffers
     alSourcei(Source, AL_BUFFER, NULL);
     alSourceStop(Source);
@@ -90,31 +351,57 @@ void AudioChannel::Stop(float fadeOutDuration) {
       delete CurrentStream;
       CurrentStream = 0;
     }
-    Position = 0;
+    if (CurrentClip) {
+      PcmCacheRelease(CurrentClip);
+      CurrentClip = 0;
+    }
+    if (Preroll) {
+      free(Preroll);
+      Preroll = 0;
+      PrerollSamples = 0;
+    }
+    MixPosition = 0;
   } else {
-    State = ACS_FadingOut;
+    MixState = ACS_FadingOut;
     FadeDuration = fadeOutDuration;
     FadeCompletion = 0.0f;
   }
 }
 
-void AudioChannel::Update(float dt) {
+void AudioChannel::Mix(float dt) {
   if (!IsInit) return;
 
+  if (PendingLoad) {
+    if (!SDL_AtomicGet(&PendingLoad->Done)) return;
+    StartLoadedPlayback();
+  }
+
   // Update fade
 
-  if (State == ACS_FadingIn || State == ACS_FadingOut) {
+  if (MixState == ACS_FadingIn || MixState == ACS_FadingOut) {
     FadeCompletion += dt / FadeDuration;
     if (FadeCompletion >= 1.0f) {
-      if (State == ACS_FadingIn) {
-        State = ACS_Playing;
+      if (MixState == ACS_FadingIn) {
+        MixState = ACS_Playing;
       } else {
-        Stop(0);
+        StopPlayback(0);
       }
     }
   }
-  if (State == ACS_Stopped) return;
-  SetGain();
+  if (MixState == ACS_Stopped) return;
+  ApplyGain();
+
+  if (CurrentClip) {
+    // OpenAL does all the work, including looping
+    ALint sourceState;
+    alGetSourcei(Source, AL_SOURCE_STATE, &sourceState);
+    if (sourceState == AL_STOPPED) {
+      StopPlayback(0.0f);
+      return;
+    }
+    alGetSourcei(Source, AL_SAMPLE_OFFSET, &MixPosition);
+    return;
+  }
 
   // Update playhead and stop playing if we're done
 
@@ -122,7 +409,7 @@ void AudioChannel::Update(float dt) {
 
   if (FreeBufferCount == AudioBufferCount && FinishedDecode && !Looping) {
     // whole file has been played out
-    Stop(0.0f);
+    StopPlayback(0.0f);
     return;
   }
 
@@ -132,24 +419,23 @@ void AudioChannel::Update(float dt) {
 
   int offset;
   alGetSourcei(Source, AL_SAMPLE_OFFSET, &offset);
-  Position = BufferStartPositions[currentlyPlayingBuffer] + offset;
+  MixPosition = BufferStartPositions[currentlyPlayingBuffer] + offset;
   if (Looping) {
-    if (Position > CurrentStream->LoopEnd)
-      Position =
+    if (MixPosition > CurrentStream->LoopEnd)
+      MixPosition =
           CurrentStream->LoopStart +
-          (Position % (CurrentStream->LoopEnd - CurrentStream->LoopStart));
+          (MixPosition % (CurrentStream->LoopEnd - CurrentStream->LoopStart));
   } else {
-    Position = std::min(Position, CurrentStream->Duration);
+    MixPosition = std::min(MixPosition, CurrentStream->Duration);
   }
 
-  // TODO do this on background thread detached from game loop
   FillBuffers();
 
   // restart playback after underrun
 
   ALint sourceState;
   alGetSourcei(Source, AL_SOURCE_STATE, &sourceState);
-  if (State != ACS_Stopped && sourceState != AL_PLAYING) {
+  if (MixState != ACS_Stopped && sourceState != AL_PLAYING) {
     ImpLog(LL_Error, LC_Audio,
            "Restarting playback after buffer underrun on channel %d - %d\n", Id,
            sourceState);
@@ -158,10 +444,10 @@ void AudioChannel::Update(float dt) {
 }
 
 // TODO what easing functions do we want for this?
-void AudioChannel::SetGain() {
-  if (State == ACS_Stopped) return;
-  float gain = MasterVolume * GroupVolumes[Group] * Volume;
-  switch (State) {
+void AudioChannel::ApplyGain() {
+  if (MixState == ACS_Stopped) return;
+  float gain = Gain;
+  switch (MixState) {
     case ACS_FadingIn:
       gain *= powf(FadeCompletion, 3.0f);
       break;
@@ -178,7 +464,7 @@ void AudioChannel::FillBuffers() {
   if (!CurrentStream) return;
 
   if (FreeBufferCount == AudioBufferCount && !FinishedDecode &&
-      State == ACS_Playing) {
+      MixState == ACS_Playing) {
     ImpLog(LL_Error, LC_Audio, "Buffer underrun on channel %d\n", Id);
   }
 
@@ -188,12 +474,26 @@ void AudioChannel::FillBuffers() {
     alSourceUnqueueBuffers(Source, 1, &BufferIds[FirstFreeBuffer]);
     FreeBufferCount--;
 
-    BufferStartPositions[FirstFreeBuffer] = CurrentStream->ReadPosition;
+    BufferStartPositions[FirstFreeBuffer] =
+        CurrentStream->ReadPosition - PrerollSamples;
 
     memset(HostBuffer, 0, AudioBufferSize);
 
     uint8_t* dest;
     int samplesRead = 0;
+    if (Preroll) {
+      // Decoded by the stream loader already
+      memcpy(HostBuffer, Preroll,
+             PrerollSamples * CurrentStream->BytesPerSample());
+      samplesRead = PrerollSamples;
+      free(Preroll);
+      Preroll = 0;
+      PrerollSamples = 0;
+      if (CurrentStream->ReadPosition >= CurrentStream->Duration &&
+          CurrentStream->Duration >= 0) {
+        FinishedDecode = true;
+      }
+    }
     while (samplesRead < maxSamples) {
       if (Looping && CurrentStream->ReadPosition >= CurrentStream->LoopEnd) {
         ImpLog(LL_Trace, LC_Audio, "Channel %d looping\n", Id);
@@ -231,14 +531,5 @@ int AudioChannel::SamplesPerBuffer() const {
   return AudioBufferSize / CurrentStream->BytesPerSample();
 }
 
-float AudioChannel::PositionInSeconds() const {
-  if (!CurrentStream) return 0;
-  return (float)Position / (float)CurrentStream->SampleRate;
-}
-float AudioChannel::DurationInSeconds() const {
-  if (!CurrentStream) return 0;
-  return (float)CurrentStream->Duration / (float)CurrentStream->SampleRate;
-}
-
 }  // namespace Audio
 }  // namespace Impacto
\ No newline at end of file
@@ -1,10 +1,16 @@
 #pragma once
 
+#include <string>
+#include <SDL_atomic.h>
+
 #include "audiocommon.h"
 
 namespace Impacto {
 namespace Audio {
 
+// Game code controls channels from the main thread. Requests are queued for
+// the audio thread (see audiosystem.h), which owns the stream and OpenAL
+// source, so they return right away and frame hitches can't starve playback.
 class AudioChannel {
  public:
   ~AudioChannel();
@@ -13,9 +19,14 @@ class AudioChannel {
 
   // Stream is automatically deleted when playback is stopped
   void Play(AudioStream* stream, bool loop, float fadeInDuration);
-  void FillBuffers();
+  // Opens and probes the file and decodes its first buffer on a worker, the
+  // channel starts playing once that is done. Duration and position are 0
+  // until then.
+  void Play(std::string const& mountpoint, uint32_t fileId, bool loop,
+            float fadeInDuration);
   void Stop(float fadeOutDuration);
 
+  // Sends volume changes and picks up State and Position from the audio thread
   void Update(float dt);
 
   float PositionInSeconds() const;
@@ -25,6 +36,7 @@ class AudioChannel {
   AudioChannelId Id;
   AudioChannelGroup Group;
 
+  // As of the last request, until the audio thread has caught up with it
   AudioChannelState State;
 
   float Volume = 1.0f;
@@ -33,13 +45,54 @@ class AudioChannel {
   // Actual playhead at start of (graphics) frame, in AudioStream samples
   int Position = 0;
 
- private:
-  void SetGain();
-  int SamplesPerBuffer() const;
+  // Audio thread side, called by the audio system only
+
+  void Apply(AudioRequest const& request);
+  void Mix(float dt);
+  // Makes the playback state visible to Update()
+  void Publish();
 
   static int const AudioBufferSize = 64 * 1024;
   static int const AudioBufferCount = 3;
 
+ private:
+  void PushRequest(AudioRequestType type, AudioStream* stream,
+                   AudioStreamLoad* load, bool loop, float duration);
+  float TargetGain() const;
+
+  void StartPlayback(AudioStream* stream, bool loop, float fadeInDuration);
+  void StartClipPlayback(PcmClip* clip, bool loop, float fadeInDuration);
+  void StartLoadedPlayback();
+  void StopPlayback(float fadeOutDuration);
+  void ApplyGain();
+  void FillBuffers();
+  int SamplesPerBuffer() const;
+
+  // Game side
+  uint32_t RequestSerial = 0;
+  float RequestedGain = 0.0f;
+  int StreamDuration = 0;
+  int StreamSampleRate = 0;
+
+  // Written by the audio thread
+  SDL_atomic_t PublishedSerial;
+  SDL_atomic_t PublishedState;
+  SDL_atomic_t PublishedPosition;
+  SDL_atomic_t PublishedDuration;
+  SDL_atomic_t PublishedSampleRate;
+
+  // Audio thread side
+  uint32_t AppliedSerial = 0;
+  AudioChannelState MixState;
+  int MixPosition = 0;
+  float Gain = 0.0f;
+
+  // Stream still being created, MixState is ACS_FadingIn meanwhile
+  AudioStreamLoad* PendingLoad = 0;
+  // Decoded start of the stream, goes into the first buffer
+  uint8_t* Preroll = 0;
+  int PrerollSamples = 0;
+
   ALuint BufferIds[AudioBufferCount];
   uint8_t HostBuffer[AudioBufferSize];
   int FirstFreeBuffer;
@@ -48,7 +101,9 @@ class AudioChannel {
   // In AudioStream samples
   int BufferStartPositions[AudioBufferCount];
 
+  // One or the other
   AudioStream* CurrentStream = 0;
+  PcmClip* CurrentClip = 0;
   bool IsInit = false;
 
   bool Looping;
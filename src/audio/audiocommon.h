@@ -44,6 +44,26 @@ enum AudioChannelState {
 
 class AudioChannel;
 class AudioStream;
+struct AudioStreamLoad;
+struct PcmClip;
+
+ALenum ToALFormat(int channels, int bitdepth);
+
+enum AudioRequestType { ART_Play, ART_Stop, ART_SetGain };
+
+struct AudioRequest {
+  AudioRequestType Type;
+  AudioChannelId Channel;
+  // Per channel, tells the game side which request the audio thread is at
+  uint32_t Serial;
+  // ART_Play, one of them
+  AudioStream* Stream;
+  AudioStreamLoad* Load;
+  bool Loop;
+  // Fade duration for ART_Play and ART_Stop
+  float Duration;
+  float Gain;
+};
 
 }  // namespace Audio
 }  // namespace Impacto
\ No newline at end of file
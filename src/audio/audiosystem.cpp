@@ -1,6 +1,8 @@
 #include "audiosystem.h"
+#include "pcmcache.h"
 #include "../log.h"
 #include <utility>
+#include <SDL.h>
 
 namespace Impacto {
 namespace Audio {
@@ -13,8 +15,104 @@ static ALCcontext* AlcContext = 0;
 float MasterVolume = 1.0f;
 float GroupVolumes[ACG_Count];
 AudioChannel Channels[AC_Count];
+bool FloatOutput = false;
+
+// Ring buffer, indices only ever increase (wrapping around) and each is
+// written by one side only
+static int const RequestQueueSize = 256;
+static AudioRequest Requests[RequestQueueSize];
+static SDL_atomic_t RequestsWritten;
+static SDL_atomic_t RequestsRead;
+
+static void ProcessRequests() {
+  int read = SDL_AtomicGet(&RequestsRead);
+  int written = SDL_AtomicGet(&RequestsWritten);
+  for (; read != written; read++) {
+    AudioRequest const& request = Requests[read % RequestQueueSize];
+    Channels[request.Channel].Apply(request);
+  }
+  SDL_AtomicSet(&RequestsRead, read);
+}
+
+static void Mix(float dt) {
+  ProcessRequests();
+  for (int i = 0; i < AC_Count; i++) {
+    Channels[i].Mix(dt);
+    Channels[i].Publish();
+  }
+  PcmCacheTrim();
+}
+
+void QueueRequest(AudioRequest const& request) {
+  int written = SDL_AtomicGet(&RequestsWritten);
+  while (written - SDL_AtomicGet(&RequestsRead) >= RequestQueueSize) {
+#if IMPACTO_HAVE_THREADS
+    // Only on absurd bursts of requests
+    SDL_Delay(1);
+#else
+    ProcessRequests();
+#endif
+  }
+  Requests[written % RequestQueueSize] = request;
+  SDL_AtomicSet(&RequestsWritten, written + 1);
+}
+
+#if IMPACTO_HAVE_THREADS
+
+// Well within the ~1/3 s of audio a channel has queued
+static int const MixIntervalMs = 5;
+
+static SDL_Thread* Thread = 0;
+static SDL_atomic_t ThreadRunning;
+
+static int AudioThread(void* unused) {
+  uint64_t frequency = SDL_GetPerformanceFrequency();
+  uint64_t lastTime = SDL_GetPerformanceCounter();
+  while (SDL_AtomicGet(&ThreadRunning)) {
+    uint64_t time = SDL_GetPerformanceCounter();
+    Mix((float)((double)(time - lastTime) / (double)frequency));
+    lastTime = time;
+    SDL_Delay(MixIntervalMs);
+  }
+  return 0;
+}
+
+static void StartThread() {
+  SDL_AtomicSet(&ThreadRunning, 1);
+  Thread = SDL_CreateThread(&AudioThread, "Audio thread", NULL);
+  if (!Thread) {
+    ImpLog(LL_Fatal, LC_Audio, "Could not create audio thread: %s\n",
+           SDL_GetError());
+  }
+}
+
+static void StopThread() {
+  if (!Thread) return;
+  SDL_AtomicSet(&ThreadRunning, 0);
+  SDL_WaitThread(Thread, NULL);
+  Thread = 0;
+}
+
+#else
+
+static void StartThread() {}
+static void StopThread() {}
+
+#endif
 
 void AudioShutdown() {
+  if (IsInit) {
+    StopThread();
+    // Streams of requests that never made it to the audio thread
+    ProcessRequests();
+    AudioRequest stop = {};
+    stop.Type = ART_Stop;
+    for (int i = 0; i < AC_Count; i++) {
+      stop.Channel = (AudioChannelId)i;
+      Channels[i].Apply(stop);
+    }
+    PcmCacheClear();
+  }
   if (AlcContext) alcDestroyContext(AlcContext);
   if (AlcDevice) alcCloseDevice(AlcDevice);
   IsInit = false;
@@ -32,9 +130,10 @@ void AudioInit() {
     ImpLog(LL_Fatal, LC_Audio, "Could not create OpenAL device\n");
     return;
   }
-  if (alIsExtensionPresent("AL_EXT_float32") == AL_FALSE) {
-    ImpLog(LL_Error, LC_Audio,
-           "No floating-point audio support, some decoders may fail\n");
+  FloatOutput = alIsExtensionPresent("AL_EXT_float32") == AL_TRUE;
+  if (!FloatOutput) {
+    ImpLog(LL_Warning, LC_Audio,
+           "No floating-point audio support, decoding to 16-bit\n");
   }
   AlcContext = alcCreateContext(AlcDevice, NULL);
   if (!AlcContext || !alcMakeContextCurrent(AlcContext)) {
@@ -55,10 +154,16 @@ void AudioInit() {
     Channels[i].Init((AudioChannelId)i, ACG_BGM);
   Channels[AC_SSE].Init(AC_SSE, ACG_SE);
 
+  SDL_AtomicSet(&RequestsWritten, 0);
+  SDL_AtomicSet(&RequestsRead, 0);
   IsInit = true;
+  StartThread();
 }
 
 void AudioUpdate(float dt) {
+#if !IMPACTO_HAVE_THREADS
+  if (IsInit) Mix(dt);
+#endif
   for (int i = 0; i < AC_Count; i++) {
     Channels[i].Update(dt);
   }
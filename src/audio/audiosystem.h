@@ -7,13 +7,24 @@
 namespace Impacto {
 namespace Audio {
 
+// Decoding, buffer queueing and fades run on a dedicated audio thread (or in
+// AudioUpdate() without thread support). The game side talks to it through
+// AudioChannel, which queues requests here and reads back published state.
+
 void AudioInit();
+// Main thread, once per frame
 void AudioUpdate(float dt);
 void AudioShutdown();
 
+// Lock-free, single producer (the main thread)
+void QueueRequest(AudioRequest const& request);
+
 extern float MasterVolume;
 extern float GroupVolumes[ACG_Count];
 extern AudioChannel Channels[AC_Count];
+// Decoders producing floats (HCA) output them as 32-bit samples instead of
+// converting to 16-bit. Set by AudioInit() if OpenAL has AL_EXT_float32.
+extern bool FloatOutput;
 
 }  // namespace Audio
 }  // namespace Impacto
\ No newline at end of file
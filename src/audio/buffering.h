@@ -6,11 +6,15 @@
 namespace Impacto {
 namespace Audio {
 
-template <typename T, typename SampleType>
+// Block decoding on top of AudioStream. T implements
+// bool DecodeBuffer(uint8_t* out), decoding EncodedBuffer into out, which has
+// room for SamplesPerBuffer samples of T's format. Whole blocks the caller
+// wants are decoded straight into its buffer, only partial ones go through
+// DecodedBuffer.
+template <typename T>
 class Buffering {
  protected:
-  bool DecodeBuffer();
-  SampleType* DecodedBuffer = 0;
+  uint8_t* DecodedBuffer = 0;
   uint8_t* EncodedBuffer = 0;
 
   int DecodedSamplesAvailable = 0;
@@ -18,9 +22,13 @@ class Buffering {
   int SamplesPerBuffer = 0;
   int EncodedBytesPerBuffer = 0;
   int StreamDataOffset;
+  // Blocks decoded and thrown away before a seek target, for codecs whose
+  // blocks overlap the previous one
+  int PrimingBlocks = 0;
 
-  int ReadBuffered(SampleType* out, int samples) {
+  int ReadBuffered(uint8_t* out, int samples) {
     T* stream = static_cast<T*>(this);
+    int bytesPerSample = stream->BytesPerSample();
     int read = 0;
     while (samples) {
       if (DecodedSamplesAvailable) {
@@ -29,10 +37,10 @@ class Buffering {
         if (out) {
           // null pointer => discard-seek
           memcpy(out,
-                 stream->DecodedBuffer +
-                     DecodedSamplesConsumed * stream->ChannelCount,
-                 samplesWrittenNow * stream->ChannelCount * sizeof(SampleType));
-          out += samplesWrittenNow * stream->ChannelCount;
+                 (uint8_t*)stream->DecodedBuffer +
+                     DecodedSamplesConsumed * bytesPerSample,
+                 samplesWrittenNow * bytesPerSample);
+          out += samplesWrittenNow * bytesPerSample;
         }
         samples -= samplesWrittenNow;
         read += samplesWrittenNow;
@@ -46,10 +54,24 @@ class Buffering {
           //
           return read;
 
+        stream->BaseStream->Read(stream->EncodedBuffer, EncodedBytesPerBuffer);
+
+        if (out && samples >= SamplesPerBuffer &&
+            samplesLeft >= SamplesPerBuffer) {
+          // whole block => skip the copy
+          DecodedSamplesConsumed = 0;
+          if (!stream->DecodeBuffer(out)) return read;
+          out += SamplesPerBuffer * bytesPerSample;
+          samples -= SamplesPerBuffer;
+          read += SamplesPerBuffer;
+          stream->ReadPosition += SamplesPerBuffer;
+          continue;
+        }
+
         DecodedSamplesAvailable = SamplesPerBuffer;
         DecodedSamplesConsumed = 0;
-        stream->BaseStream->Read(stream->EncodedBuffer, EncodedBytesPerBuffer);
-        bool decodeSuccess = stream->DecodeBuffer();
+        bool decodeSuccess =
+            stream->DecodeBuffer((uint8_t*)stream->DecodedBuffer);
 
         DecodedSamplesAvailable =
             std::min(DecodedSamplesAvailable, samplesLeft);
@@ -59,28 +81,49 @@ class Buffering {
     return read;
   }
 
+  // Seeks cost at most PrimingBlocks (or whatever T's SeekToBlock() needs)
+  // plus one block of decoding, wherever they go
   void SeekBuffered(int samples) {
     T* stream = static_cast<T*>(this);
     int buffer = samples / SamplesPerBuffer;
     int offset = samples % SamplesPerBuffer;
     int currentBuffer = stream->ReadPosition / SamplesPerBuffer;
     if (currentBuffer != buffer) {
-      // seek base stream
-      stream->BaseStream->Seek(
-          StreamDataOffset + buffer * EncodedBytesPerBuffer, RW_SEEK_SET);
-      stream->ReadPosition = buffer * SamplesPerBuffer;
-      DecodedSamplesAvailable = 0;
-      DecodedSamplesConsumed = 0;
+      stream->SeekToBlock(buffer);
     }
     // ensure available
     if (!DecodedSamplesAvailable) {
       ReadBuffered(NULL, 1);
     }
     // skip
+    int decoded = DecodedSamplesAvailable + DecodedSamplesConsumed;
     stream->ReadPosition = samples;
-    DecodedSamplesAvailable = SamplesPerBuffer - offset;
+    DecodedSamplesAvailable = std::max(0, decoded - offset);
     DecodedSamplesConsumed = offset;
   }
+
+  // Sets up the base stream and decoder so that the next DecodeBuffer()
+  // decodes block. T may hide this to restore decoder state it keeps track of,
+  // then call SeekToBlockFrom().
+  void SeekToBlock(int block) {
+    SeekToBlockFrom(std::max(0, block - PrimingBlocks), block);
+  }
+
+  // Decodes and throws away the blocks from first up to block, T's decoder
+  // state must be right for first
+  void SeekToBlockFrom(int first, int block) {
+    T* stream = static_cast<T*>(this);
+    stream->BaseStream->Seek(StreamDataOffset + first * EncodedBytesPerBuffer,
+                             RW_SEEK_SET);
+    for (int i = first; i < block; i++) {
+      stream->ReadPosition = i * SamplesPerBuffer;
+      stream->BaseStream->Read(stream->EncodedBuffer, EncodedBytesPerBuffer);
+      stream->DecodeBuffer((uint8_t*)stream->DecodedBuffer);
+    }
+    stream->ReadPosition = block * SamplesPerBuffer;
+    DecodedSamplesAvailable = 0;
+    DecodedSamplesConsumed = 0;
+  }
 };
 
 }  // namespace Audio
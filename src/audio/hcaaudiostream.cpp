@@ -1,4 +1,5 @@
 #include "hcaaudiostream.h"
+#include "audiosystem.h"
 
 #include "../util.h"
 #include "../log.h"
@@ -8,6 +9,10 @@ using namespace Impacto::Io;
 namespace Impacto {
 namespace Audio {
 
+// HCA blocks decoded per buffer, so the base stream is read and the buffer
+// refilled less often
+int const HcaBlocksPerBuffer = 4;
+
 AudioStream* HcaAudioStream::Create(InputStream* stream) {
   clHCA* Decoder = 0;
   HcaAudioStream* result = 0;
@@ -74,15 +79,20 @@ void HcaAudioStream::InitWithInfo(clHCA_stInfo* info) {
                 ? info->loopEndBlock * info->samplesPerBlock +
                       (info->samplesPerBlock - info->loopEndPadding)
                 : Duration;
-  EncodedBytesPerBuffer = info->blockSize;
+  SamplesPerBlock = info->samplesPerBlock;
+  BytesPerBlock = info->blockSize;
+  BlockCount = info->blockCount;
+  EncodedBytesPerBuffer = BytesPerBlock * HcaBlocksPerBuffer;
   StreamDataOffset = info->headerSize;
-  SamplesPerBuffer = info->samplesPerBlock;
+  SamplesPerBuffer = SamplesPerBlock * HcaBlocksPerBuffer;
+  // Priming is done by SeekToBlock(), a whole buffer would be too much
+  PrimingBlocks = 0;
 
-  BitDepth = 16;
+  // Decoded samples are floats already
+  BitDepth = FloatOutput ? 32 : 16;
 
   EncodedBuffer = (uint8_t*)malloc(EncodedBytesPerBuffer);
-  DecodedBuffer =
-      (int16_t*)malloc(sizeof(int16_t) * SamplesPerBuffer * ChannelCount);
+  DecodedBuffer = (uint8_t*)malloc(BytesPerSample() * SamplesPerBuffer);
 
   clHCA_SetKey(Decoder, 0xCF222F1FE0748978u);  // default key
 
@@ -97,17 +107,43 @@ HcaAudioStream::~HcaAudioStream() {
 }
 
 int HcaAudioStream::Read(void* buffer, int samples) {
-  return ReadBuffered((int16_t*)buffer, samples);
+  return ReadBuffered((uint8_t*)buffer, samples);
 }
 
 void HcaAudioStream::Seek(int samples) { SeekBuffered(samples); }
 
-bool HcaAudioStream::DecodeBuffer() {
-  // TODO clHCA_DecodeReset after seek?
-  int err = clHCA_DecodeBlock(Decoder, EncodedBuffer, EncodedBytesPerBuffer);
-  if (err < 0) return false;
-  clHCA_ReadSamples16(Decoder, DecodedBuffer);
-  return true;
+void HcaAudioStream::SeekToBlock(int block) {
+  clHCA_DecodeReset(Decoder);
+  // MDCT blocks overlap their predecessor, so decode the HCA block before the
+  // buffer (not the whole buffer before it)
+  int first = block * HcaBlocksPerBuffer;
+  if (first > 0) {
+    BaseStream->Seek(StreamDataOffset + (first - 1) * BytesPerBlock,
+                     RW_SEEK_SET);
+    BaseStream->Read(EncodedBuffer, BytesPerBlock);
+    clHCA_DecodeBlock(Decoder, EncodedBuffer, BytesPerBlock);
+  }
+  SeekToBlockFrom(block, block);
+}
+
+bool HcaAudioStream::DecodeBuffer(uint8_t* out) {
+  // The last buffer may be short, don't decode what's after the last block
+  int blocks =
+      std::min(HcaBlocksPerBuffer, BlockCount - ReadPosition / SamplesPerBlock);
+  uint8_t* encoded = EncodedBuffer;
+  // clHCA always decodes one block
+  for (int i = 0; i < blocks; i++) {
+    int err = clHCA_DecodeBlock(Decoder, encoded, BytesPerBlock);
+    if (err < 0) return false;
+    if (BitDepth == 32) {
+      clHCA_ReadSamplesFloat(Decoder, (float*)out);
+    } else {
+      clHCA_ReadSamples16(Decoder, (int16_t*)out);
+    }
+    encoded += BytesPerBlock;
+    out += SamplesPerBlock * BytesPerSample();
+  }
+  return blocks > 0;
 }
 
 bool HcaAudioStream::_registered =
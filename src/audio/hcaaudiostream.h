@@ -10,8 +10,8 @@ namespace Impacto {
 namespace Audio {
 
 class HcaAudioStream : public AudioStream,
-                       public Buffering<HcaAudioStream, int16_t> {
-  friend class Buffering<HcaAudioStream, int16_t>;
+                       public Buffering<HcaAudioStream> {
+  friend class Buffering<HcaAudioStream>;
 
  public:
   ~HcaAudioStream();
@@ -20,7 +20,8 @@ class HcaAudioStream : public AudioStream,
   void Seek(int samples) override;
 
  protected:
-  bool DecodeBuffer();
+  bool DecodeBuffer(uint8_t* out);
+  void SeekToBlock(int block);
 
  private:
   static AudioStream* Create(Io::InputStream* stream);
@@ -29,6 +30,9 @@ class HcaAudioStream : public AudioStream,
   void InitWithInfo(clHCA_stInfo* info);
 
   clHCA* Decoder = 0;
+  int SamplesPerBlock;
+  int BytesPerBlock;
+  int BlockCount;
 
   static bool _registered;
 };
@@ -0,0 +1,145 @@
+#include "pcmcache.h"
+
+#include <vector>
+#include <SDL_atomic.h>
+
+#include "audiostream.h"
+#include "../log.h"
+#include "../profile/game.h"
+
+namespace Impacto {
+namespace Audio {
+
+static SDL_SpinLock Lock;
+static std::vector<PcmClip*> Clips;
+static int64_t TotalSize = 0;
+static uint64_t UseCounter = 0;
+
+static PcmClip* Find(std::string const& mountpoint, uint32_t fileId) {
+  for (PcmClip* clip : Clips) {
+    if (clip->FileId == fileId && clip->Mountpoint == mountpoint) return clip;
+  }
+  return NULL;
+}
+
+static void Free(PcmClip* clip) {
+  if (clip->Buffer) alDeleteBuffers(1, &clip->Buffer);
+  if (clip->Data) free(clip->Data);
+  delete clip;
+}
+
+PcmClip* PcmCacheAcquire(std::string const& mountpoint, uint32_t fileId) {
+  SDL_AtomicLock(&Lock);
+  PcmClip* clip = Find(mountpoint, fileId);
+  if (clip) {
+    clip->Users++;
+    clip->LastUse = ++UseCounter;
+  }
+  SDL_AtomicUnlock(&Lock);
+  return clip;
+}
+
+PcmClip* PcmCacheInsert(std::string const& mountpoint, uint32_t fileId,
+                        AudioStream* stream) {
+  if (stream->Duration <= 0 ||
+      stream->Duration >
+          Profile::PcmCacheMaxClipLength * (float)stream->SampleRate) {
+    return NULL;
+  }
+  // Clips are looped whole
+  if (stream->LoopEnd > 0 &&
+      (stream->LoopStart != 0 || stream->LoopEnd < stream->Duration)) {
+    return NULL;
+  }
+
+  PcmClip* clip = new PcmClip;
+  clip->Mountpoint = mountpoint;
+  clip->FileId = fileId;
+  clip->ChannelCount = stream->ChannelCount;
+  clip->SampleRate = stream->SampleRate;
+  clip->BitDepth = stream->BitDepth;
+  clip->Data = (uint8_t*)malloc(stream->Duration * stream->BytesPerSample());
+  clip->Buffer = 0;
+  clip->Users = 1;
+
+  int samples = 0;
+  while (samples < stream->Duration) {
+    int read = stream->Read(clip->Data + samples * stream->BytesPerSample(),
+                            stream->Duration - samples);
+    if (read == 0) break;
+    samples += read;
+  }
+  clip->SampleCount = samples;
+  clip->Size = (int64_t)samples * stream->BytesPerSample();
+
+  SDL_AtomicLock(&Lock);
+  // Another worker may have beaten us to it
+  PcmClip* existing = Find(mountpoint, fileId);
+  if (existing) {
+    existing->Users++;
+    existing->LastUse = ++UseCounter;
+  } else {
+    clip->LastUse = ++UseCounter;
+    Clips.push_back(clip);
+    TotalSize += clip->Size;
+  }
+  SDL_AtomicUnlock(&Lock);
+
+  if (existing) {
+    Free(clip);
+    return existing;
+  }
+  return clip;
+}
+
+void PcmCacheRelease(PcmClip* clip) {
+  SDL_AtomicLock(&Lock);
+  assert(clip->Users > 0);
+  clip->Users--;
+  clip->LastUse = ++UseCounter;
+  SDL_AtomicUnlock(&Lock);
+}
+
+ALuint PcmClipBuffer(PcmClip* clip) {
+  if (!clip->Buffer) {
+    alGenBuffers(1, &clip->Buffer);
+    alBufferData(clip->Buffer, ToALFormat(clip->ChannelCount, clip->BitDepth),
+                 clip->Data, clip->Size, clip->SampleRate);
+    free(clip->Data);
+    clip->Data = 0;
+  }
+  return clip->Buffer;
+}
+
+void PcmCacheTrim() {
+  int64_t budget = (int64_t)Profile::PcmCacheSize * 1024 * 1024;
+  SDL_AtomicLock(&Lock);
+  while (TotalSize > budget) {
+    auto oldest = Clips.end();
+    for (auto it = Clips.begin(); it != Clips.end(); it++) {
+      if ((*it)->Users > 0) continue;
+      if (oldest == Clips.end() || (*it)->LastUse < (*oldest)->LastUse) {
+        oldest = it;
+      }
+    }
+    if (oldest == Clips.end()) break;
+    PcmClip* clip = *oldest;
+    Clips.erase(oldest);
+    TotalSize -= clip->Size;
+    ImpLogSlow(LL_Debug, LC_Audio, "Dropping decoded clip %u from %s\n",
+               clip->FileId, clip->Mountpoint.c_str());
+    Free(clip);
+  }
+  SDL_AtomicUnlock(&Lock);
+}
+
+void PcmCacheClear() {
+  SDL_AtomicLock(&Lock);
+  for (PcmClip* clip : Clips) Free(clip);
+  Clips.clear();
+  TotalSize = 0;
+  SDL_AtomicUnlock(&Lock);
+}
+
+}  // namespace Audio
+}  // namespace Impacto
\ No newline at end of file
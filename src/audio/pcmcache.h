@@ -0,0 +1,58 @@
+#pragma once
+
+#include <string>
+
+#include "audiocommon.h"
+#include "../impacto.h"
+
+namespace Impacto {
+namespace Audio {
+
+// A short sound decoded whole, played from a single OpenAL buffer
+struct PcmClip {
+  std::string Mountpoint;
+  uint32_t FileId;
+
+  int ChannelCount;
+  int SampleRate;
+  int BitDepth;
+  int SampleCount;
+
+  // Decoded samples, until the audio thread uploads them into Buffer
+  uint8_t* Data;
+  int64_t Size;
+  ALuint Buffer;
+
+  // Channels and pending loads holding the clip
+  int Users;
+  uint64_t LastUse;
+};
+
+// Sound effects (ACG_SE channels) no longer than
+// Profile::PcmCacheMaxClipLength are decoded once and kept within
+// Profile::PcmCacheSize (clips in use are never dropped), so replaying them
+// costs neither reading nor decoding.
+
+// Worker threads
+
+// Returns the clip with a user added, or NULL if it isn't cached
+PcmClip* PcmCacheAcquire(std::string const& mountpoint, uint32_t fileId);
+// Decodes all of stream into a new clip with a user added. Returns NULL
+// without touching the stream if it is too long or loops only part of itself.
+PcmClip* PcmCacheInsert(std::string const& mountpoint, uint32_t fileId,
+                        AudioStream* stream);
+
+// Any thread
+void PcmCacheRelease(PcmClip* clip);
+
+// Audio thread
+
+// The clip's OpenAL buffer, uploading it first if needed
+ALuint PcmClipBuffer(PcmClip* clip);
+// Drops the least recently used unused clips until they fit the budget
+void PcmCacheTrim();
+// Drops all clips, once channels are stopped at shutdown
+void PcmCacheClear();
+
+}  // namespace Audio
+}  // namespace Impacto
\ No newline at end of file
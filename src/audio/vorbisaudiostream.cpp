@@ -97,6 +97,11 @@ VorbisAudioStream::~VorbisAudioStream() {
 }
 
 int VorbisAudioStream::Read(void* buffer, int samples) {
+  if (SeekPoints.empty() ||
+      ReadPosition >= SeekPoints.back().Pcm + SeekPointSpacing) {
+    SeekPoints.push_back({ReadPosition, ov_raw_tell(&Vf)});
+  }
+
   int current_section;
   int totalSamplesRead = 0;
   while (samples > 0) {
@@ -123,8 +128,30 @@ int VorbisAudioStream::Read(void* buffer, int samples) {
 }
 
 void VorbisAudioStream::Seek(int samples) {
-  ov_pcm_seek(&Vf, samples);
+  auto next = std::upper_bound(
+      SeekPoints.begin(), SeekPoints.end(), (int64_t)samples,
+      [](int64_t pcm, SeekPoint const& point) { return pcm < point.Pcm; });
+  // Decoding resumes at the page after Raw, possibly past the target, in
+  // which case we try an earlier point
+  bool found = false;
+  while (next != SeekPoints.begin() && !found) {
+    next--;
+    found = ov_raw_seek(&Vf, next->Raw) == 0 && ov_pcm_tell(&Vf) <= samples;
+  }
+  if (!found) {
+    ov_pcm_seek(&Vf, samples);
+    ReadPosition = ov_pcm_tell(&Vf);
+    return;
+  }
+
+  // Decode up to the target, at most SeekPointSpacing samples and a page
   ReadPosition = ov_pcm_tell(&Vf);
+  uint8_t discard[4096];
+  int discardSamples = sizeof(discard) / BytesPerSample();
+  while (ReadPosition < samples) {
+    int toRead = std::min(discardSamples, samples - ReadPosition);
+    if (Read(discard, toRead) == 0) break;
+  }
 }
 
 bool VorbisAudioStream::_registered =
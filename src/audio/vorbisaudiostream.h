@@ -2,6 +2,7 @@
 
 #include "audiostream.h"
 #include "../impacto.h"
+#include <vector>
 #include <vorbis/vorbisfile.h>
 
 namespace Impacto {
@@ -23,6 +24,16 @@ class VorbisAudioStream : public AudioStream {
 
   OggVorbis_File Vf;
 
+  // ov_pcm_seek() bisects the whole file, which is slow on compressed
+  // archives, so we remember where we have been instead
+  struct SeekPoint {
+    int64_t Pcm;
+    int64_t Raw;
+  };
+  // Taken while reading, every SeekPointSpacing samples, sorted by Pcm
+  std::vector<SeekPoint> SeekPoints;
+  static int const SeekPointSpacing = 16 * 1024;
+
   static bool _registered;
 };
 
@@ -1,5 +1,6 @@
 #include "background2d.h"
 
+#include "assetcache.h"
 #include "io/memorystream.h"
 #include "io/vfs.h"
 #include "util.h"
@@ -14,17 +15,14 @@ bool Background2D::LoadSync(uint32_t bgId) {
     BgTexture.Load1x1(bgId & 0xFF, (bgId >> 8) & 0xFF, (bgId >> 16) & 0xFF,
                       0xFF);
   } else {
-    Io::InputStream* stream;
-    int64_t err = Io::VfsOpen("bg", bgId, &stream);
-    if (err != IoError_OK) return false;
-    BgTexture.Load(stream);
-    delete stream;
+    BgTextureCached = AssetCache::LoadTexture("bg", bgId, &BgTexture);
+    if (!BgTextureCached) return false;
   }
   return true;
 }
 
 void Background2D::UnloadSync() {
-  glDeleteTextures(1, &BgSpriteSheet.Texture);
+  if (BgSpriteSheet.Texture) glDeleteTextures(1, &BgSpriteSheet.Texture);
   BgSpriteSheet.DesignHeight = 0.0f;
   BgSpriteSheet.DesignWidth = 0.0f;
   BgSpriteSheet.Texture = 0;
@@ -33,7 +31,13 @@ void Background2D::UnloadSync() {
 }
 
 void Background2D::MainThreadOnLoad() {
-  BgSpriteSheet.Texture = BgTexture.Submit();
+  if (BgTextureCached) {
+    BgSpriteSheet.Texture = BgTexture.Upload();
+    AssetCache::Release("bg", NextLoadId);
+    BgTextureCached = false;
+  } else {
+    BgSpriteSheet.Texture = BgTexture.Submit();
+  }
   if ((BgTexture.Width == 1) && (BgTexture.Height == 1)) {
     BgSpriteSheet.DesignWidth = Profile::DesignWidth;
     BgSpriteSheet.DesignHeight = Profile::DesignHeight;
@@ -7,8 +7,9 @@
 
 namespace Impacto {
 
-class Background2D : public Loadable<Background2D> {
-  friend class Loadable<Background2D>;
+class Background2D
+    : public Loadable<Background2D, WorkQueue::WP_Background> {
+  friend class Loadable<Background2D, WorkQueue::WP_Background>;
 
  public:
   Sprite BgSprite;
@@ -23,6 +24,8 @@ class Background2D : public Loadable<Background2D> {
 
  private:
   Texture BgTexture;
+  // BgTexture.Buffer is pinned in the asset cache until MainThreadOnLoad()
+  bool BgTextureCached = false;
   SpriteSheet BgSpriteSheet;
 };
 
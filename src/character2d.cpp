@@ -1,5 +1,6 @@
 #include "character2d.h"
 
+#include "assetcache.h"
 #include "io/io.h"
 #include "io/vfs.h"
 #include "util.h"
@@ -8,145 +9,177 @@ namespace Impacto {
 
 Character2D Characters2D[MaxCharacters2D];
 
-bool Character2D::LoadSync(uint32_t charaId) {
-  int fileId = charaId & 0xFFFF;
+Character2DData::~Character2DData() {
+  for (auto& state : States) {
+    if (state.second.ScreenCoords) free(state.second.ScreenCoords);
+    if (state.second.TextureCoords) free(state.second.TextureCoords);
+    if (state.second.Indices) free(state.second.Indices);
+  }
+  if (MvlVertices) free(MvlVertices);
+}
 
-  Io::InputStream* stream;
-  int64_t err = Io::VfsOpen("chara", fileId, &stream);
-  if (err != IoError_OK) return false;
-  CharaTexture.Load(stream);
-  delete stream;
+static void FreeCharacter2DData(void* data) {
+  delete (Character2DData*)data;
+}
 
-  if (Profile::CharaIsMvl) {
-    // MVL format
-    Face = charaId;
-    LipFrame = 1;
-    EyeFrame = 1;
+static void LoadMvl(Io::InputStream* stream, Character2DData* data) {
+  auto& States = data->States;
+
+  Io::ReadLE<int>(stream);
+  int stateCount = Io::ReadLE<int>(stream);
+
+  // Skip to state data
+  stream->Seek(0x68, SEEK_CUR);
+
+  data->MvlVerticesCount = Io::ReadLE<int>(stream);
+  int vertexOffset = Io::ReadLE<int>(stream);
+
+  for (int i = 0; i < stateCount; i++) {
+    int count = Io::ReadLE<int>(stream);
+    int start = Io::ReadLE<int>(stream);
+
+    // I... couldn't come up with anything better
+    char name[32];
+    Io::ReadArrayLE<char>(name, stream, 32);
+    int id = 0;
+    int idx = strlen(name) - 2;
+    if (isdigit(name[idx])) {
+      id = atoi(&name[idx]);
+    } else if (name[idx] == 'L') {  // Lip
+      idx -= 2;
+      id = atoi(&name[idx]);
+      idx += 3;
+      id = (0x40000000 | (id << 8)) | atoi(&name[idx]);
+    } else if (name[idx] == 'E') {  // Eye
+      idx -= 2;
+      id = atoi(&name[idx]);
+      idx += 3;
+      id = (0x30000000 | (id << 8)) | atoi(&name[idx]);
+    }
+    States[id].Count = count;
 
-    err = Io::VfsOpen("chara", fileId + 1, &stream);
-    if (err != IoError_OK) return false;
-
-    OffsetX = Profile::DesignWidth / 2;
-    OffsetY = Profile::DesignHeight / 2;
-
-    Io::ReadLE<int>(stream);
-    int stateCount = Io::ReadLE<int>(stream);
-
-    // Skip to state data
-    stream->Seek(0x68, SEEK_CUR);
-
-    MvlVerticesCount = Io::ReadLE<int>(stream);
-    int vertexOffset = Io::ReadLE<int>(stream);
-
-    for (int i = 0; i < stateCount; i++) {
-      int count = Io::ReadLE<int>(stream);
-      int start = Io::ReadLE<int>(stream);
-
-      // I... couldn't come up with anything better
-      char name[32];
-      Io::ReadArrayLE<char>(name, stream, 32);
-      int id = 0;
-      int idx = strlen(name) - 2;
-      if (isdigit(name[idx])) {
-        id = atoi(&name[idx]);
-      } else if (name[idx] == 'L') {  // Lip
-        idx -= 2;
-        id = atoi(&name[idx]);
-        idx += 3;
-        id = (0x40000000 | (id << 8)) | atoi(&name[idx]);
-      } else if (name[idx] == 'E') {  // Eye
-        idx -= 2;
-        id = atoi(&name[idx]);
-        idx += 3;
-        id = (0x30000000 | (id << 8)) | atoi(&name[idx]);
-      }
-      States[id].Count = count;
+    long back = stream->Position;
 
-      long back = stream->Position;
+    stream->Seek(start, SEEK_SET);
+    if (States[id].Indices) free(States[id].Indices);
+    States[id].Indices = (uint16_t*)malloc(sizeof(uint16_t) * count);
+    Io::ReadArrayLE<uint16_t>(States[id].Indices, stream, count);
+    data->Size += sizeof(Character2DState) + sizeof(uint16_t) * count;
 
-      stream->Seek(start, SEEK_SET);
-      States[id].Indices = (uint16_t*)malloc(sizeof(uint16_t) * count);
-      Io::ReadArrayLE<uint16_t>(States[id].Indices, stream, count);
+    stream->Seek(back, SEEK_SET);
+    stream->Seek(0x18, SEEK_CUR);
+  }
 
-      stream->Seek(back, SEEK_SET);
-      stream->Seek(0x18, SEEK_CUR);
-    }
+  // They seem to use the whole vertex array in all states, so... read it once
+  // and forget about it?
+  stream->Seek(vertexOffset, SEEK_SET);
+  data->MvlVertices =
+      (float*)malloc(sizeof(float) * data->MvlVerticesCount * 5);
+  Io::ReadArrayLE<float>(data->MvlVertices, stream,
+                         data->MvlVerticesCount * 5);
+  data->Size += sizeof(float) * data->MvlVerticesCount * 5;
+}
 
-    // They seem to use the whole vertex array in all states, so... read it once
-    // and forget about it?
-    stream->Seek(vertexOffset, SEEK_SET);
-    MvlVertices = (float*)malloc(sizeof(float) * MvlVerticesCount * 5);
-    Io::ReadArrayLE<float>(MvlVertices, stream, MvlVerticesCount * 5);
+static void LoadLay(Io::InputStream* stream, Character2DData* data) {
+  auto& States = data->States;
 
-    delete stream;
+  int (*StreamReadInt)(Io::InputStream*);
+  float (*StreamReadFloat)(Io::InputStream*);
+  if (Profile::LayFileBigEndian) {
+    StreamReadInt = &Io::ReadBE<int>;
+    StreamReadFloat = &Io::ReadBE<float>;
   } else {
-    // LAY format
-    err = Io::VfsOpen("chara", fileId + 1, &stream);
-    if (err != IoError_OK) return false;
-
-    Face = charaId;
-
-    OffsetX = Profile::DesignWidth / 2;
-    OffsetY = Profile::DesignHeight / 2;
-
-    int (*StreamReadInt)(Io::InputStream*);
-    float (*StreamReadFloat)(Io::InputStream*);
-    if (Profile::LayFileBigEndian) {
-      StreamReadInt = &Io::ReadBE<int>;
-      StreamReadFloat = &Io::ReadBE<float>;
-    } else {
-      StreamReadInt = &Io::ReadLE<int>;
-      StreamReadFloat = &Io::ReadLE<float>;
+    StreamReadInt = &Io::ReadLE<int>;
+    StreamReadFloat = &Io::ReadLE<float>;
+  }
+  int stateCount = StreamReadInt(stream);
+  StreamReadInt(stream);
+
+  for (int i = 0; i < stateCount; i++) {
+    int id = StreamReadInt(stream);
+    int start = StreamReadInt(stream);
+    int count = StreamReadInt(stream);
+
+    long back = stream->Position;
+
+    if (States[id].ScreenCoords) free(States[id].ScreenCoords);
+    if (States[id].TextureCoords) free(States[id].TextureCoords);
+    States[id].Count = count;
+    States[id].ScreenCoords = (glm::vec2*)malloc(count * sizeof(glm::vec2));
+    States[id].TextureCoords = (glm::vec2*)malloc(count * sizeof(glm::vec2));
+    data->Size += sizeof(Character2DState) + 2 * count * sizeof(glm::vec2);
+    stream->Seek(12 * (stateCount) + 8 + (start * 16), SEEK_SET);
+    for (int i = 0; i < count; i++) {
+      States[id].ScreenCoords[i].x = StreamReadFloat(stream) + 1.0f;
+      States[id].ScreenCoords[i].y = StreamReadFloat(stream) + 1.0f;
+      States[id].TextureCoords[i].x =
+          StreamReadFloat(stream) * Profile::LayFileTexXMultiplier - 1.0f;
+      States[id].TextureCoords[i].y =
+          StreamReadFloat(stream) * Profile::LayFileTexYMultiplier - 1.0f;
     }
-    int stateCount = StreamReadInt(stream);
-    StreamReadInt(stream);
-
-    for (int i = 0; i < stateCount; i++) {
-      int id = StreamReadInt(stream);
-      int start = StreamReadInt(stream);
-      int count = StreamReadInt(stream);
-
-      long back = stream->Position;
-
-      States[id].Count = count;
-      States[id].ScreenCoords = (glm::vec2*)malloc(count * sizeof(glm::vec2));
-      States[id].TextureCoords = (glm::vec2*)malloc(count * sizeof(glm::vec2));
-      stream->Seek(12 * (stateCount) + 8 + (start * 16), SEEK_SET);
-      for (int i = 0; i < count; i++) {
-        States[id].ScreenCoords[i].x = StreamReadFloat(stream) + 1.0f;
-        States[id].ScreenCoords[i].y = StreamReadFloat(stream) + 1.0f;
-        States[id].TextureCoords[i].x =
-            StreamReadFloat(stream) * Profile::LayFileTexXMultiplier - 1.0f;
-        States[id].TextureCoords[i].y =
-            StreamReadFloat(stream) * Profile::LayFileTexYMultiplier - 1.0f;
-      }
 
-      stream->Seek(back, SEEK_SET);
-    }
+    stream->Seek(back, SEEK_SET);
+  }
+}
 
-    delete stream;
+bool Character2D::LoadSync(uint32_t charaId) {
+  int fileId = charaId & 0xFFFF;
+
+  CharaTextureCached = AssetCache::LoadTexture("chara", fileId, &CharaTexture);
+  if (!CharaTextureCached) return false;
+
+  Face = charaId;
+  if (Profile::CharaIsMvl) {
+    LipFrame = 1;
+    EyeFrame = 1;
   }
+
+  OffsetX = Profile::DesignWidth / 2;
+  OffsetY = Profile::DesignHeight / 2;
+
+  Data = (Character2DData*)AssetCache::Acquire("chara", fileId + 1);
+  if (Data) return true;
+
+  Io::InputStream* stream;
+  int64_t err = Io::VfsOpen("chara", fileId + 1, &stream);
+  if (err != IoError_OK) return false;
+
+  Character2DData* data = new Character2DData;
+  if (Profile::CharaIsMvl) {
+    LoadMvl(stream, data);
+  } else {
+    LoadLay(stream, data);
+  }
+  delete stream;
+
+  Data = (Character2DData*)AssetCache::Insert("chara", fileId + 1, data,
+                                              data->Size, &FreeCharacter2DData);
   return true;
 }
 
 void Character2D::UnloadSync() {
-  glDeleteTextures(1, &CharaSpriteSheet.Texture);
+  if (CharaSpriteSheet.Texture) glDeleteTextures(1, &CharaSpriteSheet.Texture);
   CharaSpriteSheet.DesignHeight = 0.0f;
   CharaSpriteSheet.DesignWidth = 0.0f;
   CharaSpriteSheet.Texture = 0;
   Show = false;
   Layer = -1;
-  if (MvlVertices) {
-    MvlVerticesCount = 0;
-    free(MvlVertices);
+  if (Data) {
+    AssetCache::Release("chara", (NextLoadId & 0xFFFF) + 1);
+    Data = 0;
   }
   MvlIndicesCount = 0;
-  States.clear();
   StatesToDraw.clear();
 }
 
 void Character2D::MainThreadOnLoad() {
-  CharaSpriteSheet.Texture = CharaTexture.Submit();
+  if (CharaTextureCached) {
+    CharaSpriteSheet.Texture = CharaTexture.Upload();
+    AssetCache::Release("chara", NextLoadId & 0xFFFF);
+    CharaTextureCached = false;
+  } else {
+    CharaSpriteSheet.Texture = CharaTexture.Submit();
+  }
   CharaSpriteSheet.DesignWidth = CharaTexture.Width;
   CharaSpriteSheet.DesignHeight = CharaTexture.Height;
   CharaSprite.Sheet = CharaSpriteSheet;
@@ -158,6 +191,9 @@ void Character2D::MainThreadOnLoad() {
 }
 
 void Character2D::Update(float dt) {
+  if (!Data) return;
+
+  auto const& States = Data->States;
   if (Profile::CharaIsMvl) {
     MvlIndicesCount = 0;
     StatesToDraw.clear();
@@ -168,8 +204,9 @@ void Character2D::Update(float dt) {
                            EyeFrame);  // eye
 
     for (auto id : StatesToDraw) {
-      if (States.count(id)) {
-        Character2DState state = States[id];
+      auto it = States.find(id);
+      if (it != States.end()) {
+        Character2DState const& state = it->second;
         memcpy(&MvlIndices[MvlIndicesCount], state.Indices,
                state.Count * sizeof(uint16_t));
         MvlIndicesCount += state.Count;
@@ -190,14 +227,17 @@ void Character2D::Update(float dt) {
 }
 
 void Character2D::Render() {
+  if (!Data) return;
+
   if (Profile::CharaIsMvl) {
     Renderer2D::DrawCharacterMvl(CharaSprite, glm::vec2(OffsetX, OffsetY),
-                                 MvlVerticesCount, MvlVertices, MvlIndicesCount,
-                                 MvlIndices);
+                                 Data->MvlVerticesCount, Data->MvlVertices,
+                                 MvlIndicesCount, MvlIndices);
   } else {
     for (auto id : StatesToDraw) {
-      if (States.count(id)) {
-        Character2DState state = States[id];
+      auto it = Data->States.find(id);
+      if (it != Data->States.end()) {
+        Character2DState const& state = it->second;
         for (int i = 0; i < state.Count; i++) {
           CharaSprite.Bounds = RectF(state.TextureCoords[i].x,
                                      state.TextureCoords[i].y, 32.0f, 32.0f);
@@ -12,18 +12,33 @@
 namespace Impacto {
 
 struct Character2DState {
-  int Count;
+  int Count = 0;
   // LAY
-  glm::vec2* ScreenCoords;
-  glm::vec2* TextureCoords;
+  glm::vec2* ScreenCoords = 0;
+  glm::vec2* TextureCoords = 0;
   // MVL
-  uint16_t* Indices;
+  uint16_t* Indices = 0;
+};
+
+// Parsed LAY/MVL file of a character sprite, shared through the asset cache
+// by all Character2Ds showing that sprite
+struct Character2DData {
+  ska::flat_hash_map<int, Character2DState> States;
+
+  float* MvlVertices = 0;
+  int MvlVerticesCount = 0;
+
+  // Approximate heap footprint, for the asset cache budget
+  int64_t Size = sizeof(Character2DData);
+
+  ~Character2DData();
 };
 
 int const MaxMvlIndices = 128 * 1024;
 
-class Character2D : public Loadable<Character2D> {
-  friend class Loadable<Character2D>;
+class Character2D
+    : public Loadable<Character2D, WorkQueue::WP_Character> {
+  friend class Loadable<Character2D, WorkQueue::WP_Character>;
 
  public:
   Sprite CharaSprite;
@@ -44,14 +59,15 @@ class Character2D : public Loadable<Character2D> {
 
  private:
   Texture CharaTexture;
+  // CharaTexture.Buffer is pinned in the asset cache until MainThreadOnLoad()
+  bool CharaTextureCached = false;
   SpriteSheet CharaSpriteSheet;
 
-  ska::flat_hash_map<int, Character2DState> States;
+  // Pinned in the asset cache while loaded
+  Character2DData* Data = 0;
   std::vector<int> StatesToDraw;
 
-  float* MvlVertices;
   uint16_t MvlIndices[MaxMvlIndices];
-  int MvlVerticesCount;
   int MvlIndicesCount;
 };
 
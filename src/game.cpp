@@ -3,11 +3,14 @@
 #include "window.h"
 #include "../vendor/nuklear/nuklear_sdl_gl3.h"
 #include "workqueue.h"
+#include "vm/profiler.h"
+#include "assetcache.h"
 #include "modelviewer.h"
 #include "characterviewer.h"
 #include "log.h"
 #include "inputsystem.h"
 #include "savesystem.h"
+#include "snapshot.h"
 #include "audio/audiosystem.h"
 #include "audio/audiochannel.h"
 #include "audio/audiostream.h"
@@ -35,6 +38,7 @@
 #include "profile/scene3d.h"
 #include "profile/vm.h"
 #include "profile/scriptvars.h"
+#include "profile/scriptinput.h"
 #include "profile/hud/datedisplay.h"
 #include "profile/hud/sysmesbox.h"
 
@@ -51,12 +55,26 @@ namespace Game {
 DrawComponentType DrawComponents[Vm::MaxThreads];
 
 bool ShouldQuit = false;
+bool Headless = false;
+bool AutoAdvance = false;
+static bool AutoAdvancePressed = false;
 
 static void Init() {
   WorkQueue::Init();
 
   Profile::LoadGameFromJson();
 
+  AssetCache::Init((int64_t)Profile::AssetCacheSize * 1024 * 1024);
+
+  if (Headless) {
+    // Unless Window::NoGL is set, the window and GL context stay around
+    // (hidden) for renderer setup and texture uploads
+    Profile::GameFeatures &=
+        ~(GameFeature::Nuklear | GameFeature::Audio |
+          GameFeature::ModelViewer | GameFeature::CharacterViewer);
+    Window::Hidden = true;
+  }
+
   Io::VfsInit();
   Window::Init();
 
@@ -88,7 +106,7 @@ static void Init() {
     Profile::LoadAnimations();
     DialoguePage::Init();
 
-    Renderer2D::Init();
+    if (!Window::NoGL) Renderer2D::Init();
   }
 
   if (Profile::GameFeatures & GameFeature::ModelViewer) {
@@ -137,9 +155,19 @@ void Shutdown() {
     nk_sdl_shutdown();
   }
 
+  AssetCache::Shutdown();
+
   Window::Shutdown();
 }
 
+bool IsSkipping() {
+  if (!(Profile::GameFeatures & GameFeature::Sc3VirtualMachine)) return false;
+  return Input::KeyboardButtonIsDown[SDL_SCANCODE_RCTRL] ||
+         GetFlag(SF_MESALLSKIP);
+}
+
+static void UpdateState(float dt);
+
 void Update(float dt) {
   SDL_Event e;
   if (Profile::GameFeatures & GameFeature::Nuklear) {
@@ -168,11 +196,32 @@ void Update(float dt) {
   }
   if (Profile::GameFeatures & GameFeature::Input) {
     Input::EndFrame();
+    if (Headless && AutoAdvance) {
+      // Released every other frame, since prompts wait for a new press
+      int confirm = Profile::ScriptInput::KB_PAD1A;
+      AutoAdvancePressed = !AutoAdvancePressed;
+      Input::KeyboardButtonWentDown[confirm] = AutoAdvancePressed;
+      Input::KeyboardButtonIsDown[confirm] = AutoAdvancePressed;
+      Input::KeyboardButtonIsDown[SDL_SCANCODE_RCTRL] = true;
+    }
   }
   if (Profile::GameFeatures & GameFeature::Nuklear) {
     nk_input_end(Nk);
   }
 
+  UpdateState(dt);
+}
+
+void UpdateExtra(float dt) {
+  // Presses were handled by the frame's first update
+  if (Profile::GameFeatures & GameFeature::Input) {
+    Input::BeginFrame();
+  }
+
+  UpdateState(dt);
+}
+
+static void UpdateState(float dt) {
   if (Profile::GameFeatures & GameFeature::ModelViewer) {
     ModelViewer::Update(dt);
   }
@@ -214,6 +263,7 @@ void Update(float dt) {
 }
 
 static bool DebugWindowEnabled = false;
+static bool ProfilerWindowEnabled = false;
 // FPS counter
 static float LastTime;
 static int Frames = 0;
@@ -240,6 +290,10 @@ void Render() {
     if (Input::KeyboardButtonWentDown[SDL_SCANCODE_E] ||
         Input::ControllerButtonWentDown[SDL_CONTROLLER_BUTTON_Y])
       DebugWindowEnabled = !DebugWindowEnabled;
+    if (Input::KeyboardButtonWentDown[SDL_SCANCODE_P]) {
+      ProfilerWindowEnabled = !ProfilerWindowEnabled;
+      Vm::ProfileOpcodes = ProfilerWindowEnabled;
+    }
 
     // FPS counter
     Frames++;
@@ -260,6 +314,15 @@ void Render() {
         snprintf(buffer, 32, "FPS: %02.2f", FPS);
         nk_label(Nk, buffer, NK_TEXT_ALIGN_CENTERED);
 
+        nk_layout_row_dynamic(Nk, 24, 2);
+        if (nk_button_label(Nk, "Save snapshot")) {
+          Snapshot::Save("snapshot.bin");
+        }
+        if (nk_button_label(Nk, "Load snapshot")) {
+          Snapshot::Load("snapshot.bin");
+        }
+        nk_layout_row_dynamic(Nk, 24, 1);
+
         nk_property_int(Nk, "ScrWork start index", 0, &ScrWorkIndexStart, 8000,
                         1, 1.0f);
         nk_property_int(Nk, "ScrWork end index", 0, &ScrWorkIndexEnd, 8000, 1,
@@ -304,6 +367,8 @@ void Render() {
       }
       nk_end(Nk);
     }
+
+    if (ProfilerWindowEnabled) Vm::ShowProfilerWindow();
   }
 
   if (Profile::GameFeatures & GameFeature::Renderer2D) {
@@ -47,11 +47,26 @@ void InitFromProfile(std::string const& name);
 void Shutdown();
 
 void Update(float dt);
+// Another update within the same displayed frame: doesn't pump events or
+// Nuklear input, and reports no new presses, but buttons held stay held
+void UpdateExtra(float dt);
 void Render();
 
+// Text skip, held with right Ctrl or requested by the scripts (SF_MESALLSKIP).
+// While skipping, the main loop runs several updates per rendered frame, and
+// voices and the typewriter effect are left out.
+bool IsSkipping();
+
 extern DrawComponentType DrawComponents[Vm::MaxThreads];
 
 extern bool ShouldQuit;
+
+// Set before InitFromProfile() to run without audio and debug UI and with a
+// hidden window. Render() must not be called in headless mode.
+extern bool Headless;
+// Headless only: hold skip and press confirm every other frame, so scripts
+// keep going through messages and prompts without input
+extern bool AutoAdvance;
 }  // namespace Game
 
 }  // namespace Impacto
\ No newline at end of file
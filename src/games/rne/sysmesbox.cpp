@@ -34,10 +34,7 @@ void SysMesBox::Show() {
   // Hack...
   if (Profile::Vm::GameInstructionSet == +Vm::InstructionSet::RNE) {
     if (!ScrWork[SW_SYSMESANIMCTCUR]) {
-      Io::InputStream* stream;
-      Io::VfsOpen("sysse", 16, &stream);
-      Audio::Channels[Audio::AC_SSE].Play(Audio::AudioStream::Create(stream),
-                                          false, 0.0f);
+      Audio::Channels[Audio::AC_SSE].Play("sysse", 16, false, 0.0f);
     }
   }
 }
@@ -46,10 +43,7 @@ void SysMesBox::Hide() {
   // Hack...
   if (Profile::Vm::GameInstructionSet == +Vm::InstructionSet::RNE) {
     if (ScrWork[SW_SYSMESANIMCTCUR] == ScrWork[SW_SYSMESANIMCTF]) {
-      Io::InputStream* stream;
-      Io::VfsOpen("sysse", 29, &stream);
-      Audio::Channels[Audio::AC_SSE].Play(Audio::AudioStream::Create(stream),
-                                          false, 0.0f);
+      Audio::Channels[Audio::AC_SSE].Play("sysse", 29, false, 0.0f);
     }
   }
 }
@@ -152,10 +146,7 @@ void SysMesBox::Update(float dt) {
 
     // Nice input
     if (Input::KeyboardButtonWentDown[SDL_SCANCODE_RIGHT]) {
-      Io::InputStream* stream;
-      Io::VfsOpen("sysse", 1, &stream);
-      Audio::Channels[Audio::AC_SSE].Play(Audio::AudioStream::Create(stream),
-                                          false, 0.0f);
+      Audio::Channels[Audio::AC_SSE].Play("sysse", 1, false, 0.0f);
       if (CurrentChoice == 255)
         CurrentChoice = 1;
       else {
@@ -163,10 +154,7 @@ void SysMesBox::Update(float dt) {
         if (CurrentChoice > 1) CurrentChoice = 0;
       }
     } else if (Input::KeyboardButtonWentDown[SDL_SCANCODE_LEFT]) {
-      Io::InputStream* stream;
-      Io::VfsOpen("sysse", 1, &stream);
-      Audio::Channels[Audio::AC_SSE].Play(Audio::AudioStream::Create(stream),
-                                          false, 0.0f);
+      Audio::Channels[Audio::AC_SSE].Play("sysse", 1, false, 0.0f);
       if (CurrentChoice == 255)
         CurrentChoice = 0;
       else {
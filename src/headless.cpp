@@ -0,0 +1,772 @@
+#include "impacto.h"
+
+#include "log.h"
+#include "game.h"
+#include "window.h"
+#include "vm/profiler.h"
+#include "vm/vm.h"
+#include "vm/scriptpool.h"
+#include "mem.h"
+
+#include "io/physicalfilestream.h"
+#include "io/mappedfilestream.h"
+#include "io/memorystream.h"
+#include "io/vfs.h"
+#include "io/cpkarchive.h"
+#include "io/cpkutftable.h"
+#include "audio/audiostream.h"
+#include "audio/audiosystem.h"
+
+// Runs the game loop without rendering or audio and without a frame lock, with
+// a fixed timestep, and reports VM throughput. A hidden window and GL context
+// are still created for renderer setup and texture uploads, so this needs a
+// display, unless --no-gl is given: then there is no window or context at all
+// and textures are only decoded (for CI). Usage:
+// impacto-headless [frames (default 3600)] [dt (default 1/60)] [profile output
+// (.csv or .json)]
+// --profile-opcodes also times every instruction and reports the most
+// expensive opcodes, which slows the VM down (implied by a profile output).
+// --auto-advance holds skip and keeps pressing confirm, so scripts don't stop
+// at messages and prompts. These and --no-gl may go anywhere on the command
+// line.
+// Or runs the same frames from the same starting state twice and checks that
+// ScrWork and FlagWork end up identical, and that the label, string and return
+// lookups of every script loaded meanwhile match its stored header tables:
+// impacto-headless --determinism [frames (default 3600)] [dt (default 1/60)]
+// Or compares the VM's thread table ordering with the stable sort it replaced
+// over random changes (needs no game data):
+// impacto-headless --thread-order-check [iterations (default 100000)]
+// Or checks the script analyzer's operand layouts against every script: each
+// instruction decoded from a label has to end where another one (or the next
+// label) starts:
+// impacto-headless --layout-check
+// Or decodes every audio file of a mountpoint from memory and reports decoder
+// throughput:
+// impacto-headless --decode <mountpoint> [float (32-bit output where native)]
+// Or compares CPK @UTF table readers on a synthetic table (needs no game data):
+// impacto-headless --utf-bench [rows (default 100000)]
+// Or decompresses every CRILAYLA-compressed file of a CPK and reports
+// throughput (needs no game data):
+// impacto-headless --layla-bench <cpk file>
+
+using namespace Impacto;
+
+static int const ReportedOpcodes = 20;
+
+static void LogOpcodeProfile(uint64_t totalTicks) {
+  std::vector<Vm::OpcodeProfileEntry> entries = Vm::GetOpcodeProfile();
+  if ((int)entries.size() > ReportedOpcodes) entries.resize(ReportedOpcodes);
+
+  double frequency = (double)SDL_GetPerformanceFrequency();
+  ImpLog(LL_Info, LC_VM, "Most expensive opcodes:\n");
+  for (auto const& entry : entries) {
+    double ms = entry.Stats.Ticks * 1000.0 / frequency;
+    ImpLog(LL_Info, LC_VM,
+           "  %02X:%02X %10llu calls %10.3f ms (%5.2f%%) %8.3f us/call\n",
+           entry.Group, entry.Opcode, (unsigned long long)entry.Stats.Count, ms,
+           totalTicks ? entry.Stats.Ticks * 100.0 / totalTicks : 0.0,
+           ms * 1000.0 / entry.Stats.Count);
+  }
+}
+
+static void DecodeBenchmark(std::string const& mountpoint) {
+  std::map<uint32_t, std::string> listing;
+  if (Io::VfsListFiles(mountpoint, listing) != IoError_OK) {
+    ImpLog(LL_Fatal, LC_General, "Couldn't list files in %s\n",
+           mountpoint.c_str());
+    return;
+  }
+
+  uint8_t* buffer = (uint8_t*)malloc(Audio::AudioChannel::AudioBufferSize);
+  int files = 0;
+  int64_t totalSamples = 0;
+  double audioSeconds = 0.0;
+  uint64_t totalTicks = 0;
+  for (auto const& file : listing) {
+    void* data;
+    int64_t size;
+    if (Io::VfsSlurp(mountpoint, file.first, &data, &size) != IoError_OK) {
+      continue;
+    }
+    Io::InputStream* stream = new Io::MemoryStream(data, size, true);
+
+    uint64_t start = SDL_GetPerformanceCounter();
+    Audio::AudioStream* audio = Audio::AudioStream::Create(stream);
+    if (!audio) {
+      delete stream;
+      continue;
+    }
+    int bufferSamples =
+        Audio::AudioChannel::AudioBufferSize / audio->BytesPerSample();
+    int64_t samples = 0;
+    int read;
+    while ((read = audio->Read(buffer, bufferSamples)) > 0) samples += read;
+    totalTicks += SDL_GetPerformanceCounter() - start;
+
+    files++;
+    totalSamples += samples;
+    audioSeconds += (double)samples / audio->SampleRate;
+    delete audio;
+  }
+  free(buffer);
+
+  double seconds = (double)totalTicks / (double)SDL_GetPerformanceFrequency();
+  if (seconds <= 0.0) seconds = 1e-9;
+  ImpLog(LL_Info, LC_Audio,
+         "Decoded %d files (%.1f s audio) in %.3f s: %.1f Msamples/s, %.0fx "
+         "realtime\n",
+         files, audioSeconds, seconds, totalSamples / seconds / 1e6,
+         audioSeconds / seconds);
+}
+
+static void LaylaBenchmark(std::string const& path) {
+  // Mapped if possible, so we time decompression rather than reads
+  Io::InputStream* stream;
+  if (Io::MappedFileStream::Create(path, &stream) != IoError_OK &&
+      Io::PhysicalFileStream::Create(path, &stream) != IoError_OK) {
+    ImpLog(LL_Fatal, LC_General, "Couldn't open %s\n", path.c_str());
+    return;
+  }
+  Io::VfsArchive* archive;
+  if (Io::CpkArchive::Create(stream, &archive) != IoError_OK) {
+    ImpLog(LL_Fatal, LC_General, "%s is not a CPK\n", path.c_str());
+    delete stream;
+    return;
+  }
+
+  int files = 0;
+  int64_t compressedBytes = 0;
+  int64_t uncompressedBytes = 0;
+  uint64_t totalTicks = 0;
+  for (auto const& file : archive->IdsToFiles) {
+    int64_t offset, storedSize;
+    archive->GetStorage(file.second, &offset, &storedSize);
+
+    void* data;
+    int64_t size;
+    uint64_t start = SDL_GetPerformanceCounter();
+    // Fails for files that are stored as-is
+    if (archive->Slurp(file.second, &data, &size) != IoError_OK) continue;
+    totalTicks += SDL_GetPerformanceCounter() - start;
+    free(data);
+
+    files++;
+    compressedBytes += storedSize;
+    uncompressedBytes += size;
+  }
+  delete archive;
+
+  double seconds = (double)totalTicks / (double)SDL_GetPerformanceFrequency();
+  if (seconds <= 0.0) seconds = 1e-9;
+  ImpLog(LL_Info, LC_IO,
+         "Decompressed %d files (%.1f MiB to %.1f MiB) in %.3f s: %.1f MiB/s "
+         "in, %.1f MiB/s out\n",
+         files, compressedBytes / 1048576.0, uncompressedBytes / 1048576.0,
+         seconds, compressedBytes / 1048576.0 / seconds,
+         uncompressedBytes / 1048576.0 / seconds);
+}
+
+// impacto-headless --utf-bench
+namespace Impacto {
+namespace Io {
+
+// The reader CpkUtfTable replaced, kept only to compare against: one hash map
+// from column name to cell per row, strings copied out through stream seeks,
+// data cells copied into their own allocations
+int const LegacyUtfMaxPath = 224;
+
+struct LegacyUtfCell {
+  union {
+    uint8_t Uint8Val;
+    uint16_t Uint16Val;
+    uint32_t Uint32Val;
+    uint64_t Uint64Val;
+    uint8_t* DataArray;
+    float FloatVal;
+    char StringVal[LegacyUtfMaxPath];
+  };
+  uint64_t DataSize;
+};
+
+struct LegacyUtfColumn {
+  uint32_t Flags;
+  char Name[LegacyUtfMaxPath];
+};
+
+typedef std::vector<ska::flat_hash_map<std::string, LegacyUtfCell>>
+    LegacyUtfRows;
+
+static void LegacyReadUtfString(InputStream* stream, int64_t stringsOffset,
+                                char* output) {
+  int64_t stringAddr = stringsOffset + ReadBE<uint32_t>(stream);
+  int64_t retAddr = stream->Position;
+  stream->Seek(stringAddr, RW_SEEK_SET);
+  memset(output, 0, LegacyUtfMaxPath);
+  char ch;
+  int i = 0;
+  while ((ch = ReadU8(stream)) != 0x00 && i < LegacyUtfMaxPath - 1) {
+    output[i++] = ch;
+  }
+  stream->Seek(retAddr, RW_SEEK_SET);
+}
+
+static bool LegacyReadUtfBlock(uint8_t* utfBlock, uint64_t utfSize,
+                               LegacyUtfRows* rows) {
+  const uint32_t utfMagic = 0x40555446;
+  MemoryStream stream(utfBlock, utfSize, false);
+  if (ReadBE<uint32_t>(&stream) != utfMagic) {
+    DecryptUtfBlock(utfBlock, utfSize);
+    stream.Seek(0, RW_SEEK_SET);
+    if (ReadBE<uint32_t>(&stream) != utfMagic) return false;
+  }
+
+  stream.Seek(4, RW_SEEK_CUR);
+  int64_t rowsOffset = ReadBE<uint32_t>(&stream) + 8;
+  int64_t stringsOffset = ReadBE<uint32_t>(&stream) + 8;
+  int64_t dataOffset = ReadBE<uint32_t>(&stream) + 8;
+  stream.Seek(4, RW_SEEK_CUR);
+  uint16_t numColumns = ReadBE<uint16_t>(&stream);
+  uint16_t rowLength = ReadBE<uint16_t>(&stream);
+  uint32_t numRows = ReadBE<uint32_t>(&stream);
+
+  std::vector<LegacyUtfColumn> columns(numColumns);
+  for (auto& column : columns) {
+    column.Flags = ReadU8(&stream);
+    if (column.Flags == 0) column.Flags = ReadBE<uint32_t>(&stream);
+    LegacyReadUtfString(&stream, stringsOffset, column.Name);
+    // Constant values follow the schema entry, the old reader never
+    // returned them but still had to skip them
+    if ((column.Flags & STORAGE_MASK) == STORAGE_CONSTANT) {
+      switch (column.Flags & TYPE_MASK) {
+        case TYPE_1BYTE:
+        case TYPE_1BYTE2:
+          stream.Seek(1, RW_SEEK_CUR);
+          break;
+        case TYPE_2BYTE:
+        case TYPE_2BYTE2:
+          stream.Seek(2, RW_SEEK_CUR);
+          break;
+        case TYPE_8BYTE:
+        case TYPE_8BYTE2:
+        case TYPE_DATA:
+          stream.Seek(8, RW_SEEK_CUR);
+          break;
+        default:
+          stream.Seek(4, RW_SEEK_CUR);
+          break;
+      }
+    }
+  }
+
+  for (uint32_t i = 0; i < numRows; i++) {
+    stream.Seek(rowsOffset + (int64_t)i * rowLength, RW_SEEK_SET);
+    ska::flat_hash_map<std::string, LegacyUtfCell> row;
+    for (auto& column : columns) {
+      LegacyUtfCell cell;
+      cell.DataSize = 0;
+      if ((column.Flags & STORAGE_MASK) == STORAGE_PERROW) {
+        switch (column.Flags & TYPE_MASK) {
+          case TYPE_1BYTE:
+          case TYPE_1BYTE2:
+            cell.Uint8Val = ReadU8(&stream);
+            break;
+          case TYPE_2BYTE:
+          case TYPE_2BYTE2:
+            cell.Uint16Val = ReadBE<uint16_t>(&stream);
+            break;
+          case TYPE_4BYTE:
+          case TYPE_4BYTE2:
+            cell.Uint32Val = ReadBE<uint32_t>(&stream);
+            break;
+          case TYPE_8BYTE:
+          case TYPE_8BYTE2:
+            cell.Uint64Val = ReadBE<uint64_t>(&stream);
+            break;
+          case TYPE_FLOAT:
+            cell.FloatVal = ReadBE<float>(&stream);
+            break;
+          case TYPE_STRING:
+            LegacyReadUtfString(&stream, stringsOffset, cell.StringVal);
+            break;
+          case TYPE_DATA: {
+            int64_t dataPos = ReadBE<uint32_t>(&stream) + dataOffset;
+            uint64_t dataSize = ReadBE<uint32_t>(&stream);
+            int64_t retAddr = stream.Position;
+            cell.DataArray = (uint8_t*)malloc(dataSize + sizeof(uint64_t));
+            cell.DataSize = dataSize;
+            stream.Seek(dataPos, RW_SEEK_SET);
+            stream.Read(cell.DataArray, dataSize);
+            stream.Seek(retAddr, RW_SEEK_SET);
+            break;
+          }
+        }
+      } else {
+        cell.Uint64Val = 0;
+      }
+      row[column.Name] = cell;
+    }
+    rows->push_back(row);
+  }
+  return true;
+}
+
+static void PutBE16(std::vector<uint8_t>& out, uint16_t val) {
+  val = SDL_SwapBE16(val);
+  out.insert(out.end(), (uint8_t*)&val, (uint8_t*)&val + sizeof(val));
+}
+static void PutBE32(std::vector<uint8_t>& out, uint32_t val) {
+  val = SDL_SwapBE32(val);
+  out.insert(out.end(), (uint8_t*)&val, (uint8_t*)&val + sizeof(val));
+}
+static void PutBE64(std::vector<uint8_t>& out, uint64_t val) {
+  val = SDL_SwapBE64(val);
+  out.insert(out.end(), (uint8_t*)&val, (uint8_t*)&val + sizeof(val));
+}
+
+// Shaped like a real TOC: constant directory name and user string, per-row
+// file name, sizes, offset and ID
+static std::vector<uint8_t> BuildBenchmarkUtfTable(uint32_t rowCount) {
+  std::string strings("<NULL>\0TOC\0", 11);
+  auto addString = [&strings](char const* str) {
+    uint32_t offset = strings.size();
+    strings += str;
+    strings += '\0';
+    return offset;
+  };
+
+  struct {
+    uint8_t Flags;
+    char const* Name;
+  } const columns[] = {
+      {STORAGE_CONSTANT | TYPE_STRING, "DirName"},
+      {STORAGE_PERROW | TYPE_STRING, "FileName"},
+      {STORAGE_PERROW | TYPE_4BYTE, "FileSize"},
+      {STORAGE_PERROW | TYPE_4BYTE, "ExtractSize"},
+      {STORAGE_PERROW | TYPE_8BYTE, "FileOffset"},
+      {STORAGE_PERROW | TYPE_4BYTE, "ID"},
+      {STORAGE_CONSTANT | TYPE_STRING, "UserString"},
+  };
+  uint16_t const rowLength = 4 + 4 + 4 + 8 + 4;
+
+  std::vector<uint8_t> schema;
+  for (auto const& column : columns) {
+    schema.push_back(column.Flags);
+    PutBE32(schema, addString(column.Name));
+    if ((column.Flags & STORAGE_MASK) == STORAGE_CONSTANT) {
+      PutBE32(schema, addString(column.Name[0] == 'D' ? "script" : ""));
+    }
+  }
+
+  std::vector<uint8_t> rows;
+  rows.reserve((size_t)rowCount * rowLength);
+  uint64_t fileOffset = 0x800;
+  for (uint32_t i = 0; i < rowCount; i++) {
+    char fileName[32];
+    snprintf(fileName, sizeof(fileName), "file%06u.bin", i);
+    uint32_t size = 0x800 + (i * 2654435761u) % 0x40000;
+    PutBE32(rows, addString(fileName));
+    PutBE32(rows, i % 3 ? size : size / 2);
+    PutBE32(rows, size);
+    PutBE64(rows, fileOffset);
+    PutBE32(rows, i);
+    fileOffset += (size + 0x7FF) & ~0x7FF;
+  }
+
+  uint32_t const headerSize = 32;
+  uint32_t rowsOffset = headerSize + schema.size();
+  uint32_t stringsOffset = rowsOffset + rows.size();
+  uint32_t dataOffset = stringsOffset + strings.size();
+
+  std::vector<uint8_t> block;
+  block.reserve(dataOffset);
+  PutBE32(block, 0x40555446);
+  PutBE32(block, dataOffset - 8);
+  PutBE32(block, rowsOffset - 8);
+  PutBE32(block, stringsOffset - 8);
+  PutBE32(block, dataOffset - 8);
+  PutBE32(block, 7);  // "TOC"
+  PutBE16(block, sizeof(columns) / sizeof(columns[0]));
+  PutBE16(block, rowLength);
+  PutBE32(block, rowCount);
+  block.insert(block.end(), schema.begin(), schema.end());
+  block.insert(block.end(), rows.begin(), rows.end());
+  block.insert(block.end(), strings.begin(), strings.end());
+  return block;
+}
+
+// Builds a synthetic TOC-shaped @UTF table, reads it with CpkUtfTable and with
+// the reader above, and logs both timings
+static void UtfBenchmark(uint32_t rowCount) {
+  std::vector<uint8_t> block = BuildBenchmarkUtfTable(rowCount);
+  double frequency = (double)SDL_GetPerformanceFrequency();
+
+  // Both read every cell ReadToc() needs, so the compiler can't skip work
+  uint64_t newChecksum = 0;
+  uint64_t start = SDL_GetPerformanceCounter();
+  {
+    uint8_t* copy = (uint8_t*)malloc(block.size());
+    memcpy(copy, block.data(), block.size());
+    CpkUtfTable table;
+    if (!table.Load(copy, block.size(), true)) {
+      ImpLog(LL_Error, LC_IO, "Benchmark UTF table failed to load\n");
+      return;
+    }
+    int idCol = table.FindColumn("ID");
+    int fileOffsetCol = table.FindColumn("FileOffset");
+    int dirNameCol = table.FindColumn("DirName");
+    int fileNameCol = table.FindColumn("FileName");
+    int extractSizeCol = table.FindColumn("ExtractSize");
+    int fileSizeCol = table.FindColumn("FileSize");
+    for (uint32_t i = 0; i < table.RowCount; i++) {
+      newChecksum += table.GetUint(i, idCol) + table.GetUint(i, fileOffsetCol) +
+                     table.GetUint(i, extractSizeCol) +
+                     table.GetUint(i, fileSizeCol) +
+                     strlen(table.GetString(i, dirNameCol)) +
+                     strlen(table.GetString(i, fileNameCol));
+    }
+  }
+  uint64_t newTicks = SDL_GetPerformanceCounter() - start;
+
+  uint64_t legacyChecksum = 0;
+  start = SDL_GetPerformanceCounter();
+  {
+    uint8_t* copy = (uint8_t*)malloc(block.size());
+    memcpy(copy, block.data(), block.size());
+    LegacyUtfRows rows;
+    if (!LegacyReadUtfBlock(copy, block.size(), &rows)) {
+      ImpLog(LL_Error, LC_IO, "Benchmark UTF table failed to load\n");
+      free(copy);
+      return;
+    }
+    for (auto& row : rows) {
+      // Constant columns read as empty in the old reader, skip DirName
+      legacyChecksum += row["ID"].Uint32Val + row["FileOffset"].Uint64Val +
+                        row["ExtractSize"].Uint32Val +
+                        row["FileSize"].Uint32Val +
+                        strlen(row["FileName"].StringVal);
+    }
+    free(copy);
+  }
+  uint64_t legacyTicks = SDL_GetPerformanceCounter() - start;
+
+  newChecksum -= (uint64_t)strlen("script") * rowCount;
+  if (newChecksum != legacyChecksum) {
+    ImpLog(LL_Error, LC_IO, "Benchmark UTF readers disagree\n");
+  }
+
+  double newMs = newTicks * 1000.0 / frequency;
+  double legacyMs = legacyTicks * 1000.0 / frequency;
+  ImpLog(LL_Info, LC_IO,
+         "UTF table with %u rows (%.1f KiB): columnar %.3f ms, per-row hash "
+         "map %.3f ms (%.1fx)\n",
+         rowCount, block.size() / 1024.0, newMs, legacyMs,
+         newMs > 0.0 ? legacyMs / newMs : 0.0);
+}
+
+}  // namespace Io
+}  // namespace Impacto
+
+struct DeterminismRun {
+  std::vector<int> ScrWork;
+  std::vector<uint8_t> FlagWork;
+};
+
+typedef uint8_t* (*ScriptTableLookup)(uint32_t scriptBufferId, uint32_t num);
+
+// Compares a lookup with reading the header table at tableOffset directly, the
+// way lookups worked before tables were resolved at load time. Returns the
+// number of entries that differ.
+static int CheckScriptTable(uint32_t scriptBufferId, uint32_t tableOffset,
+                            ScriptTableLookup lookup) {
+  uint8_t* buffer = Vm::ScriptBuffers[scriptBufferId];
+  int64_t size = Vm::ScriptGetBufferSize(scriptBufferId);
+  if (size < 16 || tableOffset >= size) return 0;
+
+  int64_t end = size;
+  for (uint32_t header = 4; header <= 12; header += 4) {
+    uint32_t boundary = Vm::ScriptReadU32(buffer, header);
+    if (boundary > tableOffset && boundary < end) end = boundary;
+  }
+
+  int differences = 0;
+  for (int64_t entry = tableOffset; entry + 4 <= end; entry += 4) {
+    uint8_t* stored = &buffer[Vm::ScriptReadU32(buffer, (uint32_t)entry)];
+    if (lookup(scriptBufferId, (uint32_t)(entry - tableOffset) / 4) != stored) {
+      differences++;
+    }
+  }
+  return differences;
+}
+
+// Checks the label, string and return lookups of every script buffer whose
+// script changed since the last call
+static int CheckLoadedScriptTables(uint8_t* checked[Vm::MaxLoadedScripts]) {
+  int differences = 0;
+  for (uint32_t i = 0; i < Vm::MaxLoadedScripts; i++) {
+    uint8_t* buffer = Vm::ScriptBuffers[i];
+    if (!buffer || buffer == checked[i]) continue;
+    checked[i] = buffer;
+    if (Vm::ScriptGetBufferSize(i) < 16) continue;
+
+    int scriptDifferences =
+        CheckScriptTable(i, 12, &Vm::ScriptGetLabelAddress) +
+        CheckScriptTable(i, Vm::ScriptReadU32(buffer, 4),
+                         &Vm::ScriptGetStrAddress) +
+        CheckScriptTable(i, Vm::ScriptReadU32(buffer, 8),
+                         &Vm::ScriptGetRetAddress);
+    if (scriptDifferences) {
+      ImpLog(LL_Error, LC_VM,
+             "  Script %u: %d lookups differ from its stored header tables\n",
+             Vm::LoadedScriptIds[i], scriptDifferences);
+    }
+    differences += scriptDifferences;
+  }
+  return differences;
+}
+
+// Returns the number of script table lookups that differ from the stored
+// header tables, if checkTables is set
+static int RunFrames(int frames, float dt, bool checkTables,
+                     DeterminismRun* out) {
+  uint8_t* checked[Vm::MaxLoadedScripts] = {};
+  int differences = 0;
+  // The Random expression uses rand()
+  srand(0);
+  for (int frame = 0; frame < frames && !Game::ShouldQuit; frame++) {
+    if (checkTables) differences += CheckLoadedScriptTables(checked);
+    Game::Update(dt);
+  }
+  if (checkTables) differences += CheckLoadedScriptTables(checked);
+  out->ScrWork.assign(ScrWork, ScrWork + ScrWorkSize);
+  out->FlagWork.assign(FlagWork, FlagWork + FlagWorkSize);
+  return differences;
+}
+
+static bool RestoreStart(Vm::VmState const& vmState,
+                         DeterminismRun const& start) {
+  if (!Vm::RestoreState(vmState)) {
+    ImpLog(LL_Fatal, LC_VM, "Couldn't restore the starting VM state\n");
+    return false;
+  }
+  memcpy(ScrWork, start.ScrWork.data(), sizeof(ScrWork));
+  memcpy(FlagWork, start.FlagWork.data(), sizeof(FlagWork));
+  return true;
+}
+
+// Logs the first few differences, returns whether there were any
+static bool CompareRuns(DeterminismRun const& a, DeterminismRun const& b) {
+  int const maxReported = 10;
+  int differences = 0;
+  for (int i = 0; i < ScrWorkSize; i++) {
+    if (a.ScrWork[i] == b.ScrWork[i]) continue;
+    if (differences++ < maxReported) {
+      ImpLog(LL_Info, LC_VM, "  ScrWork[%d]: %d vs %d\n", i, a.ScrWork[i],
+             b.ScrWork[i]);
+    }
+  }
+  for (int i = 0; i < FlagWorkSize; i++) {
+    if (a.FlagWork[i] == b.FlagWork[i]) continue;
+    if (differences++ < maxReported) {
+      ImpLog(LL_Info, LC_VM, "  FlagWork[%d]: %02X vs %02X\n", i,
+             a.FlagWork[i], b.FlagWork[i]);
+    }
+  }
+  return differences != 0;
+}
+
+// Only VM state is restored between runs, and asset loads still complete on
+// worker threads
+static int DeterminismCheck(int frames, float dt) {
+  Vm::VmState* vmState = new Vm::VmState;
+  Vm::CaptureState(vmState);
+  DeterminismRun start;
+  start.ScrWork.assign(ScrWork, ScrWork + ScrWorkSize);
+  start.FlagWork.assign(FlagWork, FlagWork + FlagWorkSize);
+
+  int result = 1;
+  DeterminismRun first, second;
+  int tableDifferences = RunFrames(frames, dt, true, &first);
+  if (!RestoreStart(*vmState, start)) goto end;
+  RunFrames(frames, dt, false, &second);
+
+  if (tableDifferences) {
+    ImpLog(LL_Error, LC_VM,
+           "%d frames: %d resolved script table lookups differ from the "
+           "stored header tables\n",
+           frames, tableDifferences);
+  } else if (CompareRuns(first, second)) {
+    ImpLog(LL_Error, LC_VM,
+           "%d frames: runs from the same state give different "
+           "ScrWork/FlagWork\n",
+           frames);
+  } else {
+    ImpLog(LL_Info, LC_VM,
+           "%d frames: script table lookups match the stored header tables, "
+           "runs give identical ScrWork/FlagWork\n",
+           frames);
+    result = 0;
+  }
+
+end:
+  delete vmState;
+  return result;
+}
+
+// Returns the number of layout issues found
+static int LayoutCheck() {
+  std::map<uint32_t, std::string> listing;
+  if (Io::VfsListFiles("script", listing) != IoError_OK) {
+    ImpLog(LL_Fatal, LC_General, "Couldn't list files in script\n");
+    return 1;
+  }
+
+  int scripts = 0;
+  int issues = 0;
+  int64_t decoded = 0;
+  for (auto const& file : listing) {
+    Vm::ResidentScript* script = Vm::ScriptPoolAcquire(file.first);
+    if (!script) {
+      ImpLog(LL_Warning, LC_VM, "Couldn't load script %s\n",
+             file.second.c_str());
+      continue;
+    }
+    std::vector<Vm::ScriptLayoutIssue> found;
+    decoded += Vm::CheckScriptLayouts(script->Data, script->Size,
+                                      script->Tables.Labels, found);
+    for (auto const& issue : found) {
+      ImpLog(LL_Error, LC_VM, "  %s+%X: %02X:%02X %s\n", file.second.c_str(),
+             issue.Offset, issue.Group, issue.Opcode,
+             issue.Overrun ? "runs past the next label"
+                           : "is followed by something that isn't code");
+    }
+    issues += found.size();
+    Vm::ScriptPoolRelease(script);
+    scripts++;
+  }
+
+  ImpLog(issues ? LL_Error : LL_Info, LC_VM,
+         "Decoded %lld instructions in %d scripts, %d don't end where the next "
+         "one starts\n",
+         (long long)decoded, scripts, issues);
+  return issues;
+}
+
+// Game::Shutdown() exits with status 0 (Window::Shutdown() does), so failed
+// checks return without it
+static int FinishCheck(int result) {
+  if (result == 0) Game::Shutdown();
+  return result != 0;
+}
+
+int main(int argc, char* argv[]) {
+  LogSetConsole(true);
+  g_LogLevelConsole = LL_Info;
+  g_LogChannelsConsole = LC_All;
+
+  bool profileOpcodes = false;
+  int args = 1;
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--profile-opcodes") == 0) {
+      profileOpcodes = true;
+    } else if (strcmp(argv[i], "--auto-advance") == 0) {
+      Game::AutoAdvance = true;
+    } else if (strcmp(argv[i], "--no-gl") == 0) {
+      Window::NoGL = true;
+    } else {
+      argv[args++] = argv[i];
+    }
+  }
+  argc = args;
+
+  if (argc > 1 && strcmp(argv[1], "--utf-bench") == 0) {
+    Io::UtfBenchmark(argc > 2 ? (uint32_t)atoi(argv[2]) : 100000);
+    return 0;
+  }
+  if (argc > 2 && strcmp(argv[1], "--layla-bench") == 0) {
+    LaylaBenchmark(argv[2]);
+    return 0;
+  }
+  if (argc > 1 && strcmp(argv[1], "--thread-order-check") == 0) {
+    int iterations = argc > 2 ? atoi(argv[2]) : 100000;
+    if (!Vm::CheckThreadTableOrder(iterations)) return 1;
+    ImpLog(LL_Info, LC_VM, "Thread table order matched for %d iterations\n",
+           iterations);
+    return 0;
+  }
+
+  bool decode = argc > 2 && strcmp(argv[1], "--decode") == 0;
+  bool determinism = argc > 1 && strcmp(argv[1], "--determinism") == 0;
+  bool layoutCheck = argc > 1 && strcmp(argv[1], "--layout-check") == 0;
+
+  int frames = 3600;
+  float dt = 1.0f / 60.0f;
+  std::string profileOutput;
+  if (determinism) {
+    if (argc > 2) frames = atoi(argv[2]);
+    if (argc > 3) dt = (float)atof(argv[3]);
+  } else if (!decode && !layoutCheck) {
+    if (argc > 1) frames = atoi(argv[1]);
+    if (argc > 2) dt = (float)atof(argv[2]);
+    if (argc > 3) profileOutput = argv[3];
+  }
+
+  Io::InputStream* stream;
+  IoError err = Io::PhysicalFileStream::Create("profile.txt", &stream);
+  if (err != IoError_OK) {
+    ImpLog(LL_Fatal, LC_General, "Couldn't open profile.txt\n");
+    return 1;
+  }
+
+  std::string profileName;
+  profileName.resize(stream->Meta.Size, '\0');
+  profileName.resize(stream->Read(&profileName[0], stream->Meta.Size));
+  delete stream;
+
+  Game::Headless = true;
+  Game::InitFromProfile(profileName);
+
+  if (decode) {
+    Audio::FloatOutput = argc > 3 && strcmp(argv[3], "float") == 0;
+    DecodeBenchmark(argv[2]);
+    Game::Shutdown();
+    return 0;
+  }
+
+  if (determinism) return FinishCheck(DeterminismCheck(frames, dt));
+
+  if (layoutCheck) return FinishCheck(LayoutCheck());
+
+  Vm::ResetStats();
+  Vm::ProfileOpcodes = profileOpcodes || !profileOutput.empty();
+
+  uint64_t start = SDL_GetPerformanceCounter();
+  int frame = 0;
+  for (; frame < frames && !Game::ShouldQuit; frame++) {
+    Game::Update(dt);
+  }
+  uint64_t totalTicks = SDL_GetPerformanceCounter() - start;
+  double seconds = (double)totalTicks / (double)SDL_GetPerformanceFrequency();
+  if (seconds <= 0.0) seconds = 1e-9;
+
+  ImpLog(LL_Info, LC_General,
+         "Ran %d frames (%.1f s game time) in %.3f s: %.1f frames/s\n", frame,
+         frame * dt, seconds, frame / seconds);
+  ImpLog(LL_Info, LC_VM,
+         "%llu instructions (%.0f/s), %llu expressions (%.0f/s)\n",
+         (unsigned long long)Vm::InstructionCount,
+         Vm::InstructionCount / seconds,
+         (unsigned long long)Vm::ExpressionCount,
+         Vm::ExpressionCount / seconds);
+  if (Vm::ProfileOpcodes) LogOpcodeProfile(totalTicks);
+
+  if (profileOutput.size() >= 5 &&
+      profileOutput.compare(profileOutput.size() - 5, 5, ".json") == 0) {
+    Vm::WriteProfileJson(profileOutput);
+  } else if (!profileOutput.empty()) {
+    Vm::WriteProfileCsv(profileOutput);
+  }
+
+  Game::Shutdown();
+
+  return 0;
+}
\ No newline at end of file
@@ -29,6 +29,20 @@ IoError AfsArchive::Open(FileMeta* file, InputStream** outStream) {
   return err;
 }
 
+IoError AfsArchive::View(FileMeta* file, void const** outBuffer,
+                         int64_t* outSize) {
+  AfsMetaEntry* entry = (AfsMetaEntry*)file;
+  return ViewBaseStream(entry->Offset, entry->Size, outBuffer, outSize);
+}
+
+IoError AfsArchive::GetStorage(FileMeta* file, int64_t* outOffset,
+                               int64_t* outSize) {
+  AfsMetaEntry* entry = (AfsMetaEntry*)file;
+  *outOffset = entry->Offset;
+  *outSize = entry->Size;
+  return IoError_OK;
+}
+
 IoError AfsArchive::Create(InputStream* stream, VfsArchive** outArchive) {
   ImpLog(LL_Trace, LC_IO, "Trying to mount \"%s\" as AFS\n",
          stream->Meta.FileName.c_str());
@@ -11,6 +11,10 @@ class AfsArchive : public VfsArchive {
  public:
   ~AfsArchive();
   IoError Open(FileMeta* file, InputStream** outStream) override;
+  IoError View(FileMeta* file, void const** outBuffer,
+               int64_t* outSize) override;
+  IoError GetStorage(FileMeta* file, int64_t* outOffset,
+                     int64_t* outSize) override;
 
   static IoError Create(InputStream* stream, VfsArchive** outArchive);
 
@@ -75,7 +75,9 @@ class Buffering {
   int64_t DiscardSeekBuffered(int64_t pos) {
     T* stream = static_cast<T*>(this);
     while (stream->Position < pos) {
-      int64_t read = ReadBuffered(0, BufferSize);
+      // Don't overshoot, pos may be right at the end of a buffer
+      int64_t read =
+          ReadBuffered(0, std::min(BufferSize, pos - stream->Position));
       if (read < IoError_OK) return read;
     }
     return stream->SeekBuffered(pos);
@@ -1,173 +1,82 @@
 #include "cpkarchive.h"
 
 #include "../log.h"
+#include "../profile/vfs.h"
+#include "cpkutftable.h"
+#include "mappedfilestream.h"
+#include "physicalfilestream.h"
 #include "uncompressedstream.h"
 #include "vfs.h"
 #include <SDL_endian.h>
+#include <SDL_rwops.h>
+#include <stdio.h>
+#include <sys/stat.h>
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#include <direct.h>
+#endif
 
 namespace Impacto {
 namespace Io {
 
-enum CpkColumnFlags {
-  STORAGE_MASK = 0xf0,
-  STORAGE_NONE = 0x00,
-  STORAGE_ZERO = 0x10,
-  STORAGE_CONSTANT = 0x30,
-  STORAGE_PERROW = 0x50,
-
-  TYPE_MASK = 0x0f,
-  TYPE_DATA = 0x0b,
-  TYPE_STRING = 0x0a,
-  TYPE_FLOAT = 0x08,
-  TYPE_8BYTE2 = 0x07,
-  TYPE_8BYTE = 0x06,
-  TYPE_4BYTE2 = 0x05,
-  TYPE_4BYTE = 0x04,
-  TYPE_2BYTE2 = 0x03,
-  TYPE_2BYTE = 0x02,
-  TYPE_1BYTE2 = 0x01,
-  TYPE_1BYTE = 0x00,
+struct CpkMetaEntry : public FileMeta {
+  int64_t Offset;
+  int64_t CompressedSize;
+  bool Compressed;
 };
 
-struct CpkColumn {
-  uint32_t Flags;
-  char Name[CpkMaxPath];
-  std::vector<CpkCell> Cells;
+// Index cache files are written and read in native byte order, a cache from a
+// machine with different endianness fails the magic check and is rebuilt
+uint32_t const CpkIndexCacheMagic = 0x494B5043;
+uint32_t const CpkIndexCacheFormatVersion = 2;
+
+// Layout: header, entries, archive path, file names (not null terminated)
+struct CpkIndexCacheHeader {
+  uint32_t Magic;
+  uint32_t FormatVersion;
+  int64_t ArchiveSize;
+  // Nanoseconds, in whatever epoch the platform uses
+  int64_t ArchiveMtime;
+  uint32_t FileCount;
+  uint32_t EntryCount;
+  uint32_t PathSize;
+  uint32_t NamesSize;
+  uint16_t Version;
+  uint16_t Revision;
+  uint32_t Reserved;
 };
 
-struct CpkMetaEntry : public FileMeta {
+struct CpkIndexCacheEntry {
   int64_t Offset;
+  int64_t Size;
   int64_t CompressedSize;
-  bool Compressed;
+  uint32_t Id;
+  uint32_t NameOffset;
+  uint32_t NameSize;
+  uint8_t Compressed;
+  uint8_t Reserved[3];
 };
 
 CpkArchive::~CpkArchive() {
   if (FileList) delete[] FileList;
 }
 
-void DecryptUtfBlock(uint8_t* utfBlock, uint64_t size) {
-  uint32_t utfDecryptVal = 0x655f;
-  for (uint64_t i = 0; i < size; i++) {
-    utfBlock[i] ^= utfDecryptVal & 0xFF;
-    utfDecryptVal *= 0x4115;
-  }
-}
-
-bool CpkArchive::ReadUtfBlock(
-    uint8_t* utfBlock, uint64_t utfSize,
-    std::vector<ska::flat_hash_map<std::string, CpkCell>>* rows) {
-  const uint32_t utfMagic = 0x40555446;
-  UtfStream = new MemoryStream(utfBlock, utfSize, true);
-  if (ReadBE<uint32_t>(UtfStream) != utfMagic) {
-    DecryptUtfBlock(utfBlock, utfSize);
-    UtfStream->Seek(0, RW_SEEK_SET);
-    if (ReadBE<uint32_t>(UtfStream) != utfMagic) {
-      ImpLog(LL_Trace, LC_IO, "Error reading CPK UTF table\n");
-      delete UtfStream;
-      return false;
-    }
-  }
-
-  // uint32_t tableSize = ReadBE<uint32_t>(UtfStream);
-  UtfStream->Seek(4, RW_SEEK_CUR);
-  int64_t rowsOffset = ReadBE<uint32_t>(UtfStream);
-  int64_t stringsOffset = ReadBE<uint32_t>(UtfStream);
-  int64_t dataOffset = ReadBE<uint32_t>(UtfStream);
-
-  rowsOffset += 8;
-  stringsOffset += 8;
-  dataOffset += 8;
-
-  // uint32_t tableNameOffset = ReadBE<uint32_t>(UtfStream);
-  UtfStream->Seek(4, RW_SEEK_CUR);
-  uint16_t numColumns = ReadBE<uint16_t>(UtfStream);
-  uint16_t rowLength = ReadBE<uint16_t>(UtfStream);
-  uint32_t numRows = ReadBE<uint32_t>(UtfStream);
-
-  std::vector<CpkColumn> columns;
-
-  for (int i = 0; i < numColumns; i++) {
-    CpkColumn column;
-    column.Flags = ReadU8(UtfStream);
-    if (column.Flags == 0) column.Flags = ReadBE<uint32_t>(UtfStream);
-
-    ReadString(stringsOffset, column.Name);
-
-    columns.push_back(column);
-  }
-
-  for (int i = 0; i < numRows; i++) {
-    UtfStream->Seek(rowsOffset + (i * rowLength), RW_SEEK_SET);
-    ska::flat_hash_map<std::string, CpkCell> row;
-    for (auto& column : columns) {
-      CpkCell cell;
-      int storageFlag = column.Flags & CpkColumnFlags::STORAGE_MASK;
-      if (storageFlag == 0x50) {
-        int cellType = column.Flags & CpkColumnFlags::TYPE_MASK;
-        switch (cellType) {
-          case 0:
-          case 1:
-            cell.Uint8Val = ReadU8(UtfStream);
-            break;
-          case 2:
-          case 3:
-            cell.Uint16Val = ReadBE<uint16_t>(UtfStream);
-            break;
-          case 4:
-          case 5:
-            cell.Uint32Val = ReadBE<uint32_t>(UtfStream);
-            break;
-          case 6:
-          case 7:
-            cell.Uint64Val = ReadBE<uint64_t>(UtfStream);
-            break;
-          case 8:
-            cell.FloatVal = ReadBE<float>(UtfStream);
-            break;
-          case 0xA:
-            ReadString(stringsOffset, cell.StringVal);
-            break;
-          case 0xB:
-            int64_t dataPos = ReadBE<uint32_t>(UtfStream) + dataOffset;
-            uint64_t dataSize = ReadBE<uint32_t>(UtfStream);
-            uint64_t retAddr = UtfStream->Position;
-            cell.DataArray = (uint8_t*)malloc(dataSize + sizeof(uint64_t));
-            cell.DataSize = dataSize;
-            if (cell.DataArray != 0) {
-              UtfStream->Seek(dataPos, RW_SEEK_SET);
-              UtfStream->Read(cell.DataArray, dataSize);
-              UtfStream->Seek(retAddr, RW_SEEK_SET);
-            }
-            break;
-        }
-      } else {
-        cell.Uint64Val = 0;
-      }
-      row[column.Name] = cell;
-    }
-    rows->push_back(row);
-  }
-
-  delete UtfStream;
-  return true;
-}
-
-void CpkArchive::ReadString(int64_t stringsOffset, char* output) {
-  int64_t stringAddr = stringsOffset + ReadBE<uint32_t>(UtfStream);
-
-  int64_t retAddr = UtfStream->Position;
-
-  UtfStream->Seek(stringAddr, RW_SEEK_SET);
-
-  memset(output, 0, CpkMaxPath);
-
-  char ch;
-  int i = 0;
-  while ((ch = ReadU8(UtfStream)) != 0x00) {
-    output[i++] = ch;
+// Reads a "TOC " style chunk (magic, 4 unused bytes, LE64 size, @UTF table)
+static bool ReadUtfChunk(InputStream* stream, int64_t offset, uint32_t magic,
+                         CpkUtfTable* outTable) {
+  stream->Seek(offset, RW_SEEK_SET);
+  if (ReadBE<uint32_t>(stream) != magic) return false;
+  stream->Seek(4, RW_SEEK_CUR);
+  uint64_t utfSize = ReadLE<uint64_t>(stream);
+  uint8_t* utfBlock = (uint8_t*)malloc(utfSize);
+  if (!utfBlock) return false;
+  if (stream->Read(utfBlock, utfSize) != utfSize) {
+    free(utfBlock);
+    return false;
   }
-  output[i] = '\0';
-  UtfStream->Seek(retAddr, RW_SEEK_SET);
+  return outTable->Load(utfBlock, utfSize, true);
 }
 
 CpkMetaEntry* CpkArchive::GetFileListEntry(uint32_t id) {
@@ -183,76 +92,61 @@ CpkMetaEntry* CpkArchive::GetFileListEntry(uint32_t id) {
   return entry;
 }
 
+void CpkArchive::ReadItocRows(CpkUtfTable const& table) {
+  int idCol = table.FindColumn("ID");
+  int extractSizeCol = table.FindColumn("ExtractSize");
+  int fileSizeCol = table.FindColumn("FileSize");
+
+  for (uint32_t i = 0; i < table.RowCount; i++) {
+    uint32_t id = table.GetUint(i, idCol);
+    CpkMetaEntry* entry = GetFileListEntry(id);
+    entry->Id = id;
+
+    uint64_t extractedSize = table.GetUint(i, extractSizeCol);
+    uint64_t fileSize = table.GetUint(i, fileSizeCol);
+    if (extractedSize && (extractedSize != fileSize)) {
+      entry->Size = extractedSize;
+      entry->CompressedSize = fileSize;
+      entry->Compressed = true;
+    } else {
+      entry->Size = fileSize;
+      entry->CompressedSize = fileSize;
+      entry->Compressed = false;
+    }
+    if (entry->FileName.empty()) {
+      char path[11];
+      snprintf(path, sizeof(path), "%05u", id);
+      entry->FileName = path;
+    }
+  }
+}
+
 IoError CpkArchive::ReadItoc(int64_t itocOffset, int64_t contentOffset,
                              uint16_t align) {
-  BaseStream->Seek(itocOffset, RW_SEEK_SET);
   const uint32_t itocMagic = 0x49544F43;
-  if (ReadBE<uint32_t>(BaseStream) != itocMagic) {
+  CpkUtfTable itocTable;
+  if (!ReadUtfChunk(BaseStream, itocOffset, itocMagic, &itocTable)) {
     ImpLog(LL_Trace, LC_IO, "Error reading CPK ITOC\n");
     return IoError_Fail;
   }
-  BaseStream->Seek(4, RW_SEEK_CUR);
-  uint64_t utfSize = ReadLE<uint64_t>(BaseStream);
-  uint8_t* utfBlock = (uint8_t*)malloc(utfSize);
-  BaseStream->Read(utfBlock, utfSize);
-  std::vector<ska::flat_hash_map<std::string, CpkCell>> itocUtfTable;
-  if (!ReadUtfBlock(utfBlock, utfSize, &itocUtfTable)) return IoError_Fail;
-
-  if (itocUtfTable[0]["DataL"].Uint64Val != 0) {
-    std::vector<ska::flat_hash_map<std::string, CpkCell>> dataLUtfTable;
-    if (!ReadUtfBlock(itocUtfTable[0]["DataL"].DataArray,
-                      itocUtfTable[0]["DataL"].DataSize, &dataLUtfTable))
-      return IoError_Fail;
-    std::vector<ska::flat_hash_map<std::string, CpkCell>> dataHUtfTable;
-    if (!ReadUtfBlock(itocUtfTable[0]["DataH"].DataArray,
-                      itocUtfTable[0]["DataH"].DataSize, &dataHUtfTable))
-      return IoError_Fail;
 
-    for (auto& row : dataLUtfTable) {
-      int id = row["ID"].Uint16Val;
-      CpkMetaEntry* entry = GetFileListEntry(id);
-      entry->Id = id;
-
-      uint16_t extractedSize = row["ExtractSize"].Uint16Val;
-      uint16_t fileSize = row["FileSize"].Uint16Val;
-      if (extractedSize && (extractedSize != fileSize)) {
-        entry->Size = extractedSize;
-        entry->CompressedSize = fileSize;
-        entry->Compressed = true;
-      } else {
-        entry->Size = fileSize;
-        entry->CompressedSize = fileSize;
-        entry->Compressed = false;
-      }
-      if (entry->FileName.empty()) {
-        char path[6];
-        snprintf(path, 6, "%05i", id);
-        entry->FileName = path;
-      }
-    }
-
-    for (auto& row : dataHUtfTable) {
-      int id = row["ID"].Uint16Val;
-      CpkMetaEntry* entry = GetFileListEntry(id);
-      entry->Id = id;
-
-      int extractedSize = row["ExtractSize"].Uint32Val;
-      int fileSize = row["FileSize"].Uint32Val;
-      if (extractedSize && (extractedSize != fileSize)) {
-        entry->Size = extractedSize;
-        entry->CompressedSize = fileSize;
-        entry->Compressed = true;
-      } else {
-        entry->Size = fileSize;
-        entry->CompressedSize = fileSize;
-        entry->Compressed = false;
-      }
-      if (entry->FileName.empty()) {
-        char path[6];
-        snprintf(path, 6, "%05i", id);
-        entry->FileName = path;
-      }
-    }
+  uint64_t dataLSize, dataHSize;
+  uint8_t* dataL = itocTable.GetData(0, itocTable.FindColumn("DataL"),
+                                     &dataLSize);
+  uint8_t* dataH = itocTable.GetData(0, itocTable.FindColumn("DataH"),
+                                     &dataHSize);
+  // Nested tables live inside (and are decrypted in place in) itocTable's
+  // block. Either one may be missing when all files fall on one side of the
+  // 64K split, in which case it is simply empty.
+  if (dataL) {
+    CpkUtfTable dataLTable;
+    if (!dataLTable.Load(dataL, dataLSize, false)) return IoError_Fail;
+    ReadItocRows(dataLTable);
+  }
+  if (dataH) {
+    CpkUtfTable dataHTable;
+    if (!dataHTable.Load(dataH, dataHSize, false)) return IoError_Fail;
+    ReadItocRows(dataHTable);
   }
 
   int64_t offset = contentOffset;
@@ -276,41 +170,43 @@ IoError CpkArchive::ReadItoc(int64_t itocOffset, int64_t contentOffset,
 }
 
 IoError CpkArchive::ReadToc(int64_t tocOffset, int64_t contentOffset) {
-  BaseStream->Seek(tocOffset, RW_SEEK_SET);
   const uint32_t tocMagic = 0x544F4320;
-  if (ReadBE<uint32_t>(BaseStream) != tocMagic) {
+  CpkUtfTable tocTable;
+  if (!ReadUtfChunk(BaseStream, tocOffset, tocMagic, &tocTable)) {
     ImpLog(LL_Trace, LC_IO, "Error reading CPK TOC\n");
     return IoError_Fail;
   }
-  BaseStream->Seek(4, RW_SEEK_CUR);
-  uint64_t utfSize = ReadLE<uint64_t>(BaseStream);
-  uint8_t* utfBlock = (uint8_t*)malloc(utfSize);
-  BaseStream->Read(utfBlock, utfSize);
-  std::vector<ska::flat_hash_map<std::string, CpkCell>> tocUtfTable;
-  if (!ReadUtfBlock(utfBlock, utfSize, &tocUtfTable)) return IoError_Fail;
 
-  for (auto& row : tocUtfTable) {
-    uint32_t id = row["ID"].Uint32Val;
+  int idCol = tocTable.FindColumn("ID");
+  int fileOffsetCol = tocTable.FindColumn("FileOffset");
+  int dirNameCol = tocTable.FindColumn("DirName");
+  int fileNameCol = tocTable.FindColumn("FileName");
+  int extractSizeCol = tocTable.FindColumn("ExtractSize");
+  int fileSizeCol = tocTable.FindColumn("FileSize");
+
+  for (uint32_t i = 0; i < tocTable.RowCount; i++) {
+    uint32_t id = tocTable.GetUint(i, idCol);
     CpkMetaEntry* entry = GetFileListEntry(id);
 
     entry->Id = id;
-    entry->Offset = row["FileOffset"].Uint64Val;
-
-    char path[CpkMaxPath * 2] = {0};
-
-    if (*row["DirName"].StringVal) {
-      snprintf(path, CpkMaxPath * 2, "%s/%s", row["DirName"].StringVal,
-               row["FileName"].StringVal);
+    entry->Offset = tocTable.GetUint(i, fileOffsetCol);
+
+    char const* dirName = tocTable.GetString(i, dirNameCol);
+    char const* fileName = tocTable.GetString(i, fileNameCol);
+    if (*dirName) {
+      entry->FileName = dirName;
+      entry->FileName += '/';
+      entry->FileName += fileName;
+    } else if (*fileName) {
+      entry->FileName = fileName;
     } else {
-      snprintf(path, CpkMaxPath, "%s", row["FileName"].StringVal);
-    }
-    if (strlen(path) == 0) {
-      snprintf(path, CpkMaxPath, "%05i", id);
+      char path[11];
+      snprintf(path, sizeof(path), "%05u", id);
+      entry->FileName = path;
     }
-    entry->FileName = path;
 
-    int extractedSize = row["ExtractSize"].Uint32Val;
-    int fileSize = row["FileSize"].Uint32Val;
+    uint64_t extractedSize = tocTable.GetUint(i, extractSizeCol);
+    uint64_t fileSize = tocTable.GetUint(i, fileSizeCol);
     if (extractedSize && (extractedSize != fileSize)) {
       entry->Size = extractedSize;
       entry->CompressedSize = fileSize;
@@ -326,38 +222,244 @@ IoError CpkArchive::ReadToc(int64_t tocOffset, int64_t contentOffset) {
 }
 
 IoError CpkArchive::ReadEtoc(int64_t etocOffset) {
-  BaseStream->Seek(etocOffset, RW_SEEK_SET);
   const uint32_t etocMagic = 0x45544F43;
-  if (ReadBE<uint32_t>(BaseStream) != etocMagic) {
+  CpkUtfTable etocTable;
+  if (!ReadUtfChunk(BaseStream, etocOffset, etocMagic, &etocTable)) {
     ImpLog(LL_Trace, LC_IO, "Error reading CPK ETOC\n");
     return IoError_Fail;
   }
-  BaseStream->Seek(4, RW_SEEK_CUR);
-  uint64_t utfSize = ReadLE<uint64_t>(BaseStream);
-  uint8_t* utfBlock = (uint8_t*)malloc(utfSize);
-  BaseStream->Read(utfBlock, utfSize);
-  std::vector<ska::flat_hash_map<std::string, CpkCell>> etocUtfTable;
-  if (!ReadUtfBlock(utfBlock, utfSize, &etocUtfTable)) return IoError_Fail;
 
-  // for (auto& row : etocUtfTable) {
   // TODO: This contains the LocalDir and UpdateDateTime params. Do we actually
   // need this?...
-  //}
 
   return IoError_OK;
 }
 
+// Only archives backed by a physical file can be cached, since we need its
+// modification time to tell whether the cache is stale. That has sub-second
+// precision, so an archive rewritten within a second of the cached one isn't
+// mistaken for it.
+static bool GetIndexCacheKey(InputStream* stream, int64_t* outMtime) {
+  // Archives mounted from memory only have a name, which may well match some
+  // unrelated file on disk
+  if (!stream->IsFile) return false;
+
+#ifdef _WIN32
+  WIN32_FILE_ATTRIBUTE_DATA attributes;
+  if (!GetFileAttributesExA(stream->Meta.FileName.c_str(),
+                            GetFileExInfoStandard, &attributes)) {
+    return false;
+  }
+  int64_t size = ((int64_t)attributes.nFileSizeHigh << 32) |
+                 attributes.nFileSizeLow;
+  if (size != stream->Meta.Size) return false;
+  // 100ns intervals
+  *outMtime = (((int64_t)attributes.ftLastWriteTime.dwHighDateTime << 32) |
+               attributes.ftLastWriteTime.dwLowDateTime) *
+              100;
+#else
+  struct stat st;
+  if (stat(stream->Meta.FileName.c_str(), &st) != 0) return false;
+  if ((int64_t)st.st_size != stream->Meta.Size) return false;
+#ifdef __APPLE__
+  struct timespec const& mtime = st.st_mtimespec;
+#else
+  struct timespec const& mtime = st.st_mtim;
+#endif
+  *outMtime = (int64_t)mtime.tv_sec * 1000000000 + mtime.tv_nsec;
+#endif
+  return true;
+}
+
+static std::string GetIndexCachePath(std::string const& archivePath) {
+  // FNV-1a
+  uint64_t hash = 0xcbf29ce484222325ULL;
+  for (char c : archivePath) {
+    hash ^= (uint8_t)c;
+    hash *= 0x100000001b3ULL;
+  }
+  char fileName[32];
+  snprintf(fileName, sizeof(fileName), "%016llx.cpkidx",
+           (unsigned long long)hash);
+  return Profile::Vfs::IndexCacheDir + "/" + fileName;
+}
+
+bool CpkArchive::ReadIndexCache(int64_t archiveMtime) {
+  std::string const& archivePath = BaseStream->Meta.FileName;
+  std::string cachePath = GetIndexCachePath(archivePath);
+
+  InputStream* cacheStream;
+  uint8_t* cache = 0;
+  bool ownsCache = false;
+  int64_t cacheSize;
+  CpkIndexCacheHeader const* header;
+  CpkIndexCacheEntry const* entries;
+  char const* path;
+  char const* names;
+  bool result = false;
+
+  if (MappedFileStream::Create(cachePath, &cacheStream) == IoError_OK) {
+    cache = (uint8_t*)((MemoryStream*)cacheStream)->GetMemory();
+    cacheSize = cacheStream->Meta.Size;
+  } else if (PhysicalFileStream::Create(cachePath, &cacheStream) ==
+             IoError_OK) {
+    cacheSize = cacheStream->Meta.Size;
+    cache = (uint8_t*)malloc(cacheSize);
+    ownsCache = true;
+    if (cacheStream->Read(cache, cacheSize) != cacheSize) goto end;
+  } else {
+    return false;
+  }
+
+  if (cacheSize < (int64_t)sizeof(CpkIndexCacheHeader)) goto end;
+  header = (CpkIndexCacheHeader const*)cache;
+  if (header->Magic != CpkIndexCacheMagic ||
+      header->FormatVersion != CpkIndexCacheFormatVersion ||
+      header->ArchiveSize != BaseStream->Meta.Size ||
+      header->ArchiveMtime != archiveMtime ||
+      header->EntryCount > header->FileCount ||
+      cacheSize != (int64_t)sizeof(CpkIndexCacheHeader) +
+                       (int64_t)header->EntryCount *
+                           (int64_t)sizeof(CpkIndexCacheEntry) +
+                       header->PathSize + header->NamesSize) {
+    goto end;
+  }
+
+  entries = (CpkIndexCacheEntry const*)(header + 1);
+  path = (char const*)(entries + header->EntryCount);
+  names = path + header->PathSize;
+  if (archivePath.compare(0, std::string::npos, path, header->PathSize) != 0) {
+    goto end;
+  }
+
+  FileCount = header->FileCount;
+  Version = header->Version;
+  Revision = header->Revision;
+  FileList = new CpkMetaEntry[FileCount];
+  IdsToFiles.reserve(header->EntryCount);
+  NamesToIds.reserve(header->EntryCount);
+
+  // FileMeta needs its own name string, so entries are copied out of the
+  // mapping rather than used in place
+  for (uint32_t i = 0; i < header->EntryCount; i++) {
+    CpkIndexCacheEntry const& cached = entries[i];
+    if ((uint64_t)cached.NameOffset + cached.NameSize > header->NamesSize) {
+      delete[] FileList;
+      FileList = 0;
+      IdsToFiles.clear();
+      NamesToIds.clear();
+      goto end;
+    }
+    CpkMetaEntry* entry = &FileList[i];
+    entry->Id = cached.Id;
+    entry->FileName.assign(names + cached.NameOffset, cached.NameSize);
+    entry->Offset = cached.Offset;
+    entry->Size = cached.Size;
+    entry->CompressedSize = cached.CompressedSize;
+    entry->Compressed = cached.Compressed != 0;
+    IdsToFiles[entry->Id] = entry;
+    NamesToIds[entry->FileName] = entry->Id;
+  }
+  NextFile = header->EntryCount;
+
+  ImpLog(LL_Debug, LC_IO, "Loaded CPK index for \"%s\" from cache \"%s\"\n",
+         archivePath.c_str(), cachePath.c_str());
+  result = true;
+
+end:
+  if (ownsCache) free(cache);
+  delete cacheStream;
+  return result;
+}
+
+void CpkArchive::WriteIndexCache(int64_t archiveMtime) {
+  std::string const& archivePath = BaseStream->Meta.FileName;
+  std::string cachePath = GetIndexCachePath(archivePath);
+
+  CpkIndexCacheHeader header = {0};
+  std::vector<CpkIndexCacheEntry> entries(NextFile);
+  std::string names;
+
+  for (uint32_t i = 0; i < NextFile; i++) {
+    CpkMetaEntry const& entry = FileList[i];
+    CpkIndexCacheEntry& cached = entries[i];
+    memset(&cached, 0, sizeof(cached));
+    cached.Offset = entry.Offset;
+    cached.Size = entry.Size;
+    cached.CompressedSize = entry.CompressedSize;
+    cached.Id = entry.Id;
+    cached.NameOffset = names.size();
+    cached.NameSize = entry.FileName.size();
+    cached.Compressed = entry.Compressed;
+    names += entry.FileName;
+  }
+
+  header.Magic = CpkIndexCacheMagic;
+  header.FormatVersion = CpkIndexCacheFormatVersion;
+  header.ArchiveSize = BaseStream->Meta.Size;
+  header.ArchiveMtime = archiveMtime;
+  header.FileCount = FileCount;
+  header.EntryCount = NextFile;
+  header.PathSize = archivePath.size();
+  header.NamesSize = names.size();
+  header.Version = Version;
+  header.Revision = Revision;
+
+#ifdef _WIN32
+  _mkdir(Profile::Vfs::IndexCacheDir.c_str());
+#else
+  mkdir(Profile::Vfs::IndexCacheDir.c_str(), 0755);
+#endif
+
+  // Written next to the cache and renamed over it once complete, so neither a
+  // crash nor another instance reading it sees a partial file
+  std::string tempPath = cachePath + ".tmp";
+  SDL_RWops* rw = SDL_RWFromFile(tempPath.c_str(), "wb");
+  if (!rw) {
+    ImpLog(LL_Warning, LC_IO, "Could not create CPK index cache \"%s\"\n",
+           cachePath.c_str());
+    return;
+  }
+  bool ok =
+      SDL_RWwrite(rw, &header, sizeof(header), 1) == 1 &&
+      (entries.empty() || SDL_RWwrite(rw, entries.data(),
+                                      sizeof(CpkIndexCacheEntry),
+                                      entries.size()) == entries.size()) &&
+      (archivePath.empty() ||
+       SDL_RWwrite(rw, archivePath.data(), archivePath.size(), 1) == 1) &&
+      (names.empty() || SDL_RWwrite(rw, names.data(), names.size(), 1) == 1);
+  ok = SDL_RWclose(rw) == 0 && ok;
+  if (ok) {
+#ifdef _WIN32
+    ok = MoveFileExA(tempPath.c_str(), cachePath.c_str(),
+                     MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+    ok = rename(tempPath.c_str(), cachePath.c_str()) == 0;
+#endif
+  }
+  if (!ok) {
+    remove(tempPath.c_str());
+    ImpLog(LL_Warning, LC_IO, "Could not write CPK index cache \"%s\"\n",
+           cachePath.c_str());
+  }
+}
+
 IoError CpkArchive::Create(InputStream* stream, VfsArchive** outArchive) {
   ImpLog(LL_Trace, LC_IO, "Trying to mount \"%s\" as CPK\n",
          stream->Meta.FileName.c_str());
 
   CpkArchive* result = 0;
 
-  std::vector<ska::flat_hash_map<std::string, CpkCell>> headerUtfTable;
+  CpkUtfTable headerTable;
 
   uint16_t alignVal;
+  uint64_t tocOffset, etocOffset, itocOffset, contentOffset;
   uint64_t utfSize = 0;
   uint8_t* utfBlock = 0;
+  int64_t archiveMtime;
+  bool cacheable =
+      !Profile::Vfs::IndexCacheDir.empty() &&
+      GetIndexCacheKey(stream, &archiveMtime);
 
   uint32_t const magic = 0x43504B20;
   if (ReadBE<uint32_t>(stream) != magic) {
@@ -367,40 +469,53 @@ IoError CpkArchive::Create(InputStream* stream, VfsArchive** outArchive) {
 
   result = new CpkArchive;
   result->BaseStream = stream;
+  result->LocksInternally = true;
+
+  if (cacheable && result->ReadIndexCache(archiveMtime)) {
+    result->IsInit = true;
+    *outArchive = result;
+    return IoError_OK;
+  }
 
   stream->Seek(0x8, RW_SEEK_SET);
   utfSize = ReadLE<uint64_t>(stream);
   utfBlock = (uint8_t*)malloc(utfSize);
   stream->Read(utfBlock, utfSize);
-  if (!result->ReadUtfBlock(utfBlock, utfSize, &headerUtfTable)) {
+  if (!headerTable.Load(utfBlock, utfSize, true)) {
     goto fail;
   }
 
-  alignVal = headerUtfTable[0]["Align"].Uint16Val;
-  result->FileCount = headerUtfTable[0]["Files"].Uint32Val;
-  result->Version = headerUtfTable[0]["Version"].Uint16Val;
-  result->Revision = headerUtfTable[0]["Revision"].Uint16Val;
+  alignVal = headerTable.GetUint(0, headerTable.FindColumn("Align"));
+  result->FileCount = headerTable.GetUint(0, headerTable.FindColumn("Files"));
+  result->Version = headerTable.GetUint(0, headerTable.FindColumn("Version"));
+  result->Revision =
+      headerTable.GetUint(0, headerTable.FindColumn("Revision"));
+  tocOffset = headerTable.GetUint(0, headerTable.FindColumn("TocOffset"));
+  etocOffset = headerTable.GetUint(0, headerTable.FindColumn("EtocOffset"));
+  itocOffset = headerTable.GetUint(0, headerTable.FindColumn("ItocOffset"));
+  contentOffset =
+      headerTable.GetUint(0, headerTable.FindColumn("ContentOffset"));
 
   result->FileList = new CpkMetaEntry[result->FileCount];
 
-  if (headerUtfTable[0]["TocOffset"].Uint64Val != 0) {
-    result->ReadToc(headerUtfTable[0]["TocOffset"].Uint64Val,
-                    headerUtfTable[0]["ContentOffset"].Uint64Val);
+  if (tocOffset != 0) {
+    result->ReadToc(tocOffset, contentOffset);
   }
 
-  if (headerUtfTable[0]["EtocOffset"].Uint64Val != 0) {
-    result->ReadEtoc(headerUtfTable[0]["EtocOffset"].Uint64Val);
+  if (etocOffset != 0) {
+    result->ReadEtoc(etocOffset);
   }
 
-  if (headerUtfTable[0]["ItocOffset"].Uint64Val != 0) {
-    result->ReadItoc(headerUtfTable[0]["ItocOffset"].Uint64Val,
-                     headerUtfTable[0]["ContentOffset"].Uint64Val, alignVal);
+  if (itocOffset != 0) {
+    result->ReadItoc(itocOffset, contentOffset, alignVal);
   }
 
   for (int i = 0; i < result->FileCount; i++) {
     result->NamesToIds[result->FileList[i].FileName] = result->FileList[i].Id;
   }
 
+  if (cacheable) result->WriteIndexCache(archiveMtime);
+
   result->IsInit = true;
   *outArchive = result;
   return IoError_OK;
@@ -416,14 +531,18 @@ IoError CpkArchive::Open(FileMeta* file, InputStream** outStream) {
 
   IoError err;
   if (entry->Compressed) {
-    ImpLog(LL_Debug, LC_IO,
-           "CPK cannot stream LAYLA compressed file \"%s\" in archive "
-           "\"%s\"\n",
-           entry->FileName.c_str(), BaseStream->Meta.FileName.c_str());
-    return IoError_Fail;
+    // LAYLA is decoded back to front, so the first byte of a file is only
+    // known once all of it is - decompress in one go and stream from memory
+    void* memory;
+    int64_t size;
+    err = Slurp(file, &memory, &size);
+    if (err == IoError_OK) *outStream = new MemoryStream(memory, size, true);
   } else {
+    // May duplicate BaseStream
+    SDL_LockMutex(Lock);
     err = UncompressedStream::Create(BaseStream, entry->Offset, entry->Size,
                                      outStream);
+    SDL_UnlockMutex(Lock);
   }
   if (err != IoError_OK) {
     ImpLog(LL_Error, LC_IO,
@@ -433,85 +552,142 @@ IoError CpkArchive::Open(FileMeta* file, InputStream** outStream) {
   return err;
 }
 
-// Based on https://forum.xentax.com/viewtopic.php?f=21&t=5137&hilit=CRILAYLA
+IoError CpkArchive::View(FileMeta* file, void const** outBuffer,
+                         int64_t* outSize) {
+  CpkMetaEntry* entry = (CpkMetaEntry*)file;
+  if (entry->Compressed) return IoError_Fail;
+  return ViewBaseStream(entry->Offset, entry->Size, outBuffer, outSize);
+}
 
-static uint32_t get_next_bits(char* input, int* offset_p, uint32_t* bit_pool_p,
-                              int* bits_left_p, int bit_count) {
-  uint32_t out_bits = 0;
+IoError CpkArchive::GetStorage(FileMeta* file, int64_t* outOffset,
+                               int64_t* outSize) {
+  CpkMetaEntry* entry = (CpkMetaEntry*)file;
+  *outOffset = entry->Offset;
+  *outSize = entry->CompressedSize;
+  return IoError_OK;
+}
 
-  if (*bits_left_p < bit_count) {
-    int count = ((24 - *bits_left_p) >> 3) + 1;
-    while (count) {
-      uint8_t source = input[*offset_p];
-      *offset_p = *offset_p - 1;
-      *bit_pool_p = (*bit_pool_p << 8) | source;
-      *bits_left_p += 8;
-      count--;
-    }
-  }
+// Based on https://github.com/hcs64/vgm_ripping/tree/master/multi/utf_tab
+//
+// CRILAYLA is a backwards LZ: the bitstream is read MSB-first from the end of
+// the compressed data towards its start, and the output is produced from its
+// end towards its start, following a 0x100 byte uncompressed prefix.
 
-  *bits_left_p -= bit_count;
-  out_bits = *bit_pool_p >> *bits_left_p;
-  uint32_t mask = (1 << bit_count) - 1;
-  out_bits &= mask;
+static uint32_t const LaylaBitMasks[] = {
+    0x0,   0x1,   0x3,   0x7,   0xf,    0x1f,   0x3f,   0x7f,  0xff,
+    0x1ff, 0x3ff, 0x7ff, 0xfff, 0x1fff, 0x3fff, 0x7fff, 0xffff};
 
-  return out_bits;
-}
+static int const LaylaVleLengths[] = {2, 3, 5, 8};
 
-// Based on https://github.com/hcs64/vgm_ripping/tree/master/multi/utf_tab
+struct LaylaBitReader {
+  uint8_t const* Input;
+  // Next byte to load into Pool, moving towards 0
+  int64_t Offset;
+  uint64_t Pool = 0;
+  int BitsLeft = 0;
+
+  // Tops Pool up with as many whole bytes as fit, at least 48 bits
+  void Refill() {
+    if (Offset >= 7) {
+      int count = (63 - BitsLeft) >> 3;
+      uint64_t bytes;
+      memcpy(&bytes, Input + Offset - 7, sizeof(bytes));
+      // Input[Offset] ends up as the most significant byte
+      bytes = SDL_SwapLE64(bytes);
+      Pool = (Pool << (count * 8)) | (bytes >> (64 - count * 8));
+      Offset -= count;
+      BitsLeft += count * 8;
+    } else {
+      // Past the start of the input we feed zeroes, a well-formed stream never
+      // consumes them
+      while (BitsLeft <= 56) {
+        Pool = (Pool << 8) | (Offset >= 0 ? Input[Offset] : 0);
+        Offset--;
+        BitsLeft += 8;
+      }
+    }
+  }
 
-static IoError DecompressLayla(char* input, uint32_t compressedSize,
-                               char* output, uint32_t uncompressedSize) {
-  int uncompressed_size = SDL_SwapLE32(*(uint32_t*)(input + 8));
-  uint32_t compressedStreamLength = SDL_SwapLE32(*(uint32_t*)(input + 12));
-  uint32_t compressedOffset = 16;
-  uint32_t prefixOffset = compressedOffset + compressedStreamLength;
+  // count <= 16
+  uint32_t Get(int count) {
+    if (BitsLeft < count) Refill();
+    BitsLeft -= count;
+    return (uint32_t)(Pool >> BitsLeft) & LaylaBitMasks[count];
+  }
+};
+
+static IoError DecompressLayla(uint8_t const* input, uint32_t compressedSize,
+                               uint8_t* output, uint32_t outputSize) {
+  if (compressedSize < 16 + 0x100) {
+    ImpLog(LL_Debug, LC_IO, "CPK unexpected end of LAYLA stream\n");
+    return IoError_Fail;
+  }
+  uint32_t uncompressedSize;
+  uint32_t compressedStreamLength;
+  memcpy(&uncompressedSize, input + 8, sizeof(uncompressedSize));
+  memcpy(&compressedStreamLength, input + 12, sizeof(compressedStreamLength));
+  uncompressedSize = SDL_SwapLE32(uncompressedSize);
+  compressedStreamLength = SDL_SwapLE32(compressedStreamLength);
+
+  uint32_t const compressedOffset = 16;
+  uint64_t prefixOffset = (uint64_t)compressedOffset + compressedStreamLength;
   if (compressedSize < prefixOffset || compressedSize - prefixOffset != 0x100) {
     ImpLog(LL_Debug, LC_IO, "CPK unexpected end of LAYLA stream\n");
     return IoError_Fail;
   }
-  memcpy(output, input + compressedOffset + compressedStreamLength, 0x100);
-
-  int input_end = (compressedSize - 0x100 - 1);
-  int input_offset = input_end;
-  int output_end = 0x100 + uncompressed_size - 1;
-  uint32_t bit_pool = 0;
-  int bits_left = 0, bytes_output = 0;
-  int vle_lens[4] = {2, 3, 5, 8};
-
-  while (bytes_output < uncompressed_size) {
-    if (get_next_bits(input, &input_offset, &bit_pool, &bits_left, 1) > 0) {
-      int backreference_offset =
-          output_end - bytes_output +
-          get_next_bits(input, &input_offset, &bit_pool, &bits_left, 13) + 3;
-      int backreference_length = 3;
-      int vle_level;
-
-      for (vle_level = 0; vle_level < 4; vle_level++) {
-        int this_level = get_next_bits(input, &input_offset, &bit_pool,
-                                       &bits_left, vle_lens[vle_level]);
-        backreference_length += this_level;
-        if (this_level != ((1 << vle_lens[vle_level]) - 1)) break;
-      }
+  if ((uint64_t)uncompressedSize + 0x100 > outputSize) {
+    ImpLog(LL_Debug, LC_IO, "CPK LAYLA output larger than file size\n");
+    return IoError_Fail;
+  }
+  memcpy(output, input + prefixOffset, 0x100);
 
-      if (vle_level == 4) {
-        int this_level;
-        do {
-          this_level =
-              get_next_bits(input, &input_offset, &bit_pool, &bits_left, 8);
-          backreference_length += this_level;
-        } while (this_level == 255);
-      }
+  LaylaBitReader bits;
+  bits.Input = input;
+  bits.Offset = compressedSize - 0x100 - 1;
 
-      for (int i = 0; i < backreference_length; i++) {
-        output[output_end - bytes_output] = output[backreference_offset--];
-        bytes_output++;
-      }
-    } else {
+  // Next output byte, moving downwards until outputStart
+  int64_t const outputStart = 0x100;
+  int64_t const outputEnd = 0x100 + (int64_t)uncompressedSize - 1;
+  int64_t outPos = outputEnd;
+
+  while (outPos >= outputStart) {
+    if (bits.Get(1) == 0) {
       // verbatim byte
-      output[output_end - bytes_output] = (uint8_t)get_next_bits(
-          input, &input_offset, &bit_pool, &bits_left, 8);
-      bytes_output++;
+      output[outPos--] = (uint8_t)bits.Get(8);
+      continue;
+    }
+
+    int64_t distance = bits.Get(13) + 3;
+    int64_t length = 3;
+    int vleLevel;
+    for (vleLevel = 0; vleLevel < 4; vleLevel++) {
+      uint32_t thisLevel = bits.Get(LaylaVleLengths[vleLevel]);
+      length += thisLevel;
+      if (thisLevel != LaylaBitMasks[LaylaVleLengths[vleLevel]]) break;
+    }
+    if (vleLevel == 4) {
+      uint32_t thisLevel;
+      do {
+        thisLevel = bits.Get(8);
+        length += thisLevel;
+      } while (thisLevel == 255);
+    }
+
+    int64_t srcPos = outPos + distance;
+    if (srcPos > outputEnd || outPos - length + 1 < outputStart) {
+      ImpLog(LL_Debug, LC_IO, "CPK invalid LAYLA back-reference\n");
+      return IoError_Fail;
+    }
+
+    // Copies run downwards, so chunks of up to distance bytes never read
+    // anything written by the same chunk - short distances (runs) just take
+    // more chunks
+    while (length > 0) {
+      int64_t chunk = length < distance ? length : distance;
+      memcpy(output + outPos - chunk + 1, output + srcPos - chunk + 1, chunk);
+      outPos -= chunk;
+      srcPos -= chunk;
+      length -= chunk;
     }
   }
   return IoError_OK;
@@ -523,33 +699,39 @@ IoError CpkArchive::Slurp(FileMeta* file, void** outBuffer, int64_t* outSize) {
     return IoError_Fail;
   }
 
-  int64_t pos = BaseStream->Seek(entry->Offset, RW_SEEK_SET);
-  if (pos != entry->Offset) {
-    ImpLog(LL_Error, LC_IO,
-           "CPK failed to seek when slurping compressed file \"%s\" in "
-           "archive \"%s\"\n",
-           entry->FileName.c_str(), BaseStream->Meta.FileName.c_str());
-    return IoError_Fail;
-  }
-  char* compressedData = (char*)malloc(entry->CompressedSize);
-  int64_t read = BaseStream->Read(compressedData, entry->CompressedSize);
-  if (read != entry->CompressedSize) {
-    ImpLog(LL_Error, LC_IO,
-           "CPK failed to read compressed data when slurping compressed file "
-           "\"%s\" in "
-           "archive \"%s\"\n",
-           entry->FileName.c_str(), BaseStream->Meta.FileName.c_str());
-    free(compressedData);
-    return IoError_Fail;
+  // Memory-backed archives are decompressed straight from the mapping
+  void const* compressedData;
+  int64_t compressedSize;
+  bool ownsCompressedData = false;
+  if (ViewBaseStream(entry->Offset, entry->CompressedSize, &compressedData,
+                     &compressedSize) != IoError_OK) {
+    void* readData = malloc(entry->CompressedSize);
+    // Without native ReadAt() this seeks BaseStream
+    if (!BaseStream->HasReadAt) SDL_LockMutex(Lock);
+    int64_t read =
+        BaseStream->ReadAt(entry->Offset, readData, entry->CompressedSize);
+    if (!BaseStream->HasReadAt) SDL_UnlockMutex(Lock);
+    if (read != entry->CompressedSize) {
+      ImpLog(LL_Error, LC_IO,
+             "CPK failed to read compressed data when slurping compressed "
+             "file \"%s\" in archive \"%s\"\n",
+             entry->FileName.c_str(), BaseStream->Meta.FileName.c_str());
+      free(readData);
+      return IoError_Fail;
+    }
+    compressedData = readData;
+    compressedSize = read;
+    ownsCompressedData = true;
   }
 
   *outSize = entry->Size;
   *outBuffer = malloc(*outSize);
 
-  IoError err = DecompressLayla(compressedData, entry->CompressedSize,
-                                (char*)*outBuffer, *outSize);
+  IoError err = DecompressLayla((uint8_t const*)compressedData, compressedSize,
+                                (uint8_t*)*outBuffer, *outSize);
+
   if (err != IoError_OK) free(*outBuffer);
-  free(compressedData);
+  if (ownsCompressedData) free((void*)compressedData);
   return err;
 }
 
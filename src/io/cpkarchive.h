@@ -8,28 +8,18 @@
 namespace Impacto {
 namespace Io {
 
-int const CpkMaxPath = 224;
-
 struct CpkMetaEntry;
-
-struct CpkCell {
-  union {
-    uint8_t Uint8Val;
-    uint16_t Uint16Val;
-    uint32_t Uint32Val;
-    uint64_t Uint64Val;
-    uint8_t* DataArray;
-    float FloatVal;
-    char StringVal[CpkMaxPath];
-  };
-  uint64_t DataSize;
-};
+class CpkUtfTable;
 
 class CpkArchive : public VfsArchive {
  public:
   ~CpkArchive();
 
   IoError Open(FileMeta* file, InputStream** outStream) override;
+  IoError View(FileMeta* file, void const** outBuffer,
+               int64_t* outSize) override;
+  IoError GetStorage(FileMeta* file, int64_t* outOffset,
+                     int64_t* outSize) override;
   IoError Slurp(FileMeta* file, void** outBuffer, int64_t* outSize) override;
 
   static IoError Create(InputStream* stream, VfsArchive** outArchive);
@@ -38,18 +28,18 @@ class CpkArchive : public VfsArchive {
   IoError ReadToc(int64_t tocOffset, int64_t contentOffset);
   IoError ReadEtoc(int64_t etocOffset);
   IoError ReadItoc(int64_t itocOffset, int64_t contentOffset, uint16_t align);
+  void ReadItocRows(CpkUtfTable const& table);
 
   CpkMetaEntry* GetFileListEntry(uint32_t id);
 
-  bool ReadUtfBlock(
-      uint8_t* utfBlock, uint64_t utfSize,
-      std::vector<ska::flat_hash_map<std::string, CpkCell>>* rows);
-  void ReadString(int64_t stringsOffset, char* output);
+  // Persistent index, see Profile::Vfs::IndexCacheDir. Keyed by archive path,
+  // size and modification time, lets us skip UTF table parsing on mount.
+  bool ReadIndexCache(int64_t archiveMtime);
+  void WriteIndexCache(int64_t archiveMtime);
 
   uint16_t Version;
   uint16_t Revision;
 
-  MemoryStream* UtfStream = 0;
   CpkMetaEntry* FileList = 0;
   uint32_t FileCount = 0;
   uint32_t NextFile = 0;
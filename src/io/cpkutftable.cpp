@@ -0,0 +1,219 @@
+#include "cpkutftable.h"
+
+#include "../log.h"
+#include <SDL_endian.h>
+#include <string.h>
+
+namespace Impacto {
+namespace Io {
+
+void DecryptUtfBlock(uint8_t* utfBlock, uint64_t size) {
+  uint32_t utfDecryptVal = 0x655f;
+  for (uint64_t i = 0; i < size; i++) {
+    utfBlock[i] ^= utfDecryptVal & 0xFF;
+    utfDecryptVal *= 0x4115;
+  }
+}
+
+static uint16_t LoadBE16(uint8_t const* p) {
+  uint16_t val;
+  memcpy(&val, p, sizeof(val));
+  return SDL_SwapBE16(val);
+}
+static uint32_t LoadBE32(uint8_t const* p) {
+  uint32_t val;
+  memcpy(&val, p, sizeof(val));
+  return SDL_SwapBE32(val);
+}
+static uint64_t LoadBE64(uint8_t const* p) {
+  uint64_t val;
+  memcpy(&val, p, sizeof(val));
+  return SDL_SwapBE64(val);
+}
+
+static uint64_t const CpkUtfEmptyString = UINT64_MAX;
+
+bool CpkUtfTable::ReadStringOffset(uint8_t const** cursor,
+                                   uint64_t* outOffset) const {
+  if (*cursor + 4 > Block + Size) return false;
+  uint64_t offset = StringsOffset + LoadBE32(*cursor);
+  *cursor += 4;
+  if (offset >= Size || !memchr(Block + offset, 0, Size - offset)) {
+    *outOffset = CpkUtfEmptyString;
+  } else {
+    *outOffset = offset;
+  }
+  return true;
+}
+
+bool CpkUtfTable::ReadValue(uint8_t const** cursor, int type,
+                            uint64_t* outValue) const {
+  uint8_t const* end = Block + Size;
+  switch (type) {
+    case TYPE_1BYTE:
+    case TYPE_1BYTE2:
+      if (*cursor + 1 > end) return false;
+      *outValue = **cursor;
+      *cursor += 1;
+      return true;
+    case TYPE_2BYTE:
+    case TYPE_2BYTE2:
+      if (*cursor + 2 > end) return false;
+      *outValue = LoadBE16(*cursor);
+      *cursor += 2;
+      return true;
+    case TYPE_4BYTE:
+    case TYPE_4BYTE2:
+    case TYPE_FLOAT:
+      if (*cursor + 4 > end) return false;
+      *outValue = LoadBE32(*cursor);
+      *cursor += 4;
+      return true;
+    case TYPE_8BYTE:
+    case TYPE_8BYTE2:
+      if (*cursor + 8 > end) return false;
+      *outValue = LoadBE64(*cursor);
+      *cursor += 8;
+      return true;
+    case TYPE_STRING:
+      return ReadStringOffset(cursor, outValue);
+    case TYPE_DATA: {
+      if (*cursor + 8 > end) return false;
+      uint64_t dataPos = DataOffset + LoadBE32(*cursor);
+      uint64_t dataSize = LoadBE32(*cursor + 4);
+      *cursor += 8;
+      if (dataPos + dataSize > Size) {
+        *outValue = 0;
+      } else {
+        *outValue = (dataPos << 32) | dataSize;
+      }
+      return true;
+    }
+    default:
+      return false;
+  }
+}
+
+bool CpkUtfTable::Load(uint8_t* block, uint64_t size, bool ownsBlock) {
+  const uint32_t utfMagic = 0x40555446;
+  Block = block;
+  Size = size;
+  OwnsBlock = ownsBlock;
+
+  if (size < 32) {
+    ImpLog(LL_Trace, LC_IO, "Error reading CPK UTF table\n");
+    return false;
+  }
+  if (LoadBE32(block) != utfMagic) {
+    DecryptUtfBlock(block, size);
+    if (LoadBE32(block) != utfMagic) {
+      ImpLog(LL_Trace, LC_IO, "Error reading CPK UTF table\n");
+      return false;
+    }
+  }
+
+  // uint32_t tableSize = LoadBE32(block + 4);
+  uint64_t rowsOffset = (uint64_t)LoadBE32(block + 8) + 8;
+  StringsOffset = (uint64_t)LoadBE32(block + 12) + 8;
+  DataOffset = (uint64_t)LoadBE32(block + 16) + 8;
+  // uint32_t tableNameOffset = LoadBE32(block + 20);
+  uint16_t numColumns = LoadBE16(block + 24);
+  uint16_t rowLength = LoadBE16(block + 26);
+  uint32_t numRows = LoadBE32(block + 28);
+
+  uint8_t const* cursor = block + 32;
+  uint8_t const* end = block + size;
+
+  Columns.resize(numColumns);
+  for (auto& column : Columns) {
+    if (cursor + 1 > end) goto fail;
+    column.Flags = *cursor++;
+    if (column.Flags == 0) {
+      if (cursor + 4 > end) goto fail;
+      column.Flags = LoadBE32(cursor);
+      cursor += 4;
+    }
+
+    uint64_t nameOffset;
+    if (!ReadStringOffset(&cursor, &nameOffset)) goto fail;
+    column.Name = nameOffset == CpkUtfEmptyString
+                      ? ""
+                      : (char const*)Block + nameOffset;
+
+    if ((column.Flags & STORAGE_MASK) == STORAGE_CONSTANT) {
+      uint64_t value;
+      if (!ReadValue(&cursor, column.Flags & TYPE_MASK, &value)) goto fail;
+      column.Values.push_back(value);
+    } else if ((column.Flags & STORAGE_MASK) == STORAGE_PERROW) {
+      column.Values.reserve(numRows);
+    }
+  }
+
+  if (rowsOffset + (uint64_t)numRows * rowLength > size) goto fail;
+
+  for (uint32_t i = 0; i < numRows; i++) {
+    cursor = block + rowsOffset + (uint64_t)i * rowLength;
+    for (auto& column : Columns) {
+      if ((column.Flags & STORAGE_MASK) != STORAGE_PERROW) continue;
+      uint64_t value;
+      if (!ReadValue(&cursor, column.Flags & TYPE_MASK, &value)) goto fail;
+      column.Values.push_back(value);
+    }
+  }
+
+  RowCount = numRows;
+  return true;
+
+fail:
+  ImpLog(LL_Trace, LC_IO, "Error reading CPK UTF table\n");
+  Columns.clear();
+  return false;
+}
+
+int CpkUtfTable::FindColumn(char const* name) const {
+  for (int i = 0; i < Columns.size(); i++) {
+    if (strcmp(Columns[i].Name, name) == 0) return i;
+  }
+  return -1;
+}
+
+uint64_t CpkUtfTable::GetValue(uint32_t row, int column) const {
+  if (column < 0 || row >= RowCount) return 0;
+  Column const& col = Columns[column];
+  switch (col.Flags & STORAGE_MASK) {
+    case STORAGE_CONSTANT:
+      return col.Values[0];
+    case STORAGE_PERROW:
+      return col.Values[row];
+    default:
+      return 0;
+  }
+}
+
+uint64_t CpkUtfTable::GetUint(uint32_t row, int column) const {
+  return GetValue(row, column);
+}
+
+char const* CpkUtfTable::GetString(uint32_t row, int column) const {
+  if (column < 0 || (Columns[column].Flags & TYPE_MASK) != TYPE_STRING) {
+    return "";
+  }
+  uint64_t offset = GetValue(row, column);
+  if (offset == 0 || offset == CpkUtfEmptyString) return "";
+  return (char const*)Block + offset;
+}
+
+uint8_t* CpkUtfTable::GetData(uint32_t row, int column,
+                              uint64_t* outSize) const {
+  *outSize = 0;
+  if (column < 0 || (Columns[column].Flags & TYPE_MASK) != TYPE_DATA) {
+    return 0;
+  }
+  uint64_t value = GetValue(row, column);
+  if (value == 0) return 0;
+  *outSize = value & 0xFFFFFFFF;
+  return Block + (value >> 32);
+}
+
+}  // namespace Io
+}  // namespace Impacto
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <vector>
+
+namespace Impacto {
+namespace Io {
+
+enum CpkColumnFlags {
+  STORAGE_MASK = 0xf0,
+  STORAGE_NONE = 0x00,
+  STORAGE_ZERO = 0x10,
+  STORAGE_CONSTANT = 0x30,
+  STORAGE_PERROW = 0x50,
+
+  TYPE_MASK = 0x0f,
+  TYPE_DATA = 0x0b,
+  TYPE_STRING = 0x0a,
+  TYPE_FLOAT = 0x08,
+  TYPE_8BYTE2 = 0x07,
+  TYPE_8BYTE = 0x06,
+  TYPE_4BYTE2 = 0x05,
+  TYPE_4BYTE = 0x04,
+  TYPE_2BYTE2 = 0x03,
+  TYPE_2BYTE = 0x02,
+  TYPE_1BYTE2 = 0x01,
+  TYPE_1BYTE = 0x00,
+};
+
+// @UTF tables that don't start with their magic are obfuscated, this undoes it
+// in place
+void DecryptUtfBlock(uint8_t* utfBlock, uint64_t size);
+
+// Columnar view of a @UTF table. The schema is parsed once, then every row is
+// decoded straight from the (decrypted) block into one value array per
+// column, so lookups are an index instead of a string hash per cell. Column
+// indices are resolved with FindColumn() once per table.
+//
+// Strings and data cells point into the block, which therefore has to outlive
+// the table's users - if ownsBlock is true, the table frees it.
+class CpkUtfTable {
+ public:
+  ~CpkUtfTable() {
+    if (OwnsBlock) free(Block);
+  }
+
+  bool Load(uint8_t* block, uint64_t size, bool ownsBlock);
+
+  // -1 if there is no such column, reading a nonexistent column or row yields
+  // 0 / "" / no data
+  int FindColumn(char const* name) const;
+
+  uint64_t GetUint(uint32_t row, int column) const;
+  char const* GetString(uint32_t row, int column) const;
+  uint8_t* GetData(uint32_t row, int column, uint64_t* outSize) const;
+
+  uint32_t RowCount = 0;
+
+ private:
+  struct Column {
+    uint32_t Flags;
+    char const* Name;
+    // Integers and float bits as is, strings as block offset, data as
+    // (block offset << 32) | size. One entry for constant columns, none for
+    // zero columns.
+    std::vector<uint64_t> Values;
+  };
+
+  bool ReadValue(uint8_t const** cursor, int type, uint64_t* outValue) const;
+  bool ReadStringOffset(uint8_t const** cursor, uint64_t* outOffset) const;
+  uint64_t GetValue(uint32_t row, int column) const;
+
+  uint8_t* Block = 0;
+  uint64_t Size = 0;
+  bool OwnsBlock = false;
+  uint64_t StringsOffset;
+  uint64_t DataOffset;
+  std::vector<Column> Columns;
+};
+
+}  // namespace Io
+}  // namespace Impacto
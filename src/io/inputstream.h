@@ -10,18 +10,66 @@
 namespace Impacto {
 namespace Io {
 
+class VfsArchive;
+// Keep an archive (and so its BaseStream and memory) alive past unmounting, the
+// last UnpinArchive() deletes it. Defined in vfs.cpp.
+void PinArchive(VfsArchive* archive);
+void UnpinArchive(VfsArchive* archive);
+
 class InputStream {
  public:
-  virtual ~InputStream() {}
+  InputStream() {}
+  // Duplicates keep the archive pinned too
+  InputStream(InputStream const& other)
+      : Meta(other.Meta),
+        Position(other.Position),
+        IsSeekSlow(other.IsSeekSlow),
+        IsMemory(other.IsMemory),
+        IsFile(other.IsFile),
+        HasReadAt(other.HasReadAt),
+        Archive(other.Archive) {
+    if (Archive) PinArchive(Archive);
+  }
+  InputStream& operator=(InputStream const&) = delete;
+  virtual ~InputStream() {
+    if (Archive) UnpinArchive(Archive);
+  }
+
   FileMeta Meta;
   int64_t Position = 0;
 
   bool IsSeekSlow = false;
   bool IsMemory = false;
+  // Meta.FileName is the path of a file on disk this stream reads from, rather
+  // than just a name (e.g. for an archive mounted from memory)
+  bool IsFile = false;
+  // ReadAt() doesn't touch Position or any other state of the stream, so it
+  // may be called from multiple threads at once, e.g. by sub-streams sharing
+  // this as their base
+  bool HasReadAt = false;
+  // Set by the VFS on streams it opens from an archive, which may read from the
+  // archive's BaseStream or point into its memory. Pinned for as long as the
+  // stream exists, so the archive can be unmounted before it is closed.
+  VfsArchive* Archive = 0;
 
   virtual int64_t Read(void* buffer, int64_t sz) = 0;
   virtual int64_t Seek(int64_t offset, int origin) = 0;
   virtual IoError Duplicate(InputStream** outStream) = 0;
+
+  // Read sz bytes at absolute offset, without moving Position. Unless
+  // HasReadAt is set, this is emulated with Seek() and Read().
+  virtual int64_t ReadAt(int64_t offset, void* buffer, int64_t sz) {
+    int64_t oldPosition = Position;
+    if (Seek(offset, RW_SEEK_SET) != offset) return IoError_Fail;
+    int64_t read = Read(buffer, sz);
+    Seek(oldPosition, RW_SEEK_SET);
+    return read;
+  }
+
+  // Hint that sz bytes at offset will be read soon, so they can be brought in
+  // without copying them anywhere. Returns false if the stream can't do that,
+  // reading the range is the only way to warm the cache then.
+  virtual bool WillNeed(int64_t offset, int64_t sz) { return false; }
 };
 
 inline uint8_t ReadU8(InputStream* stream) {
@@ -29,6 +29,20 @@ IoError Lnk4Archive::Open(FileMeta* file, InputStream** outStream) {
   return err;
 }
 
+IoError Lnk4Archive::View(FileMeta* file, void const** outBuffer,
+                          int64_t* outSize) {
+  Lnk4MetaEntry* entry = (Lnk4MetaEntry*)file;
+  return ViewBaseStream(entry->Offset, entry->Size, outBuffer, outSize);
+}
+
+IoError Lnk4Archive::GetStorage(FileMeta* file, int64_t* outOffset,
+                                int64_t* outSize) {
+  Lnk4MetaEntry* entry = (Lnk4MetaEntry*)file;
+  *outOffset = entry->Offset;
+  *outSize = entry->Size;
+  return IoError_OK;
+}
+
 IoError Lnk4Archive::Create(InputStream* stream, VfsArchive** outArchive) {
   ImpLog(LL_Trace, LC_IO, "Trying to mount \"%s\" as LNK4\n",
          stream->Meta.FileName.c_str());
@@ -11,6 +11,10 @@ class Lnk4Archive : public VfsArchive {
  public:
   ~Lnk4Archive();
   IoError Open(FileMeta* file, InputStream** outStream) override;
+  IoError View(FileMeta* file, void const** outBuffer,
+               int64_t* outSize) override;
+  IoError GetStorage(FileMeta* file, int64_t* outOffset,
+                     int64_t* outSize) override;
 
   static IoError Create(InputStream* stream, VfsArchive** outArchive);
 
@@ -0,0 +1,133 @@
+#include "mappedfilestream.h"
+
+#include "../impacto.h"
+#include <algorithm>
+
+#if IMPACTO_HAVE_MMAP
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+#endif
+
+namespace Impacto {
+namespace Io {
+
+#if IMPACTO_HAVE_MMAP && defined(_WIN32)
+
+MappedFileStream::~MappedFileStream() {
+  UnmapViewOfFile(Memory);
+  CloseHandle(MappingHandle);
+  CloseHandle(FileHandle);
+}
+
+IoError MappedFileStream::Create(std::string const& fileName,
+                                 InputStream** out) {
+  HANDLE file = CreateFileA(fileName.c_str(), GENERIC_READ, FILE_SHARE_READ,
+                            NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+  if (file == INVALID_HANDLE_VALUE) return IoError_Fail;
+
+  LARGE_INTEGER size;
+  if (!GetFileSizeEx(file, &size) || size.QuadPart <= 0 ||
+      (uint64_t)size.QuadPart > SIZE_MAX) {
+    CloseHandle(file);
+    return IoError_Fail;
+  }
+
+  HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+  if (!mapping) {
+    CloseHandle(file);
+    return IoError_Fail;
+  }
+  void* memory = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+  if (!memory) {
+    CloseHandle(mapping);
+    CloseHandle(file);
+    return IoError_Fail;
+  }
+
+  MappedFileStream* result = new MappedFileStream;
+  result->Memory = memory;
+  result->FreeOnClose = false;
+  result->IsMemory = true;
+  result->IsFile = true;
+  result->HasReadAt = true;
+  result->FileHandle = file;
+  result->MappingHandle = mapping;
+  result->Meta.Size = size.QuadPart;
+  result->Meta.FileName = fileName;
+  *out = (InputStream*)result;
+  return IoError_OK;
+}
+
+bool MappedFileStream::WillNeed(int64_t offset, int64_t sz) {
+  return MemoryStream::WillNeed(offset, sz);
+}
+
+#elif IMPACTO_HAVE_MMAP
+
+MappedFileStream::~MappedFileStream() { munmap(Memory, Meta.Size); }
+
+IoError MappedFileStream::Create(std::string const& fileName,
+                                 InputStream** out) {
+  int fd = open(fileName.c_str(), O_RDONLY);
+  if (fd < 0) return IoError_Fail;
+
+  struct stat st;
+  if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size <= 0 ||
+      (uint64_t)st.st_size > SIZE_MAX) {
+    close(fd);
+    return IoError_Fail;
+  }
+
+  void* memory = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  // The mapping keeps its own reference to the file
+  close(fd);
+  if (memory == MAP_FAILED) return IoError_Fail;
+
+  MappedFileStream* result = new MappedFileStream;
+  result->Memory = memory;
+  result->FreeOnClose = false;
+  result->IsMemory = true;
+  result->IsFile = true;
+  result->HasReadAt = true;
+  result->Meta.Size = st.st_size;
+  result->Meta.FileName = fileName;
+  *out = (InputStream*)result;
+  return IoError_OK;
+}
+
+bool MappedFileStream::WillNeed(int64_t offset, int64_t sz) {
+  if (offset < 0 || sz <= 0 || offset >= Meta.Size) return true;
+  int64_t end = std::min(Meta.Size, offset + sz);
+  // madvise() wants a page aligned start
+  int64_t pageSize = sysconf(_SC_PAGESIZE);
+  int64_t start = offset - offset % pageSize;
+  if (madvise((uint8_t*)Memory + start, end - start, MADV_WILLNEED) == 0) {
+    return true;
+  }
+  return MemoryStream::WillNeed(offset, sz);
+}
+
+#else
+
+MappedFileStream::~MappedFileStream() {}
+
+IoError MappedFileStream::Create(std::string const& fileName,
+                                 InputStream** out) {
+  return IoError_Fail;
+}
+
+bool MappedFileStream::WillNeed(int64_t offset, int64_t sz) {
+  return MemoryStream::WillNeed(offset, sz);
+}
+
+#endif
+
+}  // namespace Io
+}  // namespace Impacto
\ No newline at end of file
@@ -0,0 +1,36 @@
+#pragma once
+
+#include "memorystream.h"
+#include <string>
+
+namespace Impacto {
+namespace Io {
+
+// Read-only memory mapping of a physical file. Reading is a plain copy out of
+// the mapping, without going through an intermediate buffer, and duplicates
+// are non-owning MemoryStreams over the same mapping - so they (and everything
+// opened from an archive backed by this) must not outlive the original stream.
+
+class MappedFileStream : public MemoryStream {
+ public:
+  ~MappedFileStream();
+
+  // Fails if mapping is not supported on this platform or the mapping could not
+  // be established (e.g. not enough address space on 32-bit), callers should
+  // fall back to PhysicalFileStream then.
+  static IoError Create(std::string const& fileName, InputStream** out);
+  // Asks the kernel to read the range ahead (madvise(MADV_WILLNEED)) where
+  // possible, instead of faulting it in synchronously
+  bool WillNeed(int64_t offset, int64_t sz) override;
+
+ protected:
+  MappedFileStream() {}
+
+#ifdef _WIN32
+  void* FileHandle;
+  void* MappingHandle;
+#endif
+};
+
+}  // namespace Io
+}  // namespace Impacto
\ No newline at end of file
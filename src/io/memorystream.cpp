@@ -13,6 +13,7 @@ MemoryStream::MemoryStream(void* mem, int64_t size, bool freeOnClose)
     : Memory(mem), FreeOnClose(freeOnClose) {
   Meta.Size = size;
   IsMemory = true;
+  HasReadAt = true;
 }
 
 int64_t MemoryStream::Read(void* buffer, int64_t sz) {
@@ -40,6 +41,27 @@ int64_t MemoryStream::Seek(int64_t offset, int origin) {
   return newPos;
 }
 
+int64_t MemoryStream::ReadAt(int64_t offset, void* buffer, int64_t sz) {
+  if (sz < 0 || offset < 0 || offset > Meta.Size) return IoError_Fail;
+  if (offset == Meta.Size) return IoError_Eof;
+  sz = std::min(Meta.Size - offset, sz);
+  memcpy(buffer, (uint8_t*)Memory + offset, sz);
+  return sz;
+}
+
+// Memory streams may be views into a file mapping (e.g. archives mounted from
+// inside a mapped archive), so this touches a byte of every page, which faults
+// in what isn't resident without copying anything
+bool MemoryStream::WillNeed(int64_t offset, int64_t sz) {
+  if (offset < 0 || sz <= 0 || offset >= Meta.Size) return true;
+  int64_t end = std::min(Meta.Size, offset + sz);
+  uint8_t volatile const* memory = (uint8_t volatile const*)Memory;
+  for (int64_t pos = offset; pos < end; pos += 4096) {
+    (void)memory[pos];
+  }
+  return true;
+}
+
 IoError MemoryStream::Duplicate(InputStream** outStream) {
   MemoryStream* result = new MemoryStream(*this);
   result->FreeOnClose = false;
@@ -13,6 +13,13 @@ class MemoryStream : public InputStream {
   int64_t Read(void* buffer, int64_t sz) override;
   int64_t Seek(int64_t offset, int origin) override;
   IoError Duplicate(InputStream** outStream) override;
+  int64_t ReadAt(int64_t offset, void* buffer, int64_t sz) override;
+  bool WillNeed(int64_t offset, int64_t sz) override;
+
+  // Memory backing this stream, starting at position 0
+  void* GetMemory() const { return Memory; }
+  // False if this stream is a view into memory owned by someone else
+  bool OwnsMemory() const { return FreeOnClose; }
 
  protected:
   MemoryStream() {}
@@ -26,7 +26,7 @@ IoError MpkArchive::Open(FileMeta* file, InputStream** outStream) {
   IoError err;
   if (entry->Compressed) {
     err = ZlibStream::Create(BaseStream, entry->Offset, entry->CompressedSize,
-                             entry->Size, outStream);
+                             entry->Size, outStream, &SeekIndices);
 
   } else {
     err = UncompressedStream::Create(BaseStream, entry->Offset, entry->Size,
@@ -42,6 +42,21 @@ IoError MpkArchive::Open(FileMeta* file, InputStream** outStream) {
   return err;
 }
 
+IoError MpkArchive::View(FileMeta* file, void const** outBuffer,
+                         int64_t* outSize) {
+  MpkMetaEntry* entry = (MpkMetaEntry*)file;
+  if (entry->Compressed) return IoError_Fail;
+  return ViewBaseStream(entry->Offset, entry->Size, outBuffer, outSize);
+}
+
+IoError MpkArchive::GetStorage(FileMeta* file, int64_t* outOffset,
+                               int64_t* outSize) {
+  MpkMetaEntry* entry = (MpkMetaEntry*)file;
+  *outOffset = entry->Offset;
+  *outSize = entry->CompressedSize;
+  return IoError_OK;
+}
+
 IoError MpkArchive::Create(InputStream* stream, VfsArchive** outArchive) {
   ImpLog(LL_Trace, LC_IO, "Trying to mount \"%s\" as MPK\n",
          stream->Meta.FileName.c_str());
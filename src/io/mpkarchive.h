@@ -1,6 +1,7 @@
 #pragma once
 
 #include "vfsarchive.h"
+#include "zlibstream.h"
 
 namespace Impacto {
 namespace Io {
@@ -11,11 +12,17 @@ class MpkArchive : public VfsArchive {
  public:
   ~MpkArchive();
   IoError Open(FileMeta *file, InputStream **outStream) override;
+  IoError View(FileMeta *file, void const **outBuffer,
+               int64_t *outSize) override;
+  IoError GetStorage(FileMeta *file, int64_t *outOffset,
+                     int64_t *outSize) override;
 
   static IoError Create(InputStream *stream, VfsArchive **outArchive);
 
  private:
   MpkMetaEntry *TOC = 0;
+  // Kept until the archive is unmounted and its last stream closed
+  ZlibSeekIndexCache SeekIndices;
 };
 
 }  // namespace Io
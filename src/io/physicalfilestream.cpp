@@ -1,11 +1,31 @@
 #include "physicalfilestream.h"
 
+#include "../impacto.h"
 #include <algorithm>
 
+#if IMPACTO_HAVE_PREAD
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+#endif
+
 namespace Impacto {
 namespace Io {
 
-PhysicalFileStream::~PhysicalFileStream() { SDL_RWclose(RW); }
+PhysicalFileStream::~PhysicalFileStream() {
+  SDL_RWclose(RW);
+#if IMPACTO_HAVE_PREAD && defined(_WIN32)
+  if (HasReadAt) CloseHandle(NativeHandle);
+#elif IMPACTO_HAVE_PREAD
+  if (HasReadAt) close(NativeFd);
+#endif
+}
 
 IoError PhysicalFileStream::Create(std::string const& fileName,
                                    InputStream** out) {
@@ -18,6 +38,8 @@ IoError PhysicalFileStream::Create(std::string const& fileName,
   result->Meta.Size = size;
   result->SourceFileName = fileName;
   result->Meta.FileName = fileName;
+  result->IsFile = true;
+  result->OpenNative();
   *out = (InputStream*)result;
   return IoError_OK;
 }
@@ -73,9 +95,81 @@ IoError PhysicalFileStream::Duplicate(InputStream** outStream) {
   }
   PhysicalFileStream* result = new PhysicalFileStream(*this);
   result->RW = rw;
+  result->HasReadAt = false;
+  result->OpenNative();
   *outStream = (InputStream*)result;
   return IoError_OK;
 }
 
+#if IMPACTO_HAVE_PREAD && defined(_WIN32)
+
+void PhysicalFileStream::OpenNative() {
+  HANDLE file =
+      CreateFileA(SourceFileName.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL,
+                  OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+  if (file == INVALID_HANDLE_VALUE) return;
+  NativeHandle = file;
+  HasReadAt = true;
+}
+
+#elif IMPACTO_HAVE_PREAD
+
+void PhysicalFileStream::OpenNative() {
+  NativeFd = open(SourceFileName.c_str(), O_RDONLY);
+  HasReadAt = NativeFd >= 0;
+}
+
+#else
+
+void PhysicalFileStream::OpenNative() {}
+
+#endif
+
+int64_t PhysicalFileStream::ReadAt(int64_t offset, void* buffer, int64_t sz) {
+  if (!HasReadAt) return InputStream::ReadAt(offset, buffer, sz);
+
+#if IMPACTO_HAVE_PREAD
+  if (sz < 0 || offset < 0 || offset > Meta.Size) return IoError_Fail;
+  if (offset == Meta.Size) return IoError_Eof;
+  sz = std::min(Meta.Size - offset, sz);
+
+  int64_t total = 0;
+  while (total < sz) {
+    int64_t at = offset + total;
+#ifdef _WIN32
+    OVERLAPPED overlapped = {0};
+    overlapped.Offset = (DWORD)at;
+    overlapped.OffsetHigh = (DWORD)(at >> 32);
+    DWORD chunk = (DWORD)std::min(sz - total, (int64_t)1 << 30);
+    DWORD read;
+    if (!ReadFile(NativeHandle, (uint8_t*)buffer + total, chunk, &read,
+                  &overlapped)) {
+      return IoError_Fail;
+    }
+#else
+    ssize_t read = pread(NativeFd, (uint8_t*)buffer + total, sz - total, at);
+    if (read < 0) {
+      if (errno == EINTR) continue;
+      return IoError_Fail;
+    }
+#endif
+    if (read == 0) break;
+    total += read;
+  }
+  return total;
+#else
+  return IoError_Fail;
+#endif
+}
+
+bool PhysicalFileStream::WillNeed(int64_t offset, int64_t sz) {
+#if IMPACTO_HAVE_PREAD && !defined(_WIN32) && defined(POSIX_FADV_WILLNEED)
+  return HasReadAt &&
+         posix_fadvise(NativeFd, offset, sz, POSIX_FADV_WILLNEED) == 0;
+#else
+  return false;
+#endif
+}
+
 }  // namespace Io
 }  // namespace Impacto
\ No newline at end of file
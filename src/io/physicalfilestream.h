@@ -20,6 +20,9 @@ class PhysicalFileStream : public InputStream,
   int64_t Read(void* buffer, int64_t sz) override;
   int64_t Seek(int64_t offset, int origin) override;
   IoError Duplicate(InputStream** outStream) override;
+  int64_t ReadAt(int64_t offset, void* buffer, int64_t sz) override;
+  // posix_fadvise(POSIX_FADV_WILLNEED) where available
+  bool WillNeed(int64_t offset, int64_t sz) override;
 
  protected:
   static int const PhysicalBufferSize = 16 * 1024;
@@ -28,9 +31,18 @@ class PhysicalFileStream : public InputStream,
   PhysicalFileStream(PhysicalFileStream const& other) = default;
 
   IoError FillBuffer();
+  // ReadAt() goes through its own native file handle (pread()/overlapped
+  // ReadFile()), independent of RW's cursor. Sets HasReadAt if it could be
+  // opened.
+  void OpenNative();
 
   SDL_RWops* RW;
   std::string SourceFileName;
+#ifdef _WIN32
+  void* NativeHandle = 0;
+#else
+  int NativeFd = -1;
+#endif
 };
 
 }  // namespace Io
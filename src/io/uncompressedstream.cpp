@@ -1,65 +1,104 @@
 #include "uncompressedstream.h"
+#include "memorystream.h"
 
 #include <algorithm>
 
 namespace Impacto {
 namespace Io {
 
-UncompressedStream::~UncompressedStream() { delete BaseStream; }
+UncompressedStream::~UncompressedStream() {
+  if (OwnsBaseStream) delete BaseStream;
+}
 
 IoError UncompressedStream::Create(InputStream* baseStream,
                                    int64_t baseStreamOffset, int64_t size,
                                    InputStream** out) {
   if (baseStreamOffset + size > baseStream->Meta.Size) return IoError_Fail;
-  InputStream* dup;
-  int64_t err = baseStream->Duplicate(&dup);
-  if (err != IoError_OK) return (IoError)err;
-  err = dup->Seek(baseStreamOffset, RW_SEEK_SET);
-  if (err < 0) {
-    delete dup;
-    return (IoError)err;
+  if (baseStream->IsMemory) {
+    // No need to share a cursor with the base stream if we can just point into
+    // its memory
+    MemoryStream* view = new MemoryStream(
+        (uint8_t*)((MemoryStream*)baseStream)->GetMemory() + baseStreamOffset,
+        size, false);
+    *out = (InputStream*)view;
+    return IoError_OK;
+  }
+  InputStream* base = baseStream;
+  if (!baseStream->HasReadAt) {
+    IoError err = baseStream->Duplicate(&base);
+    if (err != IoError_OK) return err;
   }
   UncompressedStream* result = new UncompressedStream;
-  result->BaseStream = dup;
+  result->BaseStream = base;
+  result->OwnsBaseStream = base != baseStream;
   result->BaseStreamOffset = baseStreamOffset;
   result->Meta.Size = size;
+  result->HasReadAt = baseStream->HasReadAt;
   *out = (InputStream*)result;
   return IoError_OK;
 }
 
+IoError UncompressedStream::FillBuffer() {
+  int64_t read = BaseStream->ReadAt(
+      BaseStreamOffset + Position, Buffer,
+      std::min((int64_t)UncompressedBufferSize, Meta.Size - Position));
+  if (read < 0) return (IoError)read;
+  if (read == 0) return IoError_Eof;
+  BufferFill = read;
+  return IoError_OK;
+}
+
 int64_t UncompressedStream::Read(void* buffer, int64_t sz) {
   if (sz < 0) return IoError_Fail;
-  if (Position == Meta.Size) return IoError_Eof;
-  sz = std::min(Meta.Size - Position, sz);
-  int64_t read = BaseStream->Read(buffer, sz);
-  if (read < 0) return read;
-  Position += read;
-  return read;
+  if (sz >= UncompressedBufferSize && BufferConsumed == BufferFill) {
+    // Large reads go straight to the destination
+    int64_t read = ReadAt(Position, buffer, sz);
+    if (read < 0) return read;
+    Position += read;
+    BufferFill = 0;
+    BufferConsumed = 0;
+    return read;
+  }
+  return ReadBuffered(buffer, sz);
 }
 
 int64_t UncompressedStream::Seek(int64_t offset, int origin) {
-  int64_t newPosInBase = IoError_Fail;
-  if (origin == RW_SEEK_SET && (offset >= 0 && offset <= Meta.Size)) {
-    newPosInBase = BaseStream->Seek(BaseStreamOffset + offset, RW_SEEK_SET);
-  } else if (origin == RW_SEEK_CUR &&
-             (Position + offset >= 0 && Position + offset <= Meta.Size)) {
-    newPosInBase = BaseStream->Seek(offset, RW_SEEK_CUR);
-  } else if (origin == RW_SEEK_END && (offset >= 0 && offset <= Meta.Size)) {
-    int64_t end = BaseStreamOffset + Meta.Size;
-    int64_t ourEndFromBaseEnd = BaseStream->Meta.Size - end;
-    newPosInBase = BaseStream->Seek(ourEndFromBaseEnd + offset, RW_SEEK_END);
+  int64_t absPos;
+  if (origin == RW_SEEK_SET) {
+    absPos = offset;
+  } else if (origin == RW_SEEK_CUR) {
+    absPos = Position + offset;
+  } else if (origin == RW_SEEK_END) {
+    absPos = Meta.Size - offset;
+  } else {
+    return IoError_Fail;
+  }
+  if (absPos < 0 || absPos > Meta.Size) return IoError_Fail;
+
+  // Nothing to move in the base stream, just drop the buffer if we leave it
+  if (SeekBuffered(absPos) < IoError_OK) {
+    BufferFill = 0;
+    BufferConsumed = 0;
+    Position = absPos;
   }
-  if (newPosInBase < 0) return newPosInBase;
-  Position = newPosInBase - BaseStreamOffset;
   return Position;
 }
 
+int64_t UncompressedStream::ReadAt(int64_t offset, void* buffer, int64_t sz) {
+  if (sz < 0 || offset < 0 || offset > Meta.Size) return IoError_Fail;
+  if (offset == Meta.Size) return IoError_Eof;
+  sz = std::min(Meta.Size - offset, sz);
+  return BaseStream->ReadAt(BaseStreamOffset + offset, buffer, sz);
+}
+
 IoError UncompressedStream::Duplicate(InputStream** outStream) {
-  InputStream* baseDup;
-  IoError err = BaseStream->Duplicate(&baseDup);
-  if (err != IoError_OK) return err;
+  InputStream* base = BaseStream;
+  if (OwnsBaseStream) {
+    IoError err = BaseStream->Duplicate(&base);
+    if (err != IoError_OK) return err;
+  }
   UncompressedStream* result = new UncompressedStream(*this);
-  result->BaseStream = baseDup;
+  result->BaseStream = base;
   *outStream = (InputStream*)result;
   return IoError_OK;
 }
@@ -1,25 +1,42 @@
 #pragma once
 
 #include "inputstream.h"
+#include "buffering.h"
 
 namespace Impacto {
 namespace Io {
 
-class UncompressedStream : public InputStream {
+// Reads from its base stream with ReadAt(). If the base stream HasReadAt, it is
+// shared instead of duplicated - so any number of sub-streams (and threads) can
+// read from one archive without sharing a cursor, but they must not outlive
+// the base stream.
+
+class UncompressedStream : public InputStream,
+                           public Buffering<UncompressedStream> {
+  friend class Buffering<UncompressedStream>;
+
  public:
   ~UncompressedStream();
 
+  // For memory-backed base streams, *out is a MemoryStream view into the base
+  // stream's memory instead
   static IoError Create(InputStream* baseStream, int64_t baseStreamOffset,
                         int64_t size, InputStream** out);
   int64_t Read(void* buffer, int64_t sz) override;
   int64_t Seek(int64_t offset, int origin) override;
   IoError Duplicate(InputStream** outStream) override;
+  int64_t ReadAt(int64_t offset, void* buffer, int64_t sz) override;
 
  protected:
-  UncompressedStream() {}
+  static int const UncompressedBufferSize = 16 * 1024;
+
+  UncompressedStream() : Buffering(UncompressedBufferSize) {}
   UncompressedStream(UncompressedStream const& other) = default;
 
+  IoError FillBuffer();
+
   InputStream* BaseStream;
+  bool OwnsBaseStream;
   int64_t BaseStreamOffset;
 };
 
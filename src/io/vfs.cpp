@@ -1,11 +1,14 @@
 #include "vfs.h"
 #include "../impacto.h"
+#include <algorithm>
 #include <vector>
 #include "vfsarchive.h"
 #include "physicalfilestream.h"
+#include "mappedfilestream.h"
 #include "memorystream.h"
 #include "../log.h"
 #include "../profile/vfs.h"
+#include "../workqueue.h"
 
 #include "afsarchive.h"
 #include "cpkarchive.h"
@@ -20,8 +23,132 @@ typedef IoError (*VfsArchiveFactory)(InputStream* stream,
                                      VfsArchive** outArchive);
 
 static std::vector<VfsArchiveFactory> Archivers;
-static ska::flat_hash_map<std::string, std::vector<VfsArchive*>> Mounts;
-static SDL_mutex* Lock;
+
+// Lookups never lock. Instead, every mountpoint has a precomputed index that
+// already resolves every name and ID to the earliest-mounted archive containing
+// it. Mounting/unmounting builds a new index and a new mount table referencing
+// it, publishes that, and only frees the old ones once no lookup can still be
+// using them.
+//
+// Lookups only last as long as it takes to find the archive - it is pinned
+// (Refs) before the lookup ends, and all IO happens after that, so writers
+// never wait for IO. Streams opened from an archive pin it for their whole
+// life (InputStream::Archive). Unmounting drops the mount's reference, and
+// whoever drops the last one deletes the archive.
+
+struct VfsResolvedFile {
+  VfsArchive* Archive;
+  FileMeta* Meta;
+};
+
+struct VfsMountIndex {
+  // In mount order
+  std::vector<VfsArchive*> Archives;
+  ska::flat_hash_map<std::string, VfsResolvedFile> Names;
+  ska::flat_hash_map<uint32_t, VfsResolvedFile> Ids;
+};
+
+typedef ska::flat_hash_map<std::string, VfsMountIndex*> VfsMountTable;
+
+static VfsMountTable* Mounts;
+
+// Serializes mounting/unmounting
+static SDL_mutex* WriteLock;
+
+// Readers register in the counter for the current phase. Writers flip the
+// phase and wait for the previous phase's readers to drain, twice, after which
+// nobody can still hold a pointer to something that was unpublished before.
+static SDL_atomic_t ReadPhase;
+static SDL_atomic_t Readers[2];
+
+// A writer sleeps on ReadersDrained while WriterWaiting is set, the last reader
+// of a phase wakes it up
+static SDL_atomic_t WriterWaiting;
+static SDL_mutex* ReadersDrainedLock;
+static SDL_cond* ReadersDrained;
+
+static VfsMountTable const* ReadBegin(int* outPhase) {
+  int phase = SDL_AtomicGet(&ReadPhase);
+  SDL_AtomicIncRef(&Readers[phase]);
+  *outPhase = phase;
+  return (VfsMountTable const*)SDL_AtomicGetPtr((void**)&Mounts);
+}
+
+static void ReadEnd(int phase) {
+  if (SDL_AtomicDecRef(&Readers[phase]) && SDL_AtomicGet(&WriterWaiting)) {
+    SDL_LockMutex(ReadersDrainedLock);
+    SDL_CondBroadcast(ReadersDrained);
+    SDL_UnlockMutex(ReadersDrainedLock);
+  }
+}
+
+// Call with WriteLock held
+static void WaitForReaders() {
+  SDL_AtomicSet(&WriterWaiting, 1);
+  for (int i = 0; i < 2; i++) {
+    int oldPhase = SDL_AtomicGet(&ReadPhase);
+    SDL_AtomicSet(&ReadPhase, oldPhase ^ 1);
+    SDL_LockMutex(ReadersDrainedLock);
+    while (SDL_AtomicGet(&Readers[oldPhase]) != 0) {
+      SDL_CondWait(ReadersDrained, ReadersDrainedLock);
+    }
+    SDL_UnlockMutex(ReadersDrainedLock);
+  }
+  SDL_AtomicSet(&WriterWaiting, 0);
+}
+
+void PinArchive(VfsArchive* archive) { SDL_AtomicIncRef(&archive->Refs); }
+
+void UnpinArchive(VfsArchive* archive) {
+  if (SDL_AtomicDecRef(&archive->Refs)) delete archive;
+}
+
+static VfsMountIndex* BuildMountIndex(
+    std::vector<VfsArchive*> const& archives) {
+  VfsMountIndex* index = new VfsMountIndex;
+  index->Archives = archives;
+  for (auto archive : archives) {
+    index->Names.reserve(index->Names.size() + archive->NamesToIds.size());
+    index->Ids.reserve(index->Ids.size() + archive->IdsToFiles.size());
+    // Earlier archives take precedence, so emplace() never overwrites
+    for (auto const& idToFile : archive->IdsToFiles) {
+      index->Ids.emplace(idToFile.first,
+                         VfsResolvedFile{archive, idToFile.second});
+    }
+    for (auto const& nameToId : archive->NamesToIds) {
+      auto idToFile = archive->IdsToFiles.find(nameToId.second);
+      if (idToFile == archive->IdsToFiles.end()) continue;
+      index->Names.emplace(nameToId.first,
+                           VfsResolvedFile{archive, idToFile->second});
+    }
+  }
+  return index;
+}
+
+// Call with WriteLock held. Replaces mountpoint's archive list with archives
+// (removing the mountpoint if it's empty) and frees the old index once that's
+// safe.
+static void PublishMountpoint(std::string const& mountpoint,
+                              std::vector<VfsArchive*> const& archives) {
+  VfsMountTable* oldTable = Mounts;
+  VfsMountTable* newTable = new VfsMountTable(*oldTable);
+  VfsMountIndex* oldIndex = 0;
+
+  auto it = newTable->find(mountpoint);
+  if (it != newTable->end()) {
+    oldIndex = it->second;
+    newTable->erase(it);
+  }
+  if (!archives.empty()) {
+    (*newTable)[mountpoint] = BuildMountIndex(archives);
+  }
+
+  SDL_AtomicSetPtr((void**)&Mounts, newTable);
+  WaitForReaders();
+
+  delete oldTable;
+  if (oldIndex) delete oldIndex;
+}
 
 static IoError MountInternal(std::string const& mountpoint,
                              InputStream* stream) {
@@ -33,7 +160,11 @@ static IoError MountInternal(std::string const& mountpoint,
   }
   if (err == IoError_OK) {
     archive->MountPoint = mountpoint;
-    Mounts[mountpoint].push_back(archive);
+    std::vector<VfsArchive*> archives;
+    auto it = Mounts->find(mountpoint);
+    if (it != Mounts->end()) archives = it->second->Archives;
+    archives.push_back(archive);
+    PublishMountpoint(mountpoint, archives);
   } else {
     ImpLog(LL_Error, LC_IO, "No archiver supports file %s\n",
            stream->Meta.FileName.c_str());
@@ -43,16 +174,22 @@ static IoError MountInternal(std::string const& mountpoint,
 
 static VfsArchive* FindArchive(std::string const& mountpoint,
                                std::string const& fileName) {
-  auto it = Mounts.find(mountpoint);
-  if (it == Mounts.end()) return 0;
-  for (auto archive : it->second) {
+  auto it = Mounts->find(mountpoint);
+  if (it == Mounts->end()) return 0;
+  for (auto archive : it->second->Archives) {
     if (archive->BaseStream->Meta.FileName == fileName) return archive;
   }
   return 0;
 }
 
+static void PrefetchInit();
+
 void VfsInit() {
-  Lock = SDL_CreateMutex();
+  WriteLock = SDL_CreateMutex();
+  ReadersDrainedLock = SDL_CreateMutex();
+  ReadersDrained = SDL_CreateCond();
+  PrefetchInit();
+  Mounts = new VfsMountTable;
 
   Archivers.push_back(AfsArchive::Create);
   Archivers.push_back(CpkArchive::Create);
@@ -66,7 +203,7 @@ void VfsInit() {
 IoError VfsMount(std::string const& mountpoint,
                  std::string const& archiveFileName) {
   IoError err;
-  SDL_LockMutex(Lock);
+  SDL_LockMutex(WriteLock);
 
   ImpLog(LL_Debug, LC_IO, "Trying to mount \"%s\" on mountpoint \"%s\"\n",
          archiveFileName.c_str(), mountpoint.c_str());
@@ -78,7 +215,10 @@ IoError VfsMount(std::string const& mountpoint,
   }
 
   InputStream* archiveFile;
-  err = PhysicalFileStream::Create(archiveFileName, &archiveFile);
+  err = MappedFileStream::Create(archiveFileName, &archiveFile);
+  if (err != IoError_OK) {
+    err = PhysicalFileStream::Create(archiveFileName, &archiveFile);
+  }
   if (err != IoError_OK) {
     ImpLog(LL_Debug, LC_IO, "Could not open physical file \"%s\"\n",
            archiveFileName.c_str());
@@ -91,7 +231,7 @@ IoError VfsMount(std::string const& mountpoint,
   }
 
 end:
-  SDL_UnlockMutex(Lock);
+  SDL_UnlockMutex(WriteLock);
   return err;
 }
 
@@ -101,7 +241,7 @@ IoError VfsMountMemory(std::string const& mountpoint,
   IoError err;
   InputStream* archiveFile;
 
-  SDL_LockMutex(Lock);
+  SDL_LockMutex(WriteLock);
 
   ImpLog(
       LL_Debug, LC_IO,
@@ -122,137 +262,187 @@ IoError VfsMountMemory(std::string const& mountpoint,
   }
 
 end:
-  SDL_UnlockMutex(Lock);
+  SDL_UnlockMutex(WriteLock);
+  return err;
+}
+
+IoError VfsMountView(std::string const& mountpoint,
+                     std::string const& archiveFileName, VfsView* view) {
+  IoError err;
+  MemoryStream* archiveFile;
+
+  SDL_LockMutex(WriteLock);
+
+  ImpLog(LL_Debug, LC_IO,
+         "Trying to mount archive view named \"%s\" on mountpoint \"%s\"\n",
+         archiveFileName.c_str(), mountpoint.c_str());
+
+  // The stream takes over the view: a copy is freed with it, otherwise it keeps
+  // the archive it points into pinned
+  archiveFile = new MemoryStream((void*)view->Memory, view->Size,
+                                 view->Archive == 0);
+  archiveFile->Archive = view->Archive;
+  archiveFile->Meta.FileName = archiveFileName;
+  *view = VfsView();
+
+  if (FindArchive(mountpoint, archiveFileName) != 0) {
+    err = IoError_Fail;
+    delete archiveFile;
+    goto end;
+  }
+
+  err = MountInternal(mountpoint, archiveFile);
+  if (err != IoError_OK) {
+    delete archiveFile;
+  }
+
+end:
+  SDL_UnlockMutex(WriteLock);
   return err;
 }
 
 IoError VfsUnmount(std::string const& mountpoint,
                    std::string const& archiveFileName) {
   IoError err;
-  SDL_LockMutex(Lock);
+  VfsArchive* archive = 0;
+  std::vector<VfsArchive*> archives;
+  SDL_LockMutex(WriteLock);
 
   ImpLog(LL_Debug, LC_IO,
          "Trying to unmount archive named \"%s\" on mountpoint \"%s\"\n",
          archiveFileName.c_str(), mountpoint.c_str());
 
   err = IoError_NotFound;
-  auto it = Mounts.find(mountpoint);
-  if (it == Mounts.end()) goto end;
-  for (auto arcIt = it->second.begin(); arcIt != it->second.end(); arcIt++) {
-    if ((*arcIt)->BaseStream->Meta.FileName == archiveFileName) {
-      delete *arcIt;
-      it->second.erase(arcIt);
+  auto it = Mounts->find(mountpoint);
+  if (it == Mounts->end()) goto end;
+  for (auto arc : it->second->Archives) {
+    if (!archive && arc->BaseStream->Meta.FileName == archiveFileName) {
+      archive = arc;
       err = IoError_OK;
-      break;
+    } else {
+      archives.push_back(arc);
     }
   }
   if (err != IoError_OK) {
     ImpLog(LL_Debug, LC_IO, "Unmounting failed (file not mounted?)\n");
+    goto end;
   }
 
+  PublishMountpoint(mountpoint, archives);
+  // No lookup can find the archive anymore now, but calls that already found
+  // it may still be using it
+  UnpinArchive(archive);
+
 end:
-  SDL_UnlockMutex(Lock);
+  SDL_UnlockMutex(WriteLock);
   return err;
 }
 
-static IoError GetOrigMetaInternal(std::string const& mountpoint,
+static IoError GetOrigMetaInternal(VfsMountTable const* mounts,
+                                   std::string const& mountpoint,
                                    std::string const& fileName,
                                    FileMeta** outMeta,
                                    VfsArchive** outArchive) {
-  auto it = Mounts.find(mountpoint);
-  if (it == Mounts.end()) return IoError_NotFound;
-
-  for (auto archive : it->second) {
-    auto nameToId = archive->NamesToIds.find(fileName);
-    if (nameToId != archive->NamesToIds.end()) {
-      *outMeta = archive->IdsToFiles[nameToId->second];
-      *outArchive = archive;
-      return IoError_OK;
-    }
-  }
-  return IoError_NotFound;
+  auto it = mounts->find(mountpoint);
+  if (it == mounts->end()) return IoError_NotFound;
+
+  auto file = it->second->Names.find(fileName);
+  if (file == it->second->Names.end()) return IoError_NotFound;
+  *outMeta = file->second.Meta;
+  *outArchive = file->second.Archive;
+  return IoError_OK;
 }
 
-static IoError GetOrigMetaInternal(std::string const& mountpoint, uint32_t id,
+static IoError GetOrigMetaInternal(VfsMountTable const* mounts,
+                                   std::string const& mountpoint, uint32_t id,
                                    FileMeta** outMeta,
                                    VfsArchive** outArchive) {
-  auto it = Mounts.find(mountpoint);
-  if (it == Mounts.end()) return IoError_NotFound;
-
-  for (auto archive : it->second) {
-    auto idToFile = archive->IdsToFiles.find(id);
-    if (idToFile != archive->IdsToFiles.end()) {
-      *outMeta = idToFile->second;
-      *outArchive = archive;
-      return IoError_OK;
+  auto it = mounts->find(mountpoint);
+  if (it == mounts->end()) return IoError_NotFound;
+
+  auto file = it->second->Ids.find(id);
+  if (file == it->second->Ids.end()) return IoError_NotFound;
+  *outMeta = file->second.Meta;
+  *outArchive = file->second.Archive;
+  return IoError_OK;
+}
+
+// Finds the archive a file is in and pins it, the caller must UnpinArchive()
+// it when done
+template <typename Key>
+static IoError ResolveFile(std::string const& mountpoint, Key const& key,
+                           FileMeta** outMeta, VfsArchive** outArchive) {
+  int phase;
+  VfsMountTable const* mounts = ReadBegin(&phase);
+  IoError err =
+      GetOrigMetaInternal(mounts, mountpoint, key, outMeta, outArchive);
+  if (err == IoError_OK) PinArchive(*outArchive);
+  ReadEnd(phase);
+  return err;
+}
+
+// Archives that LocksInternally only take their lock around BaseStream access
+static void LockArchive(VfsArchive* archive) {
+  if (!archive->LocksInternally) SDL_LockMutex(archive->Lock);
+}
+static void UnlockArchive(VfsArchive* archive) {
+  if (!archive->LocksInternally) SDL_UnlockMutex(archive->Lock);
+}
+
+static IoError GetMetaInternal(std::string const& mountpoint,
+                               VfsArchive* archive, FileMeta* origMeta,
+                               FileMeta* outMeta) {
+  IoError err = IoError_OK;
+
+  *outMeta = *origMeta;
+  outMeta->ArchiveMountPoint = mountpoint;
+  outMeta->ArchiveFileName = archive->BaseStream->Meta.FileName;
+  if (outMeta->Size < 0) {
+    LockArchive(archive);
+    err = archive->GetCurrentSize(origMeta, &outMeta->Size);
+    UnlockArchive(archive);
+    if (err != IoError_OK) {
+      ImpLog(LL_Error, LC_IO, "Getting current size failed!\n");
     }
   }
-  return IoError_NotFound;
+  return err;
 }
 
 IoError VfsGetMeta(std::string const& mountpoint, std::string const& fileName,
                    FileMeta* outMeta) {
-  IoError err;
-  SDL_LockMutex(Lock);
-
   ImpLogSlow(LL_Debug, LC_IO,
              "Trying to get metadata for file \"%s\" on mountpoint \"%s\"\n",
              fileName.c_str(), mountpoint.c_str());
 
   FileMeta* origMeta;
   VfsArchive* archive;
-  err = GetOrigMetaInternal(mountpoint, fileName, &origMeta, &archive);
+  IoError err = ResolveFile(mountpoint, fileName, &origMeta, &archive);
   if (err != IoError_OK) {
     ImpLog(LL_Error, LC_IO, "Could not get metadata\n");
-    goto end;
-  }
-
-  *outMeta = *origMeta;
-  outMeta->ArchiveMountPoint = mountpoint;
-  outMeta->ArchiveFileName = archive->BaseStream->Meta.FileName;
-  if (outMeta->Size < 0) {
-    err = archive->GetCurrentSize(origMeta, &outMeta->Size);
-    if (err != IoError_OK) {
-      ImpLog(LL_Error, LC_IO, "Getting current size failed!\n");
-      goto end;
-    }
+    return err;
   }
 
-end:
-  SDL_UnlockMutex(Lock);
+  err = GetMetaInternal(mountpoint, archive, origMeta, outMeta);
+  UnpinArchive(archive);
   return err;
 }
 
 IoError VfsGetMeta(std::string const& mountpoint, uint32_t id,
                    FileMeta* outMeta) {
-  IoError err;
-  SDL_LockMutex(Lock);
-
   ImpLogSlow(LL_Debug, LC_IO,
              "Trying to get metadata for file %d on mountpoint \"%s\"\n", id,
              mountpoint.c_str());
 
   FileMeta* origMeta;
   VfsArchive* archive;
-  err = GetOrigMetaInternal(mountpoint, id, &origMeta, &archive);
+  IoError err = ResolveFile(mountpoint, id, &origMeta, &archive);
   if (err != IoError_OK) {
     ImpLog(LL_Error, LC_IO, "Could not get metadata\n");
-    goto end;
+    return err;
   }
 
-  *outMeta = *origMeta;
-  outMeta->ArchiveMountPoint = mountpoint;
-  outMeta->ArchiveFileName = archive->BaseStream->Meta.FileName;
-  if (outMeta->Size < 0) {
-    err = archive->GetCurrentSize(origMeta, &outMeta->Size);
-    if (err != IoError_OK) {
-      ImpLog(LL_Error, LC_IO, "Getting current size failed!\n");
-      goto end;
-    }
-  }
-
-end:
-  SDL_UnlockMutex(Lock);
+  err = GetMetaInternal(mountpoint, archive, origMeta, outMeta);
+  UnpinArchive(archive);
   return err;
 }
 
@@ -266,6 +456,7 @@ static IoError OpenInternal(std::string const& mountpoint, VfsArchive* archive,
       origMeta->FileName.c_str(), origMeta->Id, mountpoint.c_str(),
       archive->BaseStream->Meta.FileName.c_str());
 
+  LockArchive(archive);
   err = archive->Open(origMeta, outStream);
   if (err != IoError_OK) {
     ImpLogSlow(LL_Debug, LC_IO, "VfsArchive->Open() failed, trying slurp\n");
@@ -274,9 +465,13 @@ static IoError OpenInternal(std::string const& mountpoint, VfsArchive* archive,
     int64_t size;
     err = archive->Slurp(origMeta, &memory, &size);
     // TODO lazy slurp stream
-    *outStream = new MemoryStream(memory, size, true);
+    if (err == IoError_OK) *outStream = new MemoryStream(memory, size, true);
   }
+  UnlockArchive(archive);
   if (err == IoError_OK) {
+    // The caller's pin is only held for this call
+    (*outStream)->Archive = archive;
+    PinArchive(archive);
     (*outStream)->Meta.ArchiveFileName = archive->BaseStream->Meta.FileName;
     (*outStream)->Meta.ArchiveMountPoint = mountpoint;
     (*outStream)->Meta.FileName = origMeta->FileName;
@@ -292,47 +487,37 @@ static IoError OpenInternal(std::string const& mountpoint, VfsArchive* archive,
 
 IoError VfsOpen(std::string const& mountpoint, std::string const& fileName,
                 InputStream** outStream) {
-  IoError err;
-  SDL_LockMutex(Lock);
-
   ImpLogSlow(LL_Debug, LC_IO,
              "Trying to open file \"%s\" on mountpoint \"%s\"\n",
              fileName.c_str(), mountpoint.c_str());
 
   FileMeta* origMeta;
   VfsArchive* archive;
-  err = GetOrigMetaInternal(mountpoint, fileName, &origMeta, &archive);
+  IoError err = ResolveFile(mountpoint, fileName, &origMeta, &archive);
   if (err != IoError_OK) {
     ImpLog(LL_Error, LC_IO, "Could not get metadata\n");
-    goto end;
+    return err;
   }
 
   err = OpenInternal(mountpoint, archive, origMeta, outStream);
-
-end:
-  SDL_UnlockMutex(Lock);
+  UnpinArchive(archive);
   return err;
 }
 
 IoError VfsOpen(std::string const& mountpoint, uint32_t id,
                 InputStream** outStream) {
-  IoError err;
-  SDL_LockMutex(Lock);
-
   FileMeta* origMeta;
   VfsArchive* archive;
-  err = GetOrigMetaInternal(mountpoint, id, &origMeta, &archive);
-  if (err != IoError_OK) goto end;
+  IoError err = ResolveFile(mountpoint, id, &origMeta, &archive);
+  if (err != IoError_OK) return err;
 
   err = OpenInternal(mountpoint, archive, origMeta, outStream);
-
-end:
-  SDL_UnlockMutex(Lock);
+  UnpinArchive(archive);
   return err;
 }
 
-IoError SlurpInternal(VfsArchive* archive, FileMeta* origMeta, void** outMemory,
-                      int64_t* outSize) {
+static IoError SlurpInternal(VfsArchive* archive, FileMeta* origMeta,
+                             void** outMemory, int64_t* outSize) {
   IoError err;
 
   ImpLogSlow(
@@ -341,12 +526,15 @@ IoError SlurpInternal(VfsArchive* archive, FileMeta* origMeta, void** outMemory,
       origMeta->FileName.c_str(), origMeta->Id, archive->MountPoint.c_str(),
       archive->BaseStream->Meta.FileName.c_str());
 
+  LockArchive(archive);
   err = archive->Slurp(origMeta, outMemory, outSize);
   if (err != IoError_OK) {
     ImpLogSlow(LL_Debug, LC_IO, "VfsArchive->Slurp() failed, trying open\n");
 
     InputStream* stream;
     err = archive->Open(origMeta, &stream);
+    // The stream doesn't depend on the archive's state anymore
+    UnlockArchive(archive);
     if (err != IoError_OK) return err;
     *outMemory = malloc(stream->Meta.Size);
     *outSize = stream->Meta.Size;
@@ -366,56 +554,177 @@ IoError SlurpInternal(VfsArchive* archive, FileMeta* origMeta, void** outMemory,
     } else {
       err = IoError_OK;
     }
+  } else {
+    UnlockArchive(archive);
   }
   return err;
 }
 
 IoError VfsSlurp(std::string const& mountpoint, std::string const& fileName,
                  void** outMemory, int64_t* outSize) {
-  IoError err;
-  SDL_LockMutex(Lock);
-
   FileMeta* origMeta;
   VfsArchive* archive;
-  err = GetOrigMetaInternal(mountpoint, fileName, &origMeta, &archive);
-  if (err != IoError_OK) goto end;
+  IoError err = ResolveFile(mountpoint, fileName, &origMeta, &archive);
+  if (err != IoError_OK) return err;
 
   err = SlurpInternal(archive, origMeta, outMemory, outSize);
-
-end:
-  SDL_UnlockMutex(Lock);
+  UnpinArchive(archive);
   return err;
 }
 
 IoError VfsSlurp(std::string const& mountpoint, uint32_t id, void** outMemory,
                  int64_t* outSize) {
-  IoError err;
-  SDL_LockMutex(Lock);
-
   FileMeta* origMeta;
   VfsArchive* archive;
-  err = GetOrigMetaInternal(mountpoint, id, &origMeta, &archive);
-  if (err != IoError_OK) goto end;
+  IoError err = ResolveFile(mountpoint, id, &origMeta, &archive);
+  if (err != IoError_OK) return err;
 
   err = SlurpInternal(archive, origMeta, outMemory, outSize);
+  UnpinArchive(archive);
+  return err;
+}
 
-end:
-  SDL_UnlockMutex(Lock);
+struct SlurpManyItem {
+  std::string const* Mountpoint;
+  uint32_t Id;
+  void** OutMemory;
+  int64_t* OutSize;
+  IoError Result;
+  WorkQueue::WorkHandle Handle;
+  SDL_sem* Done;
+};
+
+static void SlurpManyWorker(void* data) {
+  SlurpManyItem* item = (SlurpManyItem*)data;
+  item->Result =
+      VfsSlurp(*item->Mountpoint, item->Id, item->OutMemory, item->OutSize);
+  SDL_SemPost(item->Done);
+}
+
+// The caller has already collected the results (and freed the items) by the
+// time this runs on the main thread
+static void SlurpManyCompletion(void* data) {}
+
+IoError VfsSlurpMany(std::string const& mountpoint, uint32_t const* ids,
+                     int count, void** outMemory, int64_t* outSizes) {
+  IoError err = IoError_OK;
+  SDL_sem* done = SDL_CreateSemaphore(0);
+  std::vector<SlurpManyItem> items(count);
+
+  for (int i = 0; i < count; i++) {
+    SlurpManyItem& item = items[i];
+    item.Mountpoint = &mountpoint;
+    item.Id = ids[i];
+    item.OutMemory = &outMemory[i];
+    item.OutSize = &outSizes[i];
+    item.Done = done;
+    item.Handle =
+        WorkQueue::Push(&item, &SlurpManyWorker, &SlurpManyCompletion);
+  }
+  // Whatever no worker has picked up yet is slurped here instead, so this only
+  // ever waits for slurps already running. Those finish on their own, even if
+  // every worker (this one included) is in here.
+  int running = 0;
+  for (auto& item : items) {
+    if (WorkQueue::Cancel(item.Handle)) {
+      item.Result =
+          VfsSlurp(mountpoint, item.Id, item.OutMemory, item.OutSize);
+    } else {
+      running++;
+    }
+  }
+  for (int i = 0; i < running; i++) {
+    SDL_SemWait(done);
+  }
+  SDL_DestroySemaphore(done);
+
+  for (auto const& item : items) {
+    if (item.Result != IoError_OK) err = item.Result;
+  }
+  if (err != IoError_OK) {
+    for (auto const& item : items) {
+      if (item.Result == IoError_OK) free(*item.OutMemory);
+    }
+  }
+  return err;
+}
+
+static IoError SlurpViewInternal(VfsArchive* archive, FileMeta* origMeta,
+                                 VfsView* outView) {
+  // Views point at memory that only goes away with the archive, so no archive
+  // lock
+  IoError err = archive->View(origMeta, &outView->Memory, &outView->Size);
+  if (err == IoError_OK) {
+    ImpLogSlow(
+        LL_Debug, LC_IO,
+        "Viewing \"%s\" (%d) from mountpoint \"%s\" (archive file \"%s\")\n",
+        origMeta->FileName.c_str(), origMeta->Id, archive->MountPoint.c_str(),
+        archive->BaseStream->Meta.FileName.c_str());
+    // The caller's pin is only held for this call
+    PinArchive(archive);
+    outView->Archive = archive;
+    return err;
+  }
+
+  void* memory;
+  err = SlurpInternal(archive, origMeta, &memory, &outView->Size);
+  if (err == IoError_OK) {
+    outView->Memory = memory;
+    outView->Archive = 0;
+  }
+  return err;
+}
+
+IoError VfsSlurpView(std::string const& mountpoint, std::string const& fileName,
+                     VfsView* outView) {
+  FileMeta* origMeta;
+  VfsArchive* archive;
+  IoError err = ResolveFile(mountpoint, fileName, &origMeta, &archive);
+  if (err != IoError_OK) return err;
+
+  err = SlurpViewInternal(archive, origMeta, outView);
+  UnpinArchive(archive);
   return err;
 }
 
+IoError VfsSlurpView(std::string const& mountpoint, uint32_t id,
+                     VfsView* outView) {
+  FileMeta* origMeta;
+  VfsArchive* archive;
+  IoError err = ResolveFile(mountpoint, id, &origMeta, &archive);
+  if (err != IoError_OK) return err;
+
+  err = SlurpViewInternal(archive, origMeta, outView);
+  UnpinArchive(archive);
+  return err;
+}
+
+void VfsReleaseView(VfsView* view) {
+  if (view->Archive) {
+    UnpinArchive(view->Archive);
+  } else {
+    free((void*)view->Memory);
+  }
+  *view = VfsView();
+}
+
 IoError VfsListFiles(std::string const& mountpoint,
                      std::map<uint32_t, std::string>& outListing) {
   IoError err;
-  SDL_LockMutex(Lock);
-
-  auto it = Mounts.find(mountpoint);
-  if (it == Mounts.end()) err = IoError_NotFound;
+  int phase;
+  VfsMountTable const* mounts = ReadBegin(&phase);
 
   outListing.clear();
 
+  auto it = mounts->find(mountpoint);
+  if (it == mounts->end()) {
+    err = IoError_NotFound;
+    goto end;
+  }
+
   // Reverse order so things first in the search path get overwritten last
-  for (auto arcIt = it->second.rbegin(); arcIt != it->second.rend(); arcIt++) {
+  for (auto arcIt = it->second->Archives.rbegin();
+       arcIt != it->second->Archives.rend(); arcIt++) {
     for (auto nameToId : (*arcIt)->NamesToIds) {
       outListing[nameToId.second] = nameToId.first;
     }
@@ -424,9 +733,146 @@ IoError VfsListFiles(std::string const& mountpoint,
   err = IoError_OK;
 
 end:
-  SDL_UnlockMutex(Lock);
+  ReadEnd(phase);
   return err;
 }
 
+// Prefetching: requests are queued and drained by (at most) one worker, which
+// resolves them to ranges of archive files, sorts those by offset, merges
+// ranges close to each other and has the OS read them ahead (or reads them
+// sequentially if the archive file can't take that hint), so the data is in
+// the OS page cache when it's actually loaded.
+
+struct PrefetchRequest {
+  std::string Mountpoint;
+  std::vector<uint32_t> Ids;
+};
+
+struct PrefetchRange {
+  VfsArchive* Archive;
+  int64_t Offset;
+  int64_t Size;
+
+  bool operator<(PrefetchRange const& other) const {
+    if (Archive != other.Archive) return Archive < other.Archive;
+    return Offset < other.Offset;
+  }
+};
+
+// Reading a gap this big is cheaper than seeking over it
+static int64_t const PrefetchMaxGap = 64 * 1024;
+static int64_t const PrefetchChunkSize = 1024 * 1024;
+
+static SDL_mutex* PrefetchLock;
+static std::vector<PrefetchRequest> PendingPrefetches;
+static bool PrefetchScheduled = false;
+
+static void PrefetchInit() { PrefetchLock = SDL_CreateMutex(); }
+
+static void PrefetchRanges(std::vector<PrefetchRequest> const& requests) {
+  // Resolve everything in one lookup, pinning the archives involved, and do
+  // the IO after it ended
+  std::vector<PrefetchRange> ranges;
+  std::vector<VfsArchive*> pinned;
+  int phase;
+  VfsMountTable const* mounts = ReadBegin(&phase);
+  for (auto const& request : requests) {
+    for (uint32_t id : request.Ids) {
+      FileMeta* origMeta;
+      PrefetchRange range;
+      if (GetOrigMetaInternal(mounts, request.Mountpoint, id, &origMeta,
+                              &range.Archive) != IoError_OK) {
+        continue;
+      }
+      if (range.Archive->GetStorage(origMeta, &range.Offset, &range.Size) !=
+              IoError_OK ||
+          range.Size <= 0) {
+        continue;
+      }
+      if (std::find(pinned.begin(), pinned.end(), range.Archive) ==
+          pinned.end()) {
+        PinArchive(range.Archive);
+        pinned.push_back(range.Archive);
+      }
+      ranges.push_back(range);
+    }
+  }
+  ReadEnd(phase);
+
+  std::sort(ranges.begin(), ranges.end());
+
+  // Coalesce in place
+  size_t runCount = 0;
+  for (auto const& range : ranges) {
+    if (runCount > 0) {
+      PrefetchRange& run = ranges[runCount - 1];
+      int64_t runEnd = run.Offset + run.Size;
+      if (run.Archive == range.Archive &&
+          range.Offset <= runEnd + PrefetchMaxGap) {
+        run.Size = std::max(runEnd, range.Offset + range.Size) - run.Offset;
+        continue;
+      }
+    }
+    ranges[runCount++] = range;
+  }
+  ranges.resize(runCount);
+
+  void* scratch = 0;
+  for (auto const& run : ranges) {
+    InputStream* base = run.Archive->BaseStream;
+    // Mapped and physical files can have the OS read ahead for us
+    if (base->WillNeed(run.Offset, run.Size)) continue;
+
+    if (!scratch) scratch = malloc(PrefetchChunkSize);
+    // Emulated ReadAt() moves BaseStream's cursor
+    if (!base->HasReadAt) SDL_LockMutex(run.Archive->Lock);
+    for (int64_t pos = run.Offset; pos < run.Offset + run.Size;
+         pos += PrefetchChunkSize) {
+      int64_t size = std::min(PrefetchChunkSize, run.Offset + run.Size - pos);
+      if (base->ReadAt(pos, scratch, size) < size) break;
+    }
+    if (!base->HasReadAt) SDL_UnlockMutex(run.Archive->Lock);
+  }
+  free(scratch);
+
+  for (VfsArchive* archive : pinned) UnpinArchive(archive);
+}
+
+static void PrefetchWorker(void* unused) {
+  std::vector<PrefetchRequest> requests;
+  for (;;) {
+    SDL_LockMutex(PrefetchLock);
+    requests.swap(PendingPrefetches);
+    PendingPrefetches.clear();
+    if (requests.empty()) PrefetchScheduled = false;
+    SDL_UnlockMutex(PrefetchLock);
+
+    if (requests.empty()) break;
+    PrefetchRanges(requests);
+    requests.clear();
+  }
+}
+
+static void PrefetchCompletion(void* unused) {}
+
+void VfsPrefetch(std::string const& mountpoint, uint32_t const* ids,
+                 int count) {
+  // Without threads, this would just be a synchronous read
+  if (!IMPACTO_HAVE_THREADS || count <= 0) return;
+
+  SDL_LockMutex(PrefetchLock);
+  PendingPrefetches.emplace_back();
+  PendingPrefetches.back().Mountpoint = mountpoint;
+  PendingPrefetches.back().Ids.assign(ids, ids + count);
+  bool schedule = !PrefetchScheduled;
+  PrefetchScheduled = true;
+  SDL_UnlockMutex(PrefetchLock);
+
+  if (schedule) {
+    WorkQueue::Push(0, &PrefetchWorker, &PrefetchCompletion,
+                    WorkQueue::WP_Default);
+  }
+}
+
 }  // namespace Io
 }  // namespace Impacto
\ No newline at end of file
@@ -26,8 +26,22 @@ namespace Io {
 // static overrides, the model CPKs get mounted later. For other things, we
 // might want to mount a patch archive when a user changes a setting in-game.
 
-// The public interface of vfs.h is threadsafe. Individual InputStreams are not.
-// Duplicate() them if you need to use them on multiple threads.
+// The public interface of vfs.h is threadsafe. Lookups don't lock at all,
+// opening/slurping only locks the archive the file is in. Individual
+// InputStreams are not threadsafe.
+// Duplicate() them if you need to use them on multiple threads. Streams opened
+// from the same archive don't share a cursor (they use ReadAt() on the archive
+// file), so they can be used on different threads without any locking.
+// Streams keep their archive alive, they may be closed after it is unmounted.
+
+// A file's contents, see VfsSlurpView(). Memory must not be written to.
+struct VfsView {
+  void const* Memory = 0;
+  int64_t Size = 0;
+  // The archive Memory points into, pinned until VfsReleaseView(). Null if
+  // Memory is a copy, which VfsReleaseView() frees.
+  VfsArchive* Archive = 0;
+};
 
 void VfsInit();
 // Mount an archive from a physical file.
@@ -40,6 +54,11 @@ IoError VfsMount(std::string const& mountpoint,
 IoError VfsMountMemory(std::string const& mountpoint,
                        std::string const& archiveFileName, void* memory,
                        int64_t size, bool freeOnClose);
+// Like VfsMountMemory, for an archive that is a view of a file in another
+// archive. The mounted archive takes over *view (which is cleared), releasing
+// it when it is unmounted or if mounting fails.
+IoError VfsMountView(std::string const& mountpoint,
+                     std::string const& archiveFileName, VfsView* view);
 // archiveFileName must match the filename an archive was mounted with
 IoError VfsUnmount(std::string const& mountpoint,
                    std::string const& archiveFileName);
@@ -55,6 +74,28 @@ IoError VfsSlurp(std::string const& mountpoint, std::string const& fileName,
                  void** outMemory, int64_t* outSize);
 IoError VfsSlurp(std::string const& mountpoint, uint32_t id, void** outMemory,
                  int64_t* outSize);
+// Slurps count files from one mountpoint on the worker pool, so e.g. their
+// decompression runs in parallel, and waits for all of them. Files no worker
+// got to in time are slurped on the calling thread, so this is safe from
+// workers too. Either every file is returned (caller must free() each
+// outMemory[i]) or, if any fails, none are.
+IoError VfsSlurpMany(std::string const& mountpoint, uint32_t const* ids,
+                     int count, void** outMemory, int64_t* outSizes);
+// Like VfsSlurp, but files stored as-is in memory-backed archives (mapped from
+// disk or mounted from memory) are not copied: the view then points into the
+// archive, which stays alive (even if unmounted) until the view is released.
+// Otherwise this is a regular slurp into a copy.
+IoError VfsSlurpView(std::string const& mountpoint, std::string const& fileName,
+                     VfsView* outView);
+IoError VfsSlurpView(std::string const& mountpoint, uint32_t id,
+                     VfsView* outView);
+// Frees or unpins the view's memory, and clears it. Safe on an empty view.
+void VfsReleaseView(VfsView* view);
+// Hint that these files will be loaded soon. Their data is read ahead in the
+// background (ordered by position in the archive, with neighbouring files
+// merged into one request) to warm the OS cache. Unknown IDs are ignored.
+void VfsPrefetch(std::string const& mountpoint, uint32_t const* ids,
+                 int count);
 // You can provide a filled outListing, we'll clear it
 IoError VfsListFiles(std::string const& mountpoint,
                      std::map<uint32_t, std::string>& outListing);
@@ -1,16 +1,43 @@
 #include "vfsarchive.h"
+#include "memorystream.h"
 
 namespace Impacto {
 namespace Io {
 
+VfsArchive::VfsArchive() {
+  Lock = SDL_CreateMutex();
+  SDL_AtomicSet(&Refs, 1);
+}
+
 VfsArchive::~VfsArchive() {
   if (IsInit && BaseStream) delete BaseStream;
+  SDL_DestroyMutex(Lock);
 }
 
 IoError VfsArchive::Slurp(FileMeta* file, void** outBuffer, int64_t* outSize) {
   return IoError_Fail;
 }
 
+IoError VfsArchive::View(FileMeta* file, void const** outBuffer,
+                         int64_t* outSize) {
+  return IoError_Fail;
+}
+
+IoError VfsArchive::ViewBaseStream(int64_t offset, int64_t size,
+                                   void const** outBuffer, int64_t* outSize) {
+  if (!BaseStream->IsMemory) return IoError_Fail;
+  if (offset < 0 || size < 0 || offset + size > BaseStream->Meta.Size)
+    return IoError_Fail;
+  *outBuffer = (uint8_t*)((MemoryStream*)BaseStream)->GetMemory() + offset;
+  *outSize = size;
+  return IoError_OK;
+}
+
+IoError VfsArchive::GetStorage(FileMeta* file, int64_t* outOffset,
+                               int64_t* outSize) {
+  return IoError_Fail;
+}
+
 IoError VfsArchive::GetCurrentSize(FileMeta* file, int64_t* outSize) {
   *outSize = file->Size;
   return IoError_OK;
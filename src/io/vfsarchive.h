@@ -2,12 +2,15 @@
 
 #include "inputstream.h"
 #include <flat_hash_map.hpp>
+#include <SDL_mutex.h>
+#include <SDL_atomic.h>
 
 namespace Impacto {
 namespace Io {
 
 class VfsArchive {
  public:
+  VfsArchive();
   virtual ~VfsArchive();
 
   // Meta.ArchiveFileName, Meta.ArchiveMountPoint, Meta.FileName are set by VFS,
@@ -16,18 +19,45 @@ class VfsArchive {
   virtual IoError Open(FileMeta* file, InputStream** outStream) = 0;
 
   virtual IoError Slurp(FileMeta* file, void** outBuffer, int64_t* outSize);
+  // Point *outBuffer directly at the file's contents inside BaseStream, if it
+  // is memory-backed and the file is stored as-is. Fails otherwise.
+  virtual IoError View(FileMeta* file, void const** outBuffer,
+                       int64_t* outSize);
   // If the size of a file is uncertain when the archive is first opened (e.g.
   // directory-listing archives), the file's size in IdsToFiles must be negative
   // and this must be overridden
   virtual IoError GetCurrentSize(FileMeta* file, int64_t* outSize);
+  // Where the file's (possibly compressed) data lives in BaseStream, for IO
+  // scheduling. Fails if it isn't one contiguous range.
+  virtual IoError GetStorage(FileMeta* file, int64_t* outOffset,
+                             int64_t* outSize);
 
   ska::flat_hash_map<std::string, uint32_t> NamesToIds;
   ska::flat_hash_map<uint32_t, FileMeta*> IdsToFiles;
 
   std::string MountPoint;
 
+  // One for being mounted, plus one for every VFS call using the archive
+  // outside of a lookup and every stream opened from it - the last one to drop
+  // theirs deletes it
+  SDL_atomic_t Refs;
+
   bool IsInit = false;
   InputStream* BaseStream = 0;
+
+  // Held by the VFS around Open(), Slurp() and GetCurrentSize(), which may
+  // move BaseStream's position, unless LocksInternally. View() is called
+  // without it.
+  SDL_mutex* Lock;
+  // Set by archives that take Lock themselves, only around their BaseStream
+  // access, so long work that doesn't need it (e.g. decompression) can run on
+  // several threads at once
+  bool LocksInternally = false;
+
+ protected:
+  // For View() implementations
+  IoError ViewBaseStream(int64_t offset, int64_t size, void const** outBuffer,
+                         int64_t* outSize);
 };
 
 }  // namespace Io
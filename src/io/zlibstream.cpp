@@ -1,31 +1,115 @@
 #include "zlibstream.h"
 
+#include <SDL_atomic.h>
+#include <vector>
+
 namespace Impacto {
 namespace Io {
 
+struct ZlibCheckpoint {
+  // Uncompressed position
+  int64_t Out;
+  // Compressed position relative to CompressedOffset. If Bits is nonzero, the
+  // block starts in the low Bits bits of the byte before this.
+  int64_t In;
+  int Bits;
+  uInt WindowSize;
+  uint8_t Window[32768];
+};
+
+struct ZlibSeekIndex {
+  int64_t CompressedOffset;
+  int64_t CompressedSize;
+  // One for every stream using it, plus one while it is in a cache
+  SDL_atomic_t RefCount;
+  SDL_SpinLock Lock;
+  // Sorted by Out, never modified once added
+  std::vector<ZlibCheckpoint*> Checkpoints;
+};
+
+static ZlibSeekIndex* NewSeekIndex(int64_t compressedOffset,
+                                   int64_t compressedSize) {
+  ZlibSeekIndex* index = new ZlibSeekIndex;
+  index->CompressedOffset = compressedOffset;
+  index->CompressedSize = compressedSize;
+  SDL_AtomicSet(&index->RefCount, 1);
+  index->Lock = 0;
+  return index;
+}
+
+static void RetainSeekIndex(ZlibSeekIndex* index) {
+  SDL_AtomicIncRef(&index->RefCount);
+}
+
+static void ReleaseSeekIndex(ZlibSeekIndex* index) {
+  if (!SDL_AtomicDecRef(&index->RefCount)) return;
+  for (auto checkpoint : index->Checkpoints) delete checkpoint;
+  delete index;
+}
+
+ZlibSeekIndexCache::~ZlibSeekIndexCache() {
+  for (auto index : Entries) ReleaseSeekIndex(index);
+}
+
+ZlibSeekIndex* ZlibSeekIndexCache::Acquire(int64_t compressedOffset,
+                                           int64_t compressedSize) {
+  ZlibSeekIndex* index = 0;
+  ZlibSeekIndex* evicted = 0;
+
+  SDL_AtomicLock(&Lock);
+  for (auto it = Entries.begin(); it != Entries.end(); ++it) {
+    if ((*it)->CompressedOffset == compressedOffset &&
+        (*it)->CompressedSize == compressedSize) {
+      index = *it;
+      Entries.erase(it);
+      break;
+    }
+  }
+  if (!index) {
+    index = NewSeekIndex(compressedOffset, compressedSize);
+    if (Entries.size() >= MaxEntries) {
+      evicted = Entries.front();
+      Entries.erase(Entries.begin());
+    }
+  }
+  Entries.push_back(index);
+  RetainSeekIndex(index);
+  SDL_AtomicUnlock(&Lock);
+
+  // Streams still using it keep it alive
+  if (evicted) ReleaseSeekIndex(evicted);
+  return index;
+}
+
 ZlibStream::~ZlibStream() {
   free(InputBuffer);
   inflateEnd(&ZlibState);
+  ReleaseSeekIndex(SeekIndex);
+  if (OwnsBaseStream) delete BaseStream;
 }
 
 IoError ZlibStream::Create(InputStream* baseStream, int64_t compressedOffset,
                            int64_t compressedSize, int64_t uncompressedSize,
-                           InputStream** out) {
+                           InputStream** out,
+                           ZlibSeekIndexCache* seekIndexCache) {
   if (compressedOffset + compressedSize > baseStream->Meta.Size)
     return IoError_Fail;
-  InputStream* dup;
-  int64_t err = baseStream->Duplicate(&dup);
-  if (err != IoError_OK) return (IoError)err;
-  err = dup->Seek(compressedOffset, RW_SEEK_SET);
-  if (err != compressedOffset) {
-    delete dup;
-    return IoError_Fail;
+  InputStream* base = baseStream;
+  if (!baseStream->HasReadAt) {
+    IoError err = baseStream->Duplicate(&base);
+    if (err != IoError_OK) return err;
   }
   ZlibStream* result = new ZlibStream;
-  result->BaseStream = dup;
+  result->BaseStream = base;
+  result->OwnsBaseStream = base != baseStream;
   result->CompressedOffset = compressedOffset;
   result->CompressedSize = compressedSize;
   result->Meta.Size = uncompressedSize;
+  result->IsSeekSlow = true;
+  result->SeekIndex =
+      seekIndexCache
+          ? seekIndexCache->Acquire(compressedOffset, compressedSize)
+          : NewSeekIndex(compressedOffset, compressedSize);
   memset(&result->ZlibState, 0, sizeof(z_stream));
   result->InputBuffer = (uint8_t*)malloc(ZlibStreamInputBufferSize);
   if (!result->Init()) {
@@ -36,8 +120,18 @@ IoError ZlibStream::Create(InputStream* baseStream, int64_t compressedOffset,
   return IoError_OK;
 }
 
+int64_t ZlibStream::ReadInput(void* buffer, int64_t sz) {
+  sz = std::min(sz, CompressedSize - InputPosition);
+  if (sz == 0) return 0;
+  int64_t read =
+      BaseStream->ReadAt(CompressedOffset + InputPosition, buffer, sz);
+  if (read > 0) InputPosition += read;
+  return read;
+}
+
 bool ZlibStream::Init() {
-  int64_t read = BaseStream->Read(InputBuffer, ZlibStreamInputBufferSize);
+  InputPosition = 0;
+  int64_t read = ReadInput(InputBuffer, ZlibStreamInputBufferSize);
   if (read < 0) return false;
   ZlibState.avail_in = read;
   ZlibState.next_in = InputBuffer;
@@ -46,6 +140,72 @@ bool ZlibStream::Init() {
   return zErr == Z_OK;
 }
 
+bool ZlibStream::Restart(ZlibCheckpoint const* checkpoint) {
+  inflateEnd(&ZlibState);
+  memset(&ZlibState, 0, sizeof(z_stream));
+  BufferFill = 0;
+  BufferConsumed = 0;
+
+  if (!checkpoint) {
+    Position = 0;
+    return Init();
+  }
+
+  // Checkpoints are at deflate block boundaries, so we continue with a raw
+  // inflate primed with the leftover bits and the window from there
+  InputPosition = checkpoint->In - (checkpoint->Bits ? 1 : 0);
+  if (inflateInit2(&ZlibState, -MAX_WBITS) != Z_OK) return false;
+  if (checkpoint->Bits) {
+    uint8_t byte;
+    if (ReadInput(&byte, 1) != 1) return false;
+    inflatePrime(&ZlibState, checkpoint->Bits,
+                 byte >> (8 - checkpoint->Bits));
+  }
+  inflateSetDictionary(&ZlibState, checkpoint->Window,
+                       checkpoint->WindowSize);
+  Position = checkpoint->Out;
+  return true;
+}
+
+void ZlibStream::RecordCheckpoint(int64_t outPos) {
+  SDL_AtomicLock(&SeekIndex->Lock);
+  int64_t last = SeekIndex->Checkpoints.empty()
+                     ? 0
+                     : SeekIndex->Checkpoints.back()->Out;
+  SDL_AtomicUnlock(&SeekIndex->Lock);
+  if (outPos < last + ZlibCheckpointSpacing) return;
+
+  ZlibCheckpoint* checkpoint = new ZlibCheckpoint;
+  checkpoint->Out = outPos;
+  checkpoint->In = InputPosition - ZlibState.avail_in;
+  checkpoint->Bits = ZlibState.data_type & 7;
+  if (inflateGetDictionary(&ZlibState, checkpoint->Window,
+                           &checkpoint->WindowSize) != Z_OK) {
+    delete checkpoint;
+    return;
+  }
+
+  // Another stream of the same entry may have gotten here first
+  SDL_AtomicLock(&SeekIndex->Lock);
+  bool added = SeekIndex->Checkpoints.empty() ||
+               SeekIndex->Checkpoints.back()->Out + ZlibCheckpointSpacing <=
+                   outPos;
+  if (added) SeekIndex->Checkpoints.push_back(checkpoint);
+  SDL_AtomicUnlock(&SeekIndex->Lock);
+  if (!added) delete checkpoint;
+}
+
+ZlibCheckpoint const* ZlibStream::FindCheckpoint(int64_t pos) {
+  SDL_AtomicLock(&SeekIndex->Lock);
+  auto const& checkpoints = SeekIndex->Checkpoints;
+  auto it = std::upper_bound(
+      checkpoints.begin(), checkpoints.end(), pos,
+      [](int64_t pos, ZlibCheckpoint const* cp) { return pos < cp->Out; });
+  ZlibCheckpoint const* result = it == checkpoints.begin() ? 0 : *(it - 1);
+  SDL_AtomicUnlock(&SeekIndex->Lock);
+  return result;
+}
+
 int64_t ZlibStream::Read(void* buffer, int64_t sz) {
   return ReadBuffered(buffer, sz);
 }
@@ -63,11 +223,11 @@ int64_t ZlibStream::Seek(int64_t offset, int origin) {
 
   int64_t err = SeekBuffered(absPos);
   if (err < IoError_OK) {
-    if (absPos < Position) {
-      Position = 0;
-      inflateReset(&ZlibState);
-      Init();
-      BaseStream->Seek(CompressedOffset, RW_SEEK_SET);
+    ZlibCheckpoint const* checkpoint = FindCheckpoint(absPos);
+    int64_t inflatedTo = Position - BufferConsumed + BufferFill;
+    // Going forward, only restart if that skips some inflating
+    if (absPos < Position || (checkpoint && checkpoint->Out > inflatedTo)) {
+      if (!Restart(checkpoint)) return IoError_Fail;
     }
     err = DiscardSeekBuffered(absPos);
   }
@@ -78,17 +238,15 @@ int64_t ZlibStream::Seek(int64_t offset, int origin) {
 }
 
 IoError ZlibStream::Duplicate(InputStream** outStream) {
-  InputStream* dup;
-  int64_t err = BaseStream->Duplicate(&dup);
-  if (err != IoError_OK) return (IoError)err;
-  err = dup->Seek(CompressedOffset, RW_SEEK_SET);
-  if (err != CompressedOffset) {
-    delete dup;
-    return IoError_Fail;
+  InputStream* base = BaseStream;
+  if (OwnsBaseStream) {
+    IoError err = BaseStream->Duplicate(&base);
+    if (err != IoError_OK) return err;
   }
   ZlibStream* result = new ZlibStream(*this);
   result->InputBuffer = (uint8_t*)malloc(ZlibStreamInputBufferSize);
-  result->BaseStream = dup;
+  result->BaseStream = base;
+  RetainSeekIndex(result->SeekIndex);
   memset(&result->ZlibState, 0, sizeof(z_stream));
   result->Position = 0;
   result->BufferFill = 0;
@@ -97,7 +255,7 @@ IoError ZlibStream::Duplicate(InputStream** outStream) {
     delete result;
     return IoError_Fail;
   }
-  err = result->Seek(Position, RW_SEEK_SET);
+  int64_t err = result->Seek(Position, RW_SEEK_SET);
   if (err != Position) {
     delete result;
     return IoError_Fail;
@@ -111,25 +269,30 @@ IoError ZlibStream::FillBuffer() {
 
   ZlibState.avail_out = BufferSize;
   ZlibState.next_out = Buffer;
-  int64_t lastTotal = ZlibState.total_out;
 
   do {
     if (ZlibState.avail_in == 0) {
-      int64_t read = BaseStream->Read(InputBuffer, ZlibStreamInputBufferSize);
+      int64_t read = ReadInput(InputBuffer, ZlibStreamInputBufferSize);
       if (read < 0) return (IoError)read;
       if (read == 0) return IoError_Eof;
       ZlibState.next_in = InputBuffer;
       ZlibState.avail_in = read;
     }
 
-    zErr = inflate(&ZlibState, Z_SYNC_FLUSH);
+    // Z_BLOCK returns at every deflate block boundary, where we can take
+    // checkpoints (bit 7 of data_type set, bit 6 clear for the last block)
+    zErr = inflate(&ZlibState, Z_BLOCK);
+    if (zErr == Z_OK && (ZlibState.data_type & 128) &&
+        !(ZlibState.data_type & 64)) {
+      RecordCheckpoint(Position + BufferSize - ZlibState.avail_out);
+    }
   } while (zErr == Z_OK && ZlibState.avail_out > 0);
 
   if (zErr != Z_OK && zErr != Z_STREAM_END) {
     return IoError_Fail;
   }
 
-  BufferFill = ZlibState.total_out - lastTotal;
+  BufferFill = BufferSize - ZlibState.avail_out;
   return IoError_OK;
 }
 
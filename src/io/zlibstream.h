@@ -3,21 +3,50 @@
 #include "inputstream.h"
 #include "buffering.h"
 #include <zlib.h>
+#include <SDL_atomic.h>
+#include <vector>
 
 namespace Impacto {
 namespace Io {
 
+struct ZlibCheckpoint;
+struct ZlibSeekIndex;
+
+// Keeps the seek indices of an archive's entries around while the archive is,
+// for up to MaxEntries entries (least recently opened ones are dropped first).
+class ZlibSeekIndexCache {
+ public:
+  ~ZlibSeekIndexCache();
+
+  static size_t const MaxEntries = 16;
+
+ private:
+  friend class ZlibStream;
+
+  ZlibSeekIndex* Acquire(int64_t compressedOffset, int64_t compressedSize);
+
+  SDL_SpinLock Lock = 0;
+  // Most recently opened last
+  std::vector<ZlibSeekIndex*> Entries;
+};
+
+// Seeking backwards (or far ahead) restarts inflation from the closest
+// checkpoint before the target. Checkpoints are taken at deflate block
+// boundaries at most every ZlibCheckpointSpacing bytes while reading, and are
+// shared by all duplicates of a stream. Streams created with a
+// ZlibSeekIndexCache also share them with other streams of the same entry,
+// including ones opened after the others have been closed.
+
 class ZlibStream : public InputStream, public Buffering<ZlibStream> {
   friend class Buffering<ZlibStream>;
 
  public:
   ~ZlibStream();
 
-  bool IsSeekSlow = true;
-
   static IoError Create(InputStream* baseStream, int64_t compressedOffset,
                         int64_t compressedSize, int64_t uncompressedSize,
-                        InputStream** out);
+                        InputStream** out,
+                        ZlibSeekIndexCache* seekIndexCache = 0);
   int64_t Read(void* buffer, int64_t sz) override;
   int64_t Seek(int64_t offset, int origin) override;
   IoError Duplicate(InputStream** outStream) override;
@@ -25,6 +54,7 @@ class ZlibStream : public InputStream, public Buffering<ZlibStream> {
  protected:
   static int64_t const ZlibStreamBufferSize = 128 * 1024;
   static int64_t const ZlibStreamInputBufferSize = 64 * 1024;
+  static int64_t const ZlibCheckpointSpacing = 512 * 1024;
 
   ZlibStream() : Buffering(ZlibStreamBufferSize) {}
   ZlibStream(ZlibStream const& other) = default;
@@ -32,10 +62,21 @@ class ZlibStream : public InputStream, public Buffering<ZlibStream> {
   IoError FillBuffer();
 
   bool Init();
+  // Reads from the compressed data at InputPosition and advances it
+  int64_t ReadInput(void* buffer, int64_t sz);
+  // Resets inflation to the start of the stream if checkpoint is null
+  bool Restart(ZlibCheckpoint const* checkpoint);
+  void RecordCheckpoint(int64_t outPos);
+  ZlibCheckpoint const* FindCheckpoint(int64_t pos);
 
+  // Shared with other streams if it HasReadAt, otherwise our own duplicate
   InputStream* BaseStream;
+  bool OwnsBaseStream;
   int64_t CompressedOffset;
   int64_t CompressedSize;
+  // Relative to CompressedOffset, where the next ReadInput() starts
+  int64_t InputPosition;
+  ZlibSeekIndex* SeekIndex;
 
   uint8_t* InputBuffer;
   z_stream ZlibState;
@@ -6,20 +6,22 @@ namespace Impacto {
 
 enum LoadStatus { LS_Unloaded, LS_Loading, LS_Loaded };
 
-template <typename T>
+template <typename T,
+          WorkQueue::WorkPriority Priority = WorkQueue::WP_Default>
 class Loadable {
  public:
   LoadStatus Status = LS_Unloaded;
 
   bool LoadAsync(uint32_t id) {
     if (Status == LS_Loading) {
-      // cannot currently cancel a load
-      return false;
+      // can only cancel a load that hasn't been started by a worker yet
+      if (!WorkQueue::Cancel(LoadHandle)) return false;
+      Status = LS_Unloaded;
     }
     Unload();
     NextLoadId = id;
     Status = LS_Loading;
-    WorkQueue::Push(this, &LoadWorker, &OnLoaded);
+    LoadHandle = WorkQueue::Push(this, &LoadWorker, &OnLoaded, Priority);
     return true;
   }
 
@@ -30,12 +32,16 @@ class Loadable {
     }
   }
 
+  // Id of the asset that is loaded or being loaded, unless LS_Unloaded
+  uint32_t LoadId() const { return NextLoadId; }
+
  protected:
   void LoadSync(uint32_t id);
   void UnloadSync();
   void MainThreadOnLoad();
 
   uint32_t NextLoadId;
+  WorkQueue::WorkHandle LoadHandle = 0;
 
   static void LoadWorker(void* ptr) {
     T* loadable = (T*)ptr;
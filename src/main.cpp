@@ -14,6 +14,12 @@ using namespace Impacto;
 
 static uint64_t t;
 
+static float const FrameTime = 0.016f;
+// Turbo skip runs extra fixed-step updates until this much of the frame is
+// used up, then renders only the final state
+static float const TurboSkipBudget = 0.014f;
+static int const TurboSkipMaxUpdates = 64;
+
 void GameLoop() {
   // TODO: Better FPS lock
   uint64_t t2;
@@ -21,10 +27,21 @@ void GameLoop() {
   do {
     t2 = SDL_GetPerformanceCounter();
     dt = ((float)(t2 - t) / (float)SDL_GetPerformanceFrequency());
-  } while (dt < 0.016f);
+  } while (dt < FrameTime);
   t = t2;
 
   Game::Update(dt);
+
+  int updates = 1;
+  while (Game::IsSkipping() && !Game::ShouldQuit &&
+         updates < TurboSkipMaxUpdates) {
+    float elapsed = ((float)(SDL_GetPerformanceCounter() - t) /
+                     (float)SDL_GetPerformanceFrequency());
+    if (elapsed >= TurboSkipBudget) break;
+    Game::UpdateExtra(FrameTime);
+    updates++;
+  }
+
   Game::Render();
 }
 
@@ -56,4 +56,45 @@ inline glm::vec4 ScrWorkGetColor(int id) { return RgbIntToFloat(ScrWork[id]); }
 void SetFlag(uint32_t flagId, uint32_t value);
 bool GetFlag(uint32_t flagId);
 
+// Typed view over Count ScrWork words that remembers their values, so state
+// derived from them only needs to be recomputed when any actually changed.
+// Changes are found by comparing against the remembered values, so it works
+// no matter who writes ScrWork (scripts or engine code).
+template <int Count>
+class ScrWorkView {
+ public:
+  // Reads the words at ids, returns true if any differs from the last call
+  // (always on the first call and after Invalidate())
+  bool Update(int const (&ids)[Count]) {
+    bool changed = !Valid;
+    for (int i = 0; i < Count; i++) {
+      int value = ScrWork[ids[i]];
+      if (value != Values[i]) {
+        Values[i] = value;
+        changed = true;
+      }
+    }
+    Valid = true;
+    return changed;
+  }
+  // Call when derived state was reset elsewhere
+  void Invalidate() { Valid = false; }
+
+  // Accessors for the words as of the last Update(), by index into ids
+  int Get(int i) const { return Values[i]; }
+  float GetFloat(int i) const { return ScrRealToFloat(Values[i]); }
+  glm::vec3 GetVec3(int i) const {
+    return glm::vec3(GetFloat(i), GetFloat(i + 1), GetFloat(i + 2));
+  }
+  float GetAngle(int i) const { return DegToRad(NormalizeDeg(GetFloat(i))); }
+  glm::vec3 GetAngleVec3(int i) const {
+    return glm::vec3(GetAngle(i), GetAngle(i + 1), GetAngle(i + 2));
+  }
+  glm::vec4 GetColor(int i) const { return RgbIntToFloat(Values[i]); }
+
+ private:
+  bool Valid = false;
+  int Values[Count];
+};
+
 }  // namespace Impacto
\ No newline at end of file
@@ -309,10 +309,8 @@ void Update(float dt) {
 
   if (BgmChangeQueued &&
       Audio::Channels[Audio::AC_BGM0].State == Audio::ACS_Stopped) {
-    Io::InputStream* stream;
-    Io::VfsOpen("bgm", BgmIds[CurrentBgm], &stream);
-    Audio::Channels[Audio::AC_BGM0].Play(Audio::AudioStream::Create(stream),
-                                         BgmLoop, BgmFadeIn);
+    Audio::Channels[Audio::AC_BGM0].Play("bgm", BgmIds[CurrentBgm], BgmLoop,
+                                         BgmFadeIn);
     BgmChangeQueued = false;
   }
 
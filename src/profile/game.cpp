@@ -16,6 +16,10 @@ float LayFileTexYMultiplier;
 float DesignWidth;
 float DesignHeight;
 
+int AssetCacheSize;
+int PcmCacheSize;
+float PcmCacheMaxClipLength;
+
 void LoadGameFromJson() {
   AssertIs(kObjectType);
 
@@ -32,6 +36,12 @@ void LoadGameFromJson() {
   if (!res) LayFileTexXMultiplier = 1.0f;
   res = TryGetMemberFloat("LayFileTexYMultiplier", LayFileTexYMultiplier);
   if (!res) LayFileTexYMultiplier = 1.0f;
+  res = TryGetMemberInt("AssetCacheSize", AssetCacheSize);
+  if (!res) AssetCacheSize = 256;
+  res = TryGetMemberInt("PcmCacheSize", PcmCacheSize);
+  if (!res) PcmCacheSize = 16;
+  res = TryGetMemberFloat("PcmCacheMaxClipLength", PcmCacheMaxClipLength);
+  if (!res) PcmCacheMaxClipLength = 4.0f;
 }
 
 }  // namespace Profile
@@ -16,6 +16,13 @@ extern float LayFileTexYMultiplier;
 extern float DesignWidth;
 extern float DesignHeight;
 
+// Memory budget for decoded assets kept around after unloading, in MiB
+extern int AssetCacheSize;
+// Memory budget for fully decoded sound effects, in MiB, and the longest clip
+// that gets decoded whole, in seconds
+extern int PcmCacheSize;
+extern float PcmCacheMaxClipLength;
+
 void LoadGameFromJson();
 
 }  // namespace Profile
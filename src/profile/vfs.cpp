@@ -5,9 +5,17 @@
 namespace Impacto {
 namespace Profile {
 namespace Vfs {
+
+std::string IndexCacheDir;
+
 void Configure() {
   EnsurePushMemberOfType("Vfs", kObjectType);
 
+  char const* indexCacheDir;
+  if (TryGetMemberString("IndexCacheDir", indexCacheDir)) {
+    IndexCacheDir = indexCacheDir;
+  }
+
   {
     EnsurePushMemberOfType("Mounts", kObjectType);
 
@@ -1,8 +1,13 @@
 #pragma once
 
+#include <string>
+
 namespace Impacto {
 namespace Profile {
 namespace Vfs {
+// Directory for persistent archive indices, empty if disabled
+extern std::string IndexCacheDir;
+
 void Configure();
 }
 }  // namespace Profile
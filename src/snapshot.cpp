@@ -0,0 +1,149 @@
+#include "snapshot.h"
+
+#include "log.h"
+#include "mem.h"
+#include "game.h"
+#include "background2d.h"
+#include "character2d.h"
+#include "3d/scene.h"
+#include "vm/vm.h"
+
+#include "profile/game.h"
+#include "profile/scene3d.h"
+
+namespace Impacto {
+namespace Snapshot {
+
+uint32_t const Magic = 0x53534D49;  // 'IMSS'
+uint32_t const NoAsset = 0xFFFFFFFF;
+
+struct SnapshotState {
+  uint32_t Magic;
+  uint32_t Version;
+  // sizeof(SnapshotState), catches layout changes without a version bump
+  uint32_t StateSize;
+  uint32_t ModelCount;
+
+  int ScrWork[ScrWorkSize];
+  uint8_t FlagWork[FlagWorkSize];
+  Vm::VmState Vm;
+  uint32_t BackgroundIds[MaxBackgrounds2D];
+  uint32_t CharacterIds[MaxCharacters2D];
+  // Followed by uint32_t ModelIds[ModelCount]
+};
+
+static int ModelCount() {
+  if (!(Profile::GameFeatures & GameFeature::Scene3D)) return 0;
+  return Profile::Scene3D::MaxRenderables;
+}
+
+template <typename T>
+static uint32_t CaptureAsset(T const& object) {
+  return object.Status == LS_Unloaded ? NoAsset : object.LoadId();
+}
+
+template <typename T>
+static void RestoreAsset(T& object, uint32_t id) {
+  if (id == NoAsset) {
+    object.Unload();
+  } else if (object.Status == LS_Unloaded || object.LoadId() != id) {
+    object.LoadAsync(id);
+  }
+}
+
+void Capture(std::vector<uint8_t>* out) {
+  int modelCount = ModelCount();
+  out->resize(sizeof(SnapshotState) + modelCount * sizeof(uint32_t));
+  SnapshotState* state = (SnapshotState*)out->data();
+
+  state->Magic = Magic;
+  state->Version = Version;
+  state->StateSize = sizeof(SnapshotState);
+  state->ModelCount = modelCount;
+
+  memcpy(state->ScrWork, ScrWork, sizeof(ScrWork));
+  memcpy(state->FlagWork, FlagWork, sizeof(FlagWork));
+  Vm::CaptureState(&state->Vm);
+
+  for (int i = 0; i < MaxBackgrounds2D; i++) {
+    state->BackgroundIds[i] = CaptureAsset(Backgrounds2D[i]);
+  }
+  for (int i = 0; i < MaxCharacters2D; i++) {
+    state->CharacterIds[i] = CaptureAsset(Characters2D[i]);
+  }
+  uint32_t* modelIds = (uint32_t*)(state + 1);
+  for (int i = 0; i < modelCount; i++) {
+    modelIds[i] = CaptureAsset(Scene3D::Renderables[i]);
+  }
+}
+
+bool Restore(uint8_t const* data, size_t size) {
+  SnapshotState const* state = (SnapshotState const*)data;
+  if (size < sizeof(SnapshotState) || state->Magic != Magic ||
+      state->Version != Version || state->StateSize != sizeof(SnapshotState) ||
+      state->ModelCount != (uint32_t)ModelCount() ||
+      size != sizeof(SnapshotState) + state->ModelCount * sizeof(uint32_t)) {
+    ImpLog(LL_Error, LC_General, "Snapshot is from a different build\n");
+    return false;
+  }
+
+  if (!Vm::RestoreState(state->Vm)) {
+    ImpLog(LL_Error, LC_General, "Snapshot does not match the scripts\n");
+    return false;
+  }
+  memcpy(ScrWork, state->ScrWork, sizeof(ScrWork));
+  memcpy(FlagWork, state->FlagWork, sizeof(FlagWork));
+
+  for (int i = 0; i < MaxBackgrounds2D; i++) {
+    RestoreAsset(Backgrounds2D[i], state->BackgroundIds[i]);
+  }
+  for (int i = 0; i < MaxCharacters2D; i++) {
+    RestoreAsset(Characters2D[i], state->CharacterIds[i]);
+  }
+  uint32_t const* modelIds = (uint32_t const*)(state + 1);
+  for (uint32_t i = 0; i < state->ModelCount; i++) {
+    RestoreAsset(Scene3D::Renderables[i], modelIds[i]);
+  }
+
+  return true;
+}
+
+bool Save(std::string const& fileName) {
+  std::vector<uint8_t> data;
+  Capture(&data);
+
+  SDL_RWops* rw = SDL_RWFromFile(fileName.c_str(), "wb");
+  bool ok = rw && SDL_RWwrite(rw, data.data(), data.size(), 1) == 1;
+  if (rw) SDL_RWclose(rw);
+  if (!ok) {
+    ImpLog(LL_Error, LC_General, "Could not write snapshot \"%s\"\n",
+           fileName.c_str());
+  }
+  return ok;
+}
+
+bool Load(std::string const& fileName) {
+  SDL_RWops* rw = SDL_RWFromFile(fileName.c_str(), "rb");
+  if (!rw) {
+    ImpLog(LL_Error, LC_General, "Could not open snapshot \"%s\"\n",
+           fileName.c_str());
+    return false;
+  }
+  std::vector<uint8_t> data;
+  int64_t size = SDL_RWsize(rw);
+  bool ok = size > 0;
+  if (ok) {
+    data.resize(size);
+    ok = SDL_RWread(rw, data.data(), data.size(), 1) == 1;
+  }
+  SDL_RWclose(rw);
+  if (!ok) {
+    ImpLog(LL_Error, LC_General, "Could not read snapshot \"%s\"\n",
+           fileName.c_str());
+    return false;
+  }
+  return Restore(data.data(), data.size());
+}
+
+}  // namespace Snapshot
+}  // namespace Impacto
\ No newline at end of file
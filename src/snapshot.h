@@ -0,0 +1,28 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "impacto.h"
+
+namespace Impacto {
+namespace Snapshot {
+
+uint32_t const Version = 1;
+
+// Instant save state of the whole runtime: ScrWork, FlagWork, the VM (see
+// Vm::VmState) and the ids of loaded backgrounds, characters and models. It is
+// one contiguous block in native byte order, meant for quicksave/quickload and
+// rewind within the same build - a different version or layout is rejected.
+//
+// Restoring doesn't replay scripts. Assets that differ from the snapshot are
+// loaded asynchronously and show up once they are done.
+
+void Capture(std::vector<uint8_t>* out);
+bool Restore(uint8_t const* data, size_t size);
+
+bool Save(std::string const& fileName);
+bool Load(std::string const& fileName);
+
+}  // namespace Snapshot
+}  // namespace Impacto
\ No newline at end of file
@@ -286,7 +286,7 @@ void DialoguePage::EndRubyBase(int lastBaseCharacter) {
   }
 }
 
-void DialoguePage::AddString(Vm::Sc3VmThread* ctx, Audio::AudioStream* voice) {
+void DialoguePage::AddString(Vm::Sc3VmThread* ctx, int voiceId) {
   if (Mode == DPM_ADV || NVLResetBeforeAdd || PrevMode != Mode) {
     Clear();
   }
@@ -488,22 +488,32 @@ void DialoguePage::AddString(Vm::Sc3VmThread* ctx, Audio::AudioStream* voice) {
     ctx->Ip = oldIp;
   }
 
-  if (voice != 0) {
-    Audio::Channels[Audio::AC_VOICE0].Play(voice, false, 0.0f);
+  TypewriterAwaitsVoice = false;
+  if (voiceId >= 0) {
+    Audio::Channels[Audio::AC_VOICE0].Play("voice", voiceId, false, 0.0f);
+    TypewriterAwaitsVoice = true;
   }
 
   int typewriterCt = Length - typewriterStart;
-  float typewriterDur = 0.0f;
-  if (voice != 0) {
-    typewriterDur = Audio::Channels[Audio::AC_VOICE0].DurationInSeconds();
-  }
-  if (typewriterDur <= 0.0f) {
-    typewriterDur = (float)typewriterCt / 16.0f;
-  }
+  float typewriterDur = (float)typewriterCt / 16.0f;
   Typewriter.Start(typewriterStart, typewriterCt, typewriterDur);
+  if (Game::IsSkipping()) {
+    Typewriter.Progress = 1.0f;
+    Typewriter.State = AS_Stopped;
+  }
 }
 
 void DialoguePage::Update(float dt) {
+  if (TypewriterAwaitsVoice) {
+    Audio::AudioChannel const& voice = Audio::Channels[Audio::AC_VOICE0];
+    float voiceDur = voice.DurationInSeconds();
+    if (voiceDur > 0.0f) {
+      Typewriter.DurationIn = voiceDur;
+      TypewriterAwaitsVoice = false;
+    } else if (voice.State == Audio::ACS_Stopped) {
+      TypewriterAwaitsVoice = false;
+    }
+  }
   Typewriter.Update(dt);
 
   for (int i = 0; i < Length; i++) {
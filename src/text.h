@@ -86,7 +86,8 @@ struct DialoguePage {
   bool AutoForward;
 
   void Clear();
-  void AddString(Vm::Sc3VmThread* ctx, Audio::AudioStream* voice = 0);
+  // Plays voice file voiceId (if not negative) and times the typewriter to it
+  void AddString(Vm::Sc3VmThread* ctx, int voiceId = -1);
   void Update(float dt);
   void Render();
 
@@ -101,6 +102,9 @@ struct DialoguePage {
   float CurrentLineTopMargin;
   int LastLineStart;
 
+  // The voice is still loading, so the typewriter runs at the default speed
+  bool TypewriterAwaitsVoice = false;
+
   DialoguePageMode PrevMode = DPM_ADV;
 };
 
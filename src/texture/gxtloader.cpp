@@ -4,6 +4,7 @@
 #include "../util.h"
 
 #include "s3tc.h"
+#include "../io/memorystream.h"
 
 using namespace Impacto::Io;
 
@@ -157,6 +158,23 @@ void VitaUnswizzle(int* x, int* y, int width, int height) {
 
 /* clang-format on */
 
+// Returns the next size bytes of stream. Memory-backed streams (e.g. files
+// stored as-is in a mapped archive) are read in place, anything else is copied
+// into *outScratch, which the caller must free().
+static uint8_t const* ReadPixels(InputStream* stream, int64_t size,
+                                 uint8_t** outScratch) {
+  if (stream->IsMemory && stream->Position + size <= stream->Meta.Size) {
+    uint8_t const* pixels =
+        (uint8_t*)((MemoryStream*)stream)->GetMemory() + stream->Position;
+    stream->Seek(size, RW_SEEK_CUR);
+    *outScratch = 0;
+    return pixels;
+  }
+  *outScratch = (uint8_t*)malloc(size);
+  stream->Read(*outScratch, size);
+  return *outScratch;
+}
+
 bool GXTLoadSubtexture(InputStream* stream, Texture* outTexture,
                        SubtextureHeader* stx, uint8_t* p4Palettes,
                        uint8_t* p8Palettes, uint32_t p4count) {
@@ -181,9 +199,9 @@ bool GXTLoadSubtexture(InputStream* stream, Texture* outTexture,
       if (channelOrder == Gxm::BGR && stx->PixelOrder == Gxm::Linear) {
         stream->Read(outTexture->Buffer, outTexture->BufferSize);
       } else {
-        uint8_t* inBuffer = (uint8_t*)malloc(outTexture->BufferSize);
-        uint8_t* reader = inBuffer;
-        stream->Read(inBuffer, outTexture->BufferSize);
+        uint8_t* inBuffer;
+        uint8_t const* reader =
+            ReadPixels(stream, outTexture->BufferSize, &inBuffer);
 
         for (int y = 0; y < stx->Height; y++) {
           for (int x = 0; x < stx->Width; x++) {
@@ -216,9 +234,9 @@ bool GXTLoadSubtexture(InputStream* stream, Texture* outTexture,
 
       outTexture->Init(TexFmt_RGBA, stx->Width, stx->Height);
 
-      uint8_t* inBuffer = (uint8_t*)malloc(outTexture->BufferSize);
-      uint8_t* reader = inBuffer;
-      stream->Read(inBuffer, outTexture->BufferSize);
+      uint8_t* inBuffer;
+      uint8_t const* reader =
+          ReadPixels(stream, outTexture->BufferSize, &inBuffer);
 
       for (int y = 0; y < stx->Height; y++) {
         for (int x = 0; x < stx->Width; x++) {
@@ -257,9 +275,9 @@ bool GXTLoadSubtexture(InputStream* stream, Texture* outTexture,
         bytesPerPixel = 4;
       }
 
-      uint8_t* inBuffer = (uint8_t*)malloc(stx->Width * stx->Height);
-      uint8_t* reader = inBuffer;
-      stream->Read(inBuffer, stx->Width * stx->Height);
+      uint8_t* inBuffer;
+      uint8_t const* reader =
+          ReadPixels(stream, stx->Width * stx->Height, &inBuffer);
 
       for (int y = 0; y < stx->Height; y++) {
         for (int x = 0; x < stx->Width; x++) {
@@ -319,9 +337,9 @@ bool GXTLoadSubtexture(InputStream* stream, Texture* outTexture,
       outTexture->Init(TexFmt_U8, stx->Width, stx->Height);
 
       if (stx->PixelOrder == Gxm::Swizzled) {
-        uint8_t* inBuffer = (uint8_t*)malloc(outTexture->BufferSize);
-        uint8_t* reader = inBuffer;
-        stream->Read(inBuffer, outTexture->BufferSize);
+        uint8_t* inBuffer;
+        uint8_t const* reader =
+            ReadPixels(stream, outTexture->BufferSize, &inBuffer);
 
         for (int y = 0; y < stx->Height; y++) {
           for (int x = 0; x < stx->Width; x++) {
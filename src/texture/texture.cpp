@@ -5,6 +5,7 @@
 #include <glad/glad.h>
 
 #include "../log.h"
+#include "../window.h"
 
 #include "plainloader.h"
 
@@ -95,7 +96,10 @@ void Texture::LoadPoliticalCompass() {
   }
 }
 
-uint32_t Texture::Submit() {
+uint32_t Texture::Upload() const {
+  // No texture name, the pixels were still decoded
+  if (Window::NoGL) return 0;
+
   ImpLog(LL_Debug, LC_Render, "Submitting texture\n");
 
   uint32_t result;
@@ -128,8 +132,15 @@ uint32_t Texture::Submit() {
   // framedrop
   glGenerateMipmap(GL_TEXTURE_2D);
 
+  return result;
+}
+
+uint32_t Texture::Submit() {
+  uint32_t result = Upload();
+
   // TODO I meant to do this elsewhere but we gotta do it somewhere
   free(Buffer);
+  Buffer = 0;
 
   return result;
 }
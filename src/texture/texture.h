@@ -12,7 +12,7 @@ struct Texture {
   int Width;
   int Height;
   TexFmt Format;
-  uint8_t* Buffer;
+  uint8_t* Buffer = 0;
   int BufferSize;
 
   void Init(TexFmt fmt, int width, int height);
@@ -22,7 +22,12 @@ struct Texture {
                uint8_t alpha = 0);
   void LoadCheckerboard();
   void LoadPoliticalCompass();
+  // Uploads to a new GL texture and frees Buffer. Both return 0 without a GL
+  // context (Window::NoGL)
   uint32_t Submit();
+  // Uploads to a new GL texture, Buffer is left alone (e.g. when it is shared
+  // through the asset cache)
+  uint32_t Upload() const;
 
   typedef bool (*TextureLoader)(Io::InputStream* stream, Texture* texture);
   static bool AddTextureLoader(TextureLoader c);
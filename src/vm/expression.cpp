@@ -6,6 +6,7 @@
 
 #include <vector>
 #include <memory>
+#include <flat_hash_map.hpp>
 
 namespace Impacto {
 
@@ -76,248 +77,516 @@ class ExpressionNode {
   std::unique_ptr<ExpressionNode> RightExpr;
 
   int Value;
-
-  int Evaluate(Sc3VmThread* thd);
-  void AssignValue(Sc3VmThread* thd);
 };
 
 class ExpressionParser {
  public:
-  ExpressionParser(Sc3VmThread* thd);
+  // Tokenizes the expression at ip, which is advanced past it
+  ExpressionParser(uint8_t*& ip);
   ExpressionNode* ParseSubExpression(int minPrecidence);
 
  private:
   int CurrentToken;
   std::vector<ExprToken> Tokens;
-  void GetTokens(Sc3VmThread* thd);
+  void GetTokens(uint8_t*& ip);
 
   ExpressionNode* ParseTerm();
 };
 
+// Expressions are compiled into postfix code for a small stack machine, so
+// evaluating them again needs neither parsing nor allocation. A compiled
+// expression is a sequence of int32 words, an ExprOp followed by its operand
+// if it has one, terminated by EO_End with the result on top of the stack.
+enum ExprOp : int32_t {
+  EO_End = 0,
+  // operand: value
+  EO_Push,
+
+  // pop right, pop left, push result
+  EO_Multiply,
+  EO_Divide,
+  EO_Add,
+  EO_Subtract,
+  EO_Modulo,
+  EO_LeftShift,
+  EO_RightShift,
+  EO_BitwiseAnd,
+  EO_BitwiseXor,
+  EO_BitwiseOr,
+  EO_Equal,
+  EO_NotEqual,
+  EO_LessThanEqual,
+  EO_MoreThanEqual,
+  EO_LessThan,
+  EO_GreaterThan,
+  EO_DataAccess,
+
+  // pop operand, push result
+  EO_Negation,
+  EO_GlobalVars,
+  EO_Flags,
+  EO_LabelTable,
+  EO_ThreadVars,
+  EO_Random,
+
+  // operand: token type, logs and pushes 0
+  EO_Stub,
+  // operand: assignment token type, pop right (unless increment/decrement),
+  // pop left, push the new value
+  EO_Modify,
+  // operand: lvalue token type, pop index, pop value, store, push 0
+  EO_Store
+};
+
+// Both the depth the compiler allows and the evaluation stack size
+int const ExprMaxStackDepth = 64;
+
+class ExpressionCompiler {
+ public:
+  ExpressionCompiler(std::vector<int32_t>& code) : Code(code) {}
+
+  // Returns false if the expression is too deep to be evaluated
+  bool Compile(ExpressionNode const* root);
+
+ private:
+  std::vector<int32_t>& Code;
+  int Depth = 0;
+  int MaxDepth = 0;
+
+  void Emit(ExprOp op, int pushes, int pops);
+  void EmitOperand(int32_t operand) { Code.push_back(operand); }
+  void CompileNode(ExpressionNode const* node);
+};
+
+struct CompiledExpression {
+  // Index of the first word in ExpressionCache::Code
+  uint32_t CodeOffset;
+  // Size of the source expression in the script, in bytes
+  uint32_t SourceSize;
+};
+
+// Compiled expressions of one script buffer, keyed by their offset in it
+struct ExpressionCache {
+  uint8_t* Buffer = 0;
+  int64_t BufferSize = 0;
+  ska::flat_hash_map<uint32_t, CompiledExpression> Expressions;
+  std::vector<int32_t> Code;
+};
+
+static ExpressionCache Caches[MaxLoadedScripts];
+
+// Used for expressions outside of a known script buffer
+static std::vector<int32_t> UncachedCode;
+
+static void Compile(uint8_t*& ip, std::vector<int32_t>& code) {
+  size_t start = code.size();
+  ExpressionParser parser(ip);
+  std::unique_ptr<ExpressionNode> root(parser.ParseSubExpression(0));
+
+  ExpressionCompiler compiler(code);
+  if (!compiler.Compile(root.get())) {
+    ImpLog(LL_Error, LC_Expr, "Expression too deep, evaluating to 0\n");
+    code.resize(start);
+    code.push_back(EO_Push);
+    code.push_back(0);
+    code.push_back(EO_End);
+  }
+}
+
+static int Execute(Sc3VmThread* thd, int32_t const* code);
+
+void ExpressionCacheReset(uint32_t bufferId, int64_t bufferSize) {
+  ExpressionCache& cache = Caches[bufferId];
+  cache.Buffer = ScriptBuffers[bufferId];
+  cache.BufferSize = bufferSize;
+  cache.Expressions.clear();
+  cache.Code.clear();
+}
+
 int ExpressionEval(Sc3VmThread* thd, int* result) {
-  ExpressionParser* parser = new ExpressionParser(thd);
+  ExpressionCount++;
 
-  ExpressionNode* root = parser->ParseSubExpression(0);
+  ExpressionCache& cache = Caches[thd->ScriptBufferId];
+  uint8_t* buffer = ScriptBuffers[thd->ScriptBufferId];
 
-  std::unique_ptr<ExpressionNode> rootPtr =
-      std::unique_ptr<ExpressionNode>(root);
+  if (!buffer || buffer != cache.Buffer || thd->Ip < buffer ||
+      thd->Ip >= buffer + cache.BufferSize) {
+    UncachedCode.clear();
+    Compile(thd->Ip, UncachedCode);
+    *result = Execute(thd, UncachedCode.data());
+    return 0;
+  }
 
-  *result = rootPtr->Evaluate(thd);
+  uint32_t offset = thd->Ip - buffer;
+  auto it = cache.Expressions.find(offset);
+  if (it == cache.Expressions.end()) {
+    CompiledExpression expr;
+    expr.CodeOffset = cache.Code.size();
+    uint8_t* ip = thd->Ip;
+    Compile(ip, cache.Code);
+    expr.SourceSize = ip - thd->Ip;
+    it = cache.Expressions.emplace(offset, expr).first;
+  }
 
-  delete parser;
+  thd->Ip += it->second.SourceSize;
+  *result = Execute(thd, cache.Code.data() + it->second.CodeOffset);
 
   return 0;
 }
 
-int ExpressionNode::Evaluate(Sc3VmThread* thd) {
-  int leftVal, rightVal;
+bool ExpressionCompiler::Compile(ExpressionNode const* root) {
+  CompileNode(root);
+  Emit(EO_End, 0, 0);
+  return MaxDepth <= ExprMaxStackDepth;
+}
+
+void ExpressionCompiler::Emit(ExprOp op, int pushes, int pops) {
+  Code.push_back(op);
+  Depth += pushes - pops;
+  if (Depth > MaxDepth) MaxDepth = Depth;
+}
+
+void ExpressionCompiler::CompileNode(ExpressionNode const* node) {
+  // Malformed expressions (e.g. a missing operand) evaluate to 0
+  if (!node) {
+    Emit(EO_Push, 1, 0);
+    EmitOperand(0);
+    return;
+  }
+
+  ExprOp binaryOp;
+  ExprOp unaryOp;
+
+  switch (node->ExprType) {
+    case ET_ImmediateValue:
+      Emit(EO_Push, 1, 0);
+      EmitOperand(node->Value);
+      return;
 
-  switch (ExprType) {
     case ET_Multiply:
-      leftVal = LeftExpr->Evaluate(thd);
-      rightVal = RightExpr->Evaluate(thd);
-      return leftVal * rightVal;
+      binaryOp = EO_Multiply;
+      break;
     case ET_Divide:
-      leftVal = LeftExpr->Evaluate(thd);
-      rightVal = RightExpr->Evaluate(thd);
-      if (!rightVal) return 0x7FFFFFFF;
-      return leftVal / rightVal;
+      binaryOp = EO_Divide;
+      break;
     case ET_Add:
-      leftVal = LeftExpr->Evaluate(thd);
-      rightVal = RightExpr->Evaluate(thd);
-      return leftVal + rightVal;
+      binaryOp = EO_Add;
+      break;
     case ET_Subtract:
-      leftVal = LeftExpr->Evaluate(thd);
-      rightVal = RightExpr->Evaluate(thd);
-      return leftVal - rightVal;
+      binaryOp = EO_Subtract;
+      break;
     case ET_Modulo:
-      leftVal = LeftExpr->Evaluate(thd);
-      rightVal = RightExpr->Evaluate(thd);
-      if (!rightVal) return 0x7FFFFFFF;
-      return leftVal % rightVal;
+      binaryOp = EO_Modulo;
+      break;
     case ET_LeftShift:
-      leftVal = LeftExpr->Evaluate(thd);
-      rightVal = RightExpr->Evaluate(thd);
-      return leftVal << rightVal;
+      binaryOp = EO_LeftShift;
+      break;
     case ET_RightShift:
-      leftVal = LeftExpr->Evaluate(thd);
-      rightVal = RightExpr->Evaluate(thd);
-      return leftVal >> rightVal;
+      binaryOp = EO_RightShift;
+      break;
     case ET_BitwiseAnd:
-      leftVal = LeftExpr->Evaluate(thd);
-      rightVal = RightExpr->Evaluate(thd);
-      return leftVal & rightVal;
+      binaryOp = EO_BitwiseAnd;
+      break;
     case ET_BitwiseXor:
-      leftVal = LeftExpr->Evaluate(thd);
-      rightVal = RightExpr->Evaluate(thd);
-      return leftVal ^ rightVal;
+      binaryOp = EO_BitwiseXor;
+      break;
     case ET_BitwiseOr:
-      leftVal = LeftExpr->Evaluate(thd);
-      rightVal = RightExpr->Evaluate(thd);
-      return leftVal | rightVal;
+      binaryOp = EO_BitwiseOr;
+      break;
     case ET_Equal:
-      leftVal = LeftExpr->Evaluate(thd);
-      rightVal = RightExpr->Evaluate(thd);
-      return leftVal == rightVal;
+      binaryOp = EO_Equal;
+      break;
     case ET_NotEqual:
-      leftVal = LeftExpr->Evaluate(thd);
-      rightVal = RightExpr->Evaluate(thd);
-      return leftVal != rightVal;
+      binaryOp = EO_NotEqual;
+      break;
     case ET_LessThanEqual:
-      leftVal = LeftExpr->Evaluate(thd);
-      rightVal = RightExpr->Evaluate(thd);
-      return leftVal <= rightVal;
+      binaryOp = EO_LessThanEqual;
+      break;
     case ET_MoreThanEqual:
-      leftVal = LeftExpr->Evaluate(thd);
-      rightVal = RightExpr->Evaluate(thd);
-      return leftVal >= rightVal;
+      binaryOp = EO_MoreThanEqual;
+      break;
     case ET_LessThan:
-      leftVal = LeftExpr->Evaluate(thd);
-      rightVal = RightExpr->Evaluate(thd);
-      return leftVal < rightVal;
+      binaryOp = EO_LessThan;
+      break;
     case ET_GreaterThan:
-      leftVal = LeftExpr->Evaluate(thd);
-      rightVal = RightExpr->Evaluate(thd);
-      return leftVal > rightVal;
-    case ET_Negation:
-      leftVal = LeftExpr->Evaluate(thd);
-      return ~leftVal;
-    case ET_Assign:
-    case ET_MultiplyAssign:
-    case ET_DivideAssign:
-    case ET_AddAssign:
-    case ET_SubtractAssign:
-    case ET_ModuloAssign:
-    case ET_LeftShiftAssign:
-    case ET_RightShiftAssign:
-    case ET_BitwiseAndAssign:
-    case ET_BitwiseOrAssign:
-    case ET_BitwiseXorAssign:
-    case ET_Increment:
-    case ET_Decrement:
-      AssignValue(thd);
-      return 0;
+      binaryOp = EO_GreaterThan;
       break;
-    case ET_ImmediateValue:
-      return Value;
+    case ET_FuncDataAccess:
+      binaryOp = EO_DataAccess;
+      break;
+
+    case ET_Negation:
+      // Binary negation only looks at its left operand, the prefix form only
+      // has a right one
+      CompileNode(node->LeftExpr ? node->LeftExpr.get()
+                                 : node->RightExpr.get());
+      Emit(EO_Negation, 1, 1);
+      return;
+
     case ET_FuncGlobalVars:
-      return ScrWork[RightExpr->Evaluate(thd)];
+      unaryOp = EO_GlobalVars;
+      goto unary;
     case ET_FuncFlags:
-      return GetFlag(RightExpr->Evaluate(thd));
-    case ET_FuncDataAccess:
-      leftVal = LeftExpr->Evaluate(thd);
-      rightVal = RightExpr->Evaluate(thd);
-      if (leftVal >= 0) {
-        uint8_t* scrBuf = ScriptBuffers[thd->ScriptBufferId];
-        int* dataArray = (int*)&scrBuf[leftVal];
-        return dataArray[rightVal];
-      } else {
-        ImpLogSlow(LL_Warning, LC_Expr, "STUB token %02X evaluate\n", ExprType);
-        // TODO: Handle this
-        return 0;
-      }
+      unaryOp = EO_Flags;
+      goto unary;
     case ET_FuncLabelTable:
-      return ScriptGetLabelAddressNum(ScriptBuffers[thd->ScriptBufferId],
-                                      RightExpr->Evaluate(thd));
-    case ET_FuncFarLabelTable:
-      return 0;
+      unaryOp = EO_LabelTable;
+      goto unary;
     case ET_FuncThreadVars:
-      return *(uint32_t*)(thd->GetMemberPointer(RightExpr->Evaluate(thd)));
-    case ET_FuncDMA:
-    case ET_FuncUnk2F:
-    case ET_FuncUnk30:
-    case ET_FuncNop31:
-    case ET_FuncNop32:
-      ImpLogSlow(LL_Warning, LC_Expr, "STUB token %02X evaluate\n", ExprType);
-      return 0;
+      unaryOp = EO_ThreadVars;
+      goto unary;
     case ET_FuncRandom:
-      // TODO use our own RNG with our own seed
-      return RightExpr->Evaluate(thd) * (rand() & 0x7FFF) >> 15;
-    default:
-      ImpLogSlow(LL_Warning, LC_Expr, "STUB token %02X evaluate\n", ExprType);
-      return 0;
-  }
-}
+      unaryOp = EO_Random;
+      goto unary;
 
-void ExpressionNode::AssignValue(Sc3VmThread* thd) {
-  int leftVal = LeftExpr->Evaluate(thd);
-  int rightVal = 0;
-  if (ExprType != ET_Increment && ExprType != ET_Decrement)
-    rightVal = RightExpr->Evaluate(thd);
+    case ET_FuncFarLabelTable:
+      Emit(EO_Push, 1, 0);
+      EmitOperand(0);
+      return;
 
-  switch (ExprType) {
     case ET_Assign:
-      leftVal = rightVal;
-      break;
     case ET_MultiplyAssign:
-      leftVal *= rightVal;
-      break;
     case ET_DivideAssign:
-      leftVal /= rightVal;
-      break;
     case ET_AddAssign:
-      leftVal += rightVal;
-      break;
     case ET_SubtractAssign:
-      leftVal -= rightVal;
-      break;
     case ET_ModuloAssign:
-      leftVal %= rightVal;
-      break;
     case ET_LeftShiftAssign:
-      leftVal <<= rightVal;
-      break;
     case ET_RightShiftAssign:
-      leftVal >>= rightVal;
-      break;
     case ET_BitwiseAndAssign:
-      leftVal &= rightVal;
-      break;
     case ET_BitwiseOrAssign:
-      leftVal |= rightVal;
-      break;
     case ET_BitwiseXorAssign:
-      leftVal ^= rightVal;
-      break;
     case ET_Increment:
-      leftVal++;
-      break;
-    case ET_Decrement:
-      leftVal--;
-      break;
+    case ET_Decrement: {
+      ExpressionNode const* target = node->LeftExpr.get();
+      CompileNode(target);
+      if (node->ExprType == ET_Increment || node->ExprType == ET_Decrement) {
+        Emit(EO_Modify, 1, 1);
+      } else {
+        CompileNode(node->RightExpr.get());
+        Emit(EO_Modify, 1, 2);
+      }
+      EmitOperand(node->ExprType);
+      // The target index is evaluated again for the store
+      CompileNode(target ? target->RightExpr.get() : 0);
+      Emit(EO_Store, 1, 2);
+      EmitOperand(target ? target->ExprType : ET_EndOfExpression);
+      return;
+    }
+
     default:
-      ImpLogSlow(LL_Error, LC_Expr, "Tried to assign with unknown token %02X\n",
-                 ExprType);
-      break;
+      Emit(EO_Stub, 1, 0);
+      EmitOperand(node->ExprType);
+      return;
   }
 
-  int index = LeftExpr->RightExpr->Evaluate(thd);
+  CompileNode(node->LeftExpr.get());
+  CompileNode(node->RightExpr.get());
+  Emit(binaryOp, 1, 2);
+  return;
 
-  switch (LeftExpr->ExprType) {
-    case ET_FuncGlobalVars:
-      ScrWork[index] = leftVal;
-      break;
-    case ET_FuncFlags:
-      SetFlag(index, leftVal);
-      break;
-    case ET_FuncThreadVars: {
-      uint32_t* thdWork = (uint32_t*)thd->GetMemberPointer(index);
-      *(thdWork) = leftVal;
-      break;
+unary:
+  CompileNode(node->RightExpr.get());
+  Emit(unaryOp, 1, 1);
+}
+
+static int Execute(Sc3VmThread* thd, int32_t const* code) {
+  int stack[ExprMaxStackDepth];
+  int sp = 0;
+  int leftVal, rightVal;
+
+  for (;;) {
+    ExprOp op = (ExprOp)*code++;
+
+    // Binary operators
+    if (op >= EO_Multiply && op <= EO_DataAccess) {
+      rightVal = stack[--sp];
+      leftVal = stack[--sp];
+    }
+
+    switch (op) {
+      case EO_End:
+        return stack[sp - 1];
+      case EO_Push:
+        stack[sp++] = *code++;
+        break;
+
+      case EO_Multiply:
+        stack[sp++] = leftVal * rightVal;
+        break;
+      case EO_Divide:
+        stack[sp++] = rightVal ? leftVal / rightVal : 0x7FFFFFFF;
+        break;
+      case EO_Add:
+        stack[sp++] = leftVal + rightVal;
+        break;
+      case EO_Subtract:
+        stack[sp++] = leftVal - rightVal;
+        break;
+      case EO_Modulo:
+        stack[sp++] = rightVal ? leftVal % rightVal : 0x7FFFFFFF;
+        break;
+      case EO_LeftShift:
+        stack[sp++] = leftVal << rightVal;
+        break;
+      case EO_RightShift:
+        stack[sp++] = leftVal >> rightVal;
+        break;
+      case EO_BitwiseAnd:
+        stack[sp++] = leftVal & rightVal;
+        break;
+      case EO_BitwiseXor:
+        stack[sp++] = leftVal ^ rightVal;
+        break;
+      case EO_BitwiseOr:
+        stack[sp++] = leftVal | rightVal;
+        break;
+      case EO_Equal:
+        stack[sp++] = leftVal == rightVal;
+        break;
+      case EO_NotEqual:
+        stack[sp++] = leftVal != rightVal;
+        break;
+      case EO_LessThanEqual:
+        stack[sp++] = leftVal <= rightVal;
+        break;
+      case EO_MoreThanEqual:
+        stack[sp++] = leftVal >= rightVal;
+        break;
+      case EO_LessThan:
+        stack[sp++] = leftVal < rightVal;
+        break;
+      case EO_GreaterThan:
+        stack[sp++] = leftVal > rightVal;
+        break;
+      case EO_DataAccess:
+        if (leftVal >= 0) {
+          uint8_t* scrBuf = ScriptBuffers[thd->ScriptBufferId];
+          int* dataArray = (int*)&scrBuf[leftVal];
+          stack[sp++] = dataArray[rightVal];
+        } else {
+          ImpLogSlow(LL_Warning, LC_Expr, "STUB token %02X evaluate\n",
+                     ET_FuncDataAccess);
+          // TODO: Handle this
+          stack[sp++] = 0;
+        }
+        break;
+
+      case EO_Negation:
+        stack[sp - 1] = ~stack[sp - 1];
+        break;
+      case EO_GlobalVars:
+        stack[sp - 1] = ScrWork[stack[sp - 1]];
+        break;
+      case EO_Flags:
+        stack[sp - 1] = GetFlag(stack[sp - 1]);
+        break;
+      case EO_LabelTable:
+        stack[sp - 1] =
+            ScriptGetLabelAddressNum(thd->ScriptBufferId, stack[sp - 1]);
+        break;
+      case EO_ThreadVars:
+        stack[sp - 1] = *(uint32_t*)(thd->GetMemberPointer(stack[sp - 1]));
+        break;
+      case EO_Random:
+        // TODO use our own RNG with our own seed
+        stack[sp - 1] = stack[sp - 1] * (rand() & 0x7FFF) >> 15;
+        break;
+
+      case EO_Stub:
+        ImpLogSlow(LL_Warning, LC_Expr, "STUB token %02X evaluate\n", *code);
+        code++;
+        stack[sp++] = 0;
+        break;
+
+      case EO_Modify: {
+        ExprTokenType type = (ExprTokenType)*code++;
+        rightVal = 0;
+        if (type != ET_Increment && type != ET_Decrement) {
+          rightVal = stack[--sp];
+        }
+        leftVal = stack[sp - 1];
+
+        switch (type) {
+          case ET_Assign:
+            leftVal = rightVal;
+            break;
+          case ET_MultiplyAssign:
+            leftVal *= rightVal;
+            break;
+          case ET_DivideAssign:
+            leftVal /= rightVal;
+            break;
+          case ET_AddAssign:
+            leftVal += rightVal;
+            break;
+          case ET_SubtractAssign:
+            leftVal -= rightVal;
+            break;
+          case ET_ModuloAssign:
+            leftVal %= rightVal;
+            break;
+          case ET_LeftShiftAssign:
+            leftVal <<= rightVal;
+            break;
+          case ET_RightShiftAssign:
+            leftVal >>= rightVal;
+            break;
+          case ET_BitwiseAndAssign:
+            leftVal &= rightVal;
+            break;
+          case ET_BitwiseOrAssign:
+            leftVal |= rightVal;
+            break;
+          case ET_BitwiseXorAssign:
+            leftVal ^= rightVal;
+            break;
+          case ET_Increment:
+            leftVal++;
+            break;
+          case ET_Decrement:
+            leftVal--;
+            break;
+          default:
+            ImpLogSlow(LL_Error, LC_Expr,
+                       "Tried to assign with unknown token %02X\n", type);
+            break;
+        }
+
+        stack[sp - 1] = leftVal;
+        break;
+      }
+
+      case EO_Store: {
+        ExprTokenType type = (ExprTokenType)*code++;
+        int index = stack[--sp];
+        leftVal = stack[sp - 1];
+
+        switch (type) {
+          case ET_FuncGlobalVars:
+            ScrWork[index] = leftVal;
+            break;
+          case ET_FuncFlags:
+            SetFlag(index, leftVal);
+            break;
+          case ET_FuncThreadVars: {
+            uint32_t* thdWork = (uint32_t*)thd->GetMemberPointer(index);
+            *(thdWork) = leftVal;
+            break;
+          }
+          default:
+            ImpLogSlow(LL_Warning, LC_Expr, "STUB token %02X assign\n", type);
+            break;
+        }
+
+        stack[sp - 1] = 0;
+        break;
+      }
     }
-    case ET_FuncDMA:
-      ImpLogSlow(LL_Warning, LC_Expr, "STUB token %02X assign\n",
-                 LeftExpr->ExprType);
-      break;
-    default:
-      ImpLogSlow(LL_Warning, LC_Expr, "STUB token %02X assign\n",
-                 LeftExpr->ExprType);
-      break;
   }
 }
 
-ExpressionParser::ExpressionParser(Sc3VmThread* thd) {
-  GetTokens(thd);
+ExpressionParser::ExpressionParser(uint8_t*& ip) {
+  GetTokens(ip);
   CurrentToken = 0;
 }
 
@@ -436,54 +705,81 @@ ExpressionNode* ExpressionParser::ParseTerm() {
   return term;
 }
 
-void ExpressionParser::GetTokens(Sc3VmThread* thd) {
+// Size of an immediate value token, not counting its precedence byte
+static int ImmediateSize(int8_t tokenType) {
+  static int const sizes[] = {1, 2, 3, 5};
+  return sizes[(tokenType & 0x60) >> 5];
+}
+
+static int ImmediateValue(uint8_t const* immValue) {
+  int8_t tokenType = immValue[0];
+  int value = 0;
+  switch (tokenType & 0x60) {
+    case 0:
+      value = tokenType & 0x1F;
+      if (tokenType & 0x10) value |= 0xFFFFFFE0;
+      break;
+    case 0x20:
+      value = ((immValue[0] & 0x1F) << 8) + immValue[1];
+      if (tokenType & 0x10) value |= 0xFFFFE000;
+      break;
+    case 0x40:
+      value = ((immValue[0] & 0x1F) << 16) + (immValue[2] << 8) + immValue[1];
+      if (tokenType & 0x10) value |= 0xFFE00000;
+      break;
+    case 0x60:
+      value = SDL_SwapLE32(immValue[1] + (immValue[2] << 8) +
+                           (immValue[3] << 16) + (immValue[4] << 24));
+      break;
+  }
+  return value;
+}
+
+void ExpressionParser::GetTokens(uint8_t*& ip) {
   ExprToken curToken;
 
-  if (*thd->Ip) {
+  if (*ip) {
     do {
-      int8_t tokenType = *thd->Ip;
+      int8_t tokenType = *ip;
       if (tokenType >= 0) {
         curToken.Type = (ExprTokenType)tokenType;
-        curToken.Precedence = *(++thd->Ip);
-        thd->Ip++;
+        curToken.Precedence = *(++ip);
+        ip++;
         curToken.Value = 0;
         Tokens.push_back(curToken);
       } else {
-        uint8_t* immValue = thd->Ip;
         curToken.Type = ET_ImmediateValue;
-        switch (tokenType & 0x60) {
-          case 0:
-            curToken.Value = tokenType & 0x1F;
-            if (tokenType & 0x10) curToken.Value |= 0xFFFFFFE0;
-            thd->Ip++;
-            break;
-          case 0x20:
-            curToken.Value = ((immValue[0] & 0x1F) << 8) + immValue[1];
-            if (tokenType & 0x10) curToken.Value |= 0xFFFFE000;
-            thd->Ip += 2;
-            break;
-          case 0x40:
-            curToken.Value =
-                ((immValue[0] & 0x1F) << 16) + (immValue[2] << 8) + immValue[1];
-            if (tokenType & 0x10) curToken.Value |= 0xFFE00000;
-            thd->Ip += 3;
-            break;
-          case 0x60:
-            curToken.Value =
-                SDL_SwapLE32(immValue[1] + (immValue[2] << 8) +
-                             (immValue[3] << 16) + (immValue[4] << 24));
-            thd->Ip += 5;
-            break;
-          default:
-            break;
-        }
-        curToken.Precedence = *(++thd->Ip);
+        curToken.Value = ImmediateValue(ip);
+        ip += ImmediateSize(tokenType);
+        curToken.Precedence = *(++ip);
         Tokens.push_back(curToken);
       }
-    } while (*thd->Ip);
+    } while (*ip);
   }
 
-  thd->Ip++;
+  ip++;
+}
+
+bool ExpressionScan(uint8_t const*& ip, uint8_t const* end, bool* isConstant,
+                    int* value) {
+  // Same token layout as ExpressionParser::GetTokens()
+  int tokenCount = 0;
+  bool immediate = false;
+  uint8_t const* cur = ip;
+  if (cur >= end) return false;
+  while (*cur) {
+    int8_t tokenType = *cur;
+    immediate = tokenType < 0;
+    // Immediates are followed by a precedence byte too
+    int tokenSize = immediate ? ImmediateSize(tokenType) + 1 : 2;
+    if (end - cur <= tokenSize) return false;
+    if (immediate) *value = ImmediateValue(cur);
+    cur += tokenSize;
+    tokenCount++;
+  }
+  ip = cur + 1;
+  *isConstant = tokenCount == 1 && immediate;
+  return true;
 }
 
 }  // namespace Vm
@@ -6,7 +6,17 @@ namespace Impacto {
 
 namespace Vm {
 
+// Evaluates the expression at thread->Ip and advances past it. Expressions in
+// script buffers are compiled on first use and cached by address.
 int ExpressionEval(Sc3VmThread* thread, int* result);
+// Drops all compiled expressions of a script buffer, call this whenever
+// ScriptBuffers[bufferId] is replaced
+void ExpressionCacheReset(uint32_t bufferId, int64_t bufferSize);
+// Advances ip past the expression there without evaluating it, reading
+// nothing at or after end. Returns false if the expression runs into end.
+// *isConstant tells whether it is a lone immediate value, stored in *value.
+bool ExpressionScan(uint8_t const*& ip, uint8_t const* end, bool* isConstant,
+                    int* value);
 
 }  // namespace Vm
 
@@ -17,7 +17,7 @@ namespace Vm {
 
 VmInstruction(InstJump) {
   StartInstruction;
-  PopLocalLabel(labelAdr);
+  PopCodeLabel(labelAdr);
 
   thread->Ip = labelAdr;
 }
@@ -25,10 +25,10 @@ VmInstruction(InstJumpTable) {
   StartInstruction;
   PopExpression(labelNumIndex);
   PopUint16(dataLabelNum);
-  uint8_t* dataAdr = ScriptGetLabelAddress(
-      ScriptBuffers[thread->ScriptBufferId], dataLabelNum);
+  uint8_t* dataAdr =
+      ScriptGetLabelAddress(thread->ScriptBufferId, dataLabelNum);
   uint8_t* labelAdr = ScriptGetLabelAddress(
-      ScriptBuffers[thread->ScriptBufferId],
+      thread->ScriptBufferId,
       SDL_SwapLE16(*(uint16_t*)(dataAdr + 2 * labelNumIndex)));
 
   thread->Ip = labelAdr;
@@ -39,8 +39,7 @@ VmInstruction(InstIf) {
   PopExpression(condition);
 
   PopUint16(labelNum);
-  uint8_t* labelAdr =
-      ScriptGetLabelAddress(ScriptBuffers[thread->ScriptBufferId], labelNum);
+  uint8_t* labelAdr = ScriptGetLabelAddress(thread->ScriptBufferId, labelNum);
 
   if ((bool)check == (bool)condition) {
     thread->Ip = labelAdr;
@@ -55,13 +54,13 @@ VmInstruction(InstIf) {
 }
 VmInstruction(InstCall) {
   StartInstruction;
-  PopLocalLabel(labelAdr);
+  PopCodeLabel(labelAdr);
 
   if (thread->CallStackDepth != MaxCallStackDepth) {
     if (Profile::Vm::UseReturnIds) {
       PopUint16(retNum);
       thread->ReturnAdresses[thread->CallStackDepth] =
-          ScriptGetRetAddress(ScriptBuffers[thread->ScriptBufferId], retNum);
+          ScriptGetRetAddress(thread->ScriptBufferId, retNum);
     } else {
       thread->ReturnAdresses[thread->CallStackDepth] = thread->Ip;
     }
@@ -75,7 +74,7 @@ VmInstruction(InstCall) {
 VmInstruction(InstJumpFar) {
   StartInstruction;
   PopExpression(scriptBufferId);
-  PopFarLabel(labelAdr, scriptBufferId);
+  PopFarCodeLabel(labelAdr, scriptBufferId);
 
   thread->ScriptBufferId = scriptBufferId;
   thread->Ip = labelAdr;
@@ -83,13 +82,13 @@ VmInstruction(InstJumpFar) {
 VmInstruction(InstCallFar) {
   StartInstruction;
   PopExpression(scriptBufferId);
-  PopFarLabel(labelAdr, scriptBufferId);
+  PopFarCodeLabel(labelAdr, scriptBufferId);
 
   if (thread->CallStackDepth != MaxCallStackDepth) {
     if (Profile::Vm::UseReturnIds) {
       PopUint16(retNum);
       thread->ReturnAdresses[thread->CallStackDepth] =
-          ScriptGetRetAddress(ScriptBuffers[thread->ScriptBufferId], retNum);
+          ScriptGetRetAddress(thread->ScriptBufferId, retNum);
     } else {
       thread->ReturnAdresses[thread->CallStackDepth] = thread->Ip;
     }
@@ -134,8 +133,7 @@ VmInstruction(InstLoop) {
   PopUint16(labelNum);
   PopExpression(loopCount);
 
-  uint8_t* labelAdr =
-      ScriptGetLabelAddress(ScriptBuffers[thread->ScriptBufferId], labelNum);
+  uint8_t* labelAdr = ScriptGetLabelAddress(thread->ScriptBufferId, labelNum);
 
   if (thread->LoopLabelNum == labelNum) {
     loopCount = thread->LoopCounter;
@@ -166,8 +164,7 @@ VmInstruction(InstKeyOnJump) {
   PopExpression(arg2);
   PopExpression(arg3);
   PopUint16(labelNum);
-  uint8_t* labelAdr =
-      ScriptGetLabelAddress(ScriptBuffers[thread->ScriptBufferId], labelNum);
+  uint8_t* labelAdr = ScriptGetLabelAddress(thread->ScriptBufferId, labelNum);
 
   if (arg1 & 2) {
     arg2 = Interface::PADcustom[arg2];
@@ -215,8 +212,7 @@ VmInstruction(InstKeyOnJump_Dash) {
     PopExpression(arg3);
   }
   PopUint16(labelNum);
-  uint8_t* labelAdr =
-      ScriptGetLabelAddress(ScriptBuffers[thread->ScriptBufferId], labelNum);
+  uint8_t* labelAdr = ScriptGetLabelAddress(thread->ScriptBufferId, labelNum);
   if (Input::KeyboardButtonWentDown[SDL_SCANCODE_D]) {
     thread->Ip = labelAdr;
   }
@@ -252,8 +248,7 @@ VmInstruction(InstClickOnJump) {
   }
   PopExpression(arg2);
   PopUint16(labelNum);
-  uint8_t* labelAdr =
-      ScriptGetLabelAddress(ScriptBuffers[thread->ScriptBufferId], labelNum);
+  uint8_t* labelAdr = ScriptGetLabelAddress(thread->ScriptBufferId, labelNum);
   if (Input::KeyboardButtonWentDown[SDL_SCANCODE_D]) {
     thread->Ip = labelAdr;
   }
@@ -277,10 +272,15 @@ VmInstruction(InstLoadJump) {
   StartInstruction;
   PopExpression(scriptId);
   PopUint16(labelNum);
-  LoadScript(thread->ScriptBufferId, scriptId);
-  uint8_t* labelAdr =
-      ScriptGetLabelAddress(ScriptBuffers[thread->ScriptBufferId], labelNum);
-  thread->Ip = labelAdr;
+  if (RequestScript(scriptId)) {
+    LoadScript(thread->ScriptBufferId, scriptId);
+    uint8_t* labelAdr = ScriptGetLabelAddress(thread->ScriptBufferId, labelNum);
+    PrefetchLabelAssets(thread->ScriptBufferId, labelNum);
+    thread->Ip = labelAdr;
+  } else {
+    ResetInstruction;
+    BlockThread;
+  }
 }
 VmInstruction(InstSwitch) {
   StartInstruction;
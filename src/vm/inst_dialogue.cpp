@@ -131,12 +131,19 @@ VmInstruction(InstMes) {
       PopExpression(animationId);
       PopExpression(characterId);
       PopString(line);
-      Io::InputStream* stream;
-      Io::VfsOpen("voice", audioId, &stream);
+      int voiceId = -1;
+      // The line would be gone before the voice got to play anyway
+      if (!Game::IsSkipping()) {
+        voiceId = audioId;
+        // Voice files are numbered in script order, so the next lines' voices
+        // are most likely the next IDs
+        uint32_t const upcomingVoices[] = {(uint32_t)audioId + 1,
+                                           (uint32_t)audioId + 2};
+        Io::VfsPrefetch("voice", upcomingVoices, 2);
+      }
       uint8_t* oldIp = thread->Ip;
       thread->Ip = line;
-      DialoguePages[thread->DialoguePageId].AddString(
-          thread, Audio::AudioStream::Create(stream));
+      DialoguePages[thread->DialoguePageId].AddString(thread, voiceId);
       thread->Ip = oldIp;
     } break;
     case 0x0B: {  // LoadVoicedDialogue0B
@@ -290,8 +297,7 @@ VmInstruction(InstSel) {
     case 1: {
       PopUint16(selStrNum);
       uint8_t* oldIp = thread->Ip;
-      thread->Ip =
-          ScriptGetStrAddress(ScriptBuffers[thread->ScriptBufferId], selStrNum);
+      thread->Ip = ScriptGetStrAddress(thread->ScriptBufferId, selStrNum);
       int len = TextLayoutPlainLine(
           thread, 255, SelectionDisplay::Choices[SelectionDisplay::ChoiceCount],
           Profile::Dialogue::DialogueFont, Profile::Dialogue::DefaultFontSize,
@@ -311,8 +317,7 @@ VmInstruction(InstSel) {
     case 2: {
       PopUint16(selStrNum);
       uint8_t* oldIp = thread->Ip;
-      thread->Ip =
-          ScriptGetStrAddress(ScriptBuffers[thread->ScriptBufferId], selStrNum);
+      thread->Ip = ScriptGetStrAddress(thread->ScriptBufferId, selStrNum);
       int len = TextLayoutPlainLine(
           thread, 255, SelectionDisplay::Choices[SelectionDisplay::ChoiceCount],
           Profile::Dialogue::DialogueFont, Profile::Dialogue::DefaultFontSize,
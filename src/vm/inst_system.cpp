@@ -41,7 +41,7 @@ VmInstruction(InstCreateThread) {
   StartInstruction;
   PopExpression(groupId);
   PopExpression(scriptBufferId);
-  PopFarLabel(labelAdr, scriptBufferId);
+  PopFarCodeLabel(labelAdr, scriptBufferId);
   Sc3VmThread* newThread = CreateThread(groupId);
   newThread->GroupId = groupId;
   newThread->ScriptBufferId = scriptBufferId;
@@ -66,7 +66,12 @@ VmInstruction(InstScriptLoad) {
   StartInstruction;
   PopExpression(bufferId);
   PopExpression(scriptId);
-  LoadScript(bufferId, scriptId);
+  if (RequestScript(scriptId)) {
+    LoadScript(bufferId, scriptId);
+  } else {
+    ResetInstruction;
+    BlockThread;
+  }
 }
 VmInstruction(InstWait) {
   StartInstruction;
@@ -303,8 +308,7 @@ VmInstruction(InstSystemMes) {
     case 3: {  // SystemMesSetMes
       PopUint16(sysMesStrNum);
       uint8_t* oldIp = thread->Ip;
-      thread->Ip = ScriptGetStrAddress(ScriptBuffers[thread->ScriptBufferId],
-                                       sysMesStrNum);
+      thread->Ip = ScriptGetStrAddress(thread->ScriptBufferId, sysMesStrNum);
       int len = TextLayoutPlainLine(
           thread, 255,
           SysMesBox::Implementation
@@ -328,8 +332,7 @@ VmInstruction(InstSystemMes) {
     case 4: {  // SystemMesSetSel
       PopUint16(sysSelStrNum);
       uint8_t* oldIp = thread->Ip;
-      thread->Ip = ScriptGetStrAddress(ScriptBuffers[thread->ScriptBufferId],
-                                       sysSelStrNum);
+      thread->Ip = ScriptGetStrAddress(thread->ScriptBufferId, sysSelStrNum);
       int len = TextLayoutPlainLine(
           thread, 255,
           SysMesBox::Implementation
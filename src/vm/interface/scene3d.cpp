@@ -36,20 +36,56 @@ static void UpdateScrWorkAnimations() {
   }
 }
 
+// Indices of the words position and rotation of a model are derived from in
+// its ScrWorkView
+enum ModelViewWord {
+  MVW_TarDir,
+  MVW_PosX,
+  MVW_PosY,
+  MVW_PosZ,
+  MVW_CenY,
+  MVW_RotX,
+  MVW_RotY,
+  MVW_RotZ,
+  MVW_TargetX,
+  MVW_TargetY,
+  MVW_TargetZ,
+  MVW_Count
+};
+
+static int const ScriptModelCount = 9;
+static ScrWorkView<MVW_Count> ModelViews[ScriptModelCount];
+
+// Returns true if the model's transform needs to be recomputed
+static bool UpdateModelView(int charId) {
+  int base = 30 * charId;
+  int pose = ScrWork[base + SW_MDL1TARDIR] - 30;
+  // Only RNE models look at a target, otherwise this just repeats POSX
+  int target = base + SW_MDL1POSX;
+  if (Profile::Vm::GameInstructionSet == +InstructionSet::RNE && pose >= 0) {
+    target = 20 * pose + 5500;
+  }
+
+  int const ids[MVW_Count] = {
+      base + SW_MDL1TARDIR, base + SW_MDL1POSX, base + SW_MDL1POSY,
+      base + SW_MDL1POSZ,   base + SW_MDL1CENY, base + SW_MDL1ROTX,
+      base + SW_MDL1ROTY,   base + SW_MDL1ROTZ, target,
+      target + 1,           target + 2};
+  return ModelViews[charId].Update(ids);
+}
+
 static void UpdateRenderableRot(int charId) {
-  int pose = ScrWork[30 * charId + SW_MDL1TARDIR] - 30;
+  ScrWorkView<MVW_Count> const& view = ModelViews[charId];
+  int pose = view.Get(MVW_TarDir) - 30;
 
   switch (Profile::Vm::GameInstructionSet) {
     case InstructionSet::RNE: {
       if (pose >= 0) {
-        glm::vec3 target = ScrWorkGetVec3(20 * pose + 5500, 20 * pose + 5501,
-                                          20 * pose + 5502);
+        glm::vec3 target = view.GetVec3(MVW_TargetX);
         target.y += Profile::Scene3D::DefaultCameraPosition.y;
 
-        glm::vec3 object =
-            ScrWorkGetVec3(30 * charId + SW_MDL1POSX, 30 * charId + SW_MDL1POSY,
-                           30 * charId + SW_MDL1POSZ);
-        object.y += ScrWorkGetFloat(30 * charId + SW_MDL1CENY);
+        glm::vec3 object = view.GetVec3(MVW_PosX);
+        object.y += view.GetFloat(MVW_CenY);
 
         glm::vec3 lookat = LookAtEulerZYX(object, target);
         lookat.x = 0.0f;
@@ -60,36 +96,36 @@ static void UpdateRenderableRot(int charId) {
         ScrWorkSetAngle(30 * charId + SW_MDL1ROTY, lookat.y);
       } else {
         Scene3D::Renderables[charId].ModelTransform.SetRotationFromEuler(
-            ScrWorkGetAngleVec3(30 * charId + SW_MDL1ROTX,
-                                30 * charId + SW_MDL1ROTY,
-                                30 * charId + SW_MDL1ROTZ));
+            view.GetAngleVec3(MVW_RotX));
       }
     } break;
     case InstructionSet::Dash: {
       Scene3D::Renderables[charId].ModelTransform.SetRotationFromEuler(
-          ScrWorkGetAngleVec3(30 * charId + SW_MDL1ROTX,
-                              30 * charId + SW_MDL1ROTY,
-                              30 * charId + SW_MDL1ROTZ));
+          view.GetAngleVec3(MVW_RotX));
     } break;
   }
 }
 
 static void UpdateRenderablePos(int charId) {
   Scene3D::Renderables[charId].ModelTransform.Position =
-      ScrWorkGetVec3(30 * charId + SW_MDL1POSX, 30 * charId + SW_MDL1POSY,
-                     30 * charId + SW_MDL1POSZ);
+      ModelViews[charId].GetVec3(MVW_PosX);
 }
 
 static void UpdateRenderables() {
-  for (int i = 0; i <= 8; i++) {
-    if (Scene3D::Renderables[i].Status == LS_Loaded) {
+  for (int i = 0; i < ScriptModelCount; i++) {
+    if (Scene3D::Renderables[i].Status != LS_Loaded) {
+      // (Re)loading resets the transform
+      ModelViews[i].Invalidate();
+      continue;
+    }
+    if (UpdateModelView(i)) {
       UpdateRenderableRot(i);
       UpdateRenderablePos(i);
-      if (GetFlag(SF_IRUOENABLE) && GetFlag(SF_Pokecon_Open)) {
-        Scene3D::Renderables[i].IsVisible = GetFlag(SF_MDL1SHDISP + i);
-      } else {
-        Scene3D::Renderables[i].IsVisible = GetFlag(SF_MDL1DISP + i);
-      }
+    }
+    if (GetFlag(SF_IRUOENABLE) && GetFlag(SF_Pokecon_Open)) {
+      Scene3D::Renderables[i].IsVisible = GetFlag(SF_MDL1SHDISP + i);
+    } else {
+      Scene3D::Renderables[i].IsVisible = GetFlag(SF_MDL1DISP + i);
     }
   }
 }
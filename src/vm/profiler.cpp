@@ -0,0 +1,191 @@
+#include "profiler.h"
+
+#include <algorithm>
+#include <cstdarg>
+
+#include "../game.h"
+#include "../log.h"
+#include "../window.h"
+
+namespace Impacto {
+namespace Vm {
+
+static int const WindowShownOpcodes = 40;
+
+static double TicksToMs(uint64_t ticks) {
+  return ticks * 1000.0 / (double)SDL_GetPerformanceFrequency();
+}
+
+std::vector<OpcodeProfileEntry> GetOpcodeProfile() {
+  std::vector<OpcodeProfileEntry> entries;
+  for (int i = 0; i < OpcodeGroupCount; i++) {
+    for (int j = 0; j < 256; j++) {
+      if (OpcodeProfile[i][j].Count == 0) continue;
+      OpcodeProfileEntry entry;
+      entry.Group = OpcodeGroups[i];
+      entry.Opcode = j;
+      entry.Stats = OpcodeProfile[i][j];
+      entries.push_back(entry);
+    }
+  }
+  std::sort(entries.begin(), entries.end(),
+            [](OpcodeProfileEntry const& a, OpcodeProfileEntry const& b) {
+              return a.Stats.Ticks > b.Stats.Ticks;
+            });
+  return entries;
+}
+
+static bool WriteFile(std::string const& fileName, std::string const& data) {
+  SDL_RWops* rw = SDL_RWFromFile(fileName.c_str(), "wb");
+  bool ok = rw && SDL_RWwrite(rw, data.data(), data.size(), 1) == 1;
+  if (rw) SDL_RWclose(rw);
+  if (!ok) {
+    ImpLog(LL_Error, LC_VM, "Could not write VM profile \"%s\"\n",
+           fileName.c_str());
+  }
+  return ok;
+}
+
+static void AppendF(std::string& out, char const* format, ...) {
+  char buffer[256];
+  va_list args;
+  va_start(args, format);
+  vsnprintf(buffer, sizeof(buffer), format, args);
+  va_end(args);
+  out += buffer;
+}
+
+bool WriteProfileCsv(std::string const& fileName) {
+  std::string out = "kind,group,opcode,buffer,script,thread,count,ms\n";
+  for (auto const& entry : GetOpcodeProfile()) {
+    AppendF(out, "opcode,%u,%u,,,,%llu,%.6f\n", entry.Group, entry.Opcode,
+            (unsigned long long)entry.Stats.Count,
+            TicksToMs(entry.Stats.Ticks));
+  }
+  for (int i = 0; i < MaxLoadedScripts; i++) {
+    if (ScriptProfile[i].Count == 0) continue;
+    AppendF(out, "script,,,%d,%u,,%llu,%.6f\n", i, LoadedScriptIds[i],
+            (unsigned long long)ScriptProfile[i].Count,
+            TicksToMs(ScriptProfile[i].Ticks));
+  }
+  for (int i = 0; i < MaxThreads; i++) {
+    if (ThreadProfile[i].Count == 0) continue;
+    AppendF(out, "thread,,,,,%d,%llu,%.6f\n", i,
+            (unsigned long long)ThreadProfile[i].Count,
+            TicksToMs(ThreadProfile[i].Ticks));
+  }
+  return WriteFile(fileName, out);
+}
+
+bool WriteProfileJson(std::string const& fileName) {
+  std::string out;
+  AppendF(out, "{\n  \"instructions\": %llu,\n  \"expressions\": %llu,\n",
+          (unsigned long long)InstructionCount,
+          (unsigned long long)ExpressionCount);
+
+  out += "  \"opcodes\": [";
+  char const* separator = "\n";
+  for (auto const& entry : GetOpcodeProfile()) {
+    AppendF(out,
+            "%s    {\"group\": %u, \"opcode\": %u, \"count\": %llu, \"ms\": "
+            "%.6f}",
+            separator, entry.Group, entry.Opcode,
+            (unsigned long long)entry.Stats.Count,
+            TicksToMs(entry.Stats.Ticks));
+    separator = ",\n";
+  }
+  out += "\n  ],\n  \"scripts\": [";
+  separator = "\n";
+  for (int i = 0; i < MaxLoadedScripts; i++) {
+    if (ScriptProfile[i].Count == 0) continue;
+    AppendF(out,
+            "%s    {\"buffer\": %d, \"script\": %u, \"count\": %llu, \"ms\": "
+            "%.6f}",
+            separator, i, LoadedScriptIds[i],
+            (unsigned long long)ScriptProfile[i].Count,
+            TicksToMs(ScriptProfile[i].Ticks));
+    separator = ",\n";
+  }
+  out += "\n  ],\n  \"threads\": [";
+  separator = "\n";
+  for (int i = 0; i < MaxThreads; i++) {
+    if (ThreadProfile[i].Count == 0) continue;
+    AppendF(out, "%s    {\"thread\": %d, \"count\": %llu, \"ms\": %.6f}",
+            separator, i, (unsigned long long)ThreadProfile[i].Count,
+            TicksToMs(ThreadProfile[i].Ticks));
+    separator = ",\n";
+  }
+  out += "\n  ]\n}\n";
+  return WriteFile(fileName, out);
+}
+
+static void StatsLabel(char const* name, OpcodeStats const& stats) {
+  char buffer[96];
+  snprintf(buffer, sizeof(buffer), "%s: %llu calls, %.3f ms", name,
+           (unsigned long long)stats.Count, TicksToMs(stats.Ticks));
+  nk_label(Nk, buffer, NK_TEXT_ALIGN_LEFT);
+}
+
+void ShowProfilerWindow() {
+  if (nk_begin(Nk, "VM Profiler",
+               nk_rect(Window::WindowWidth - 420, 20, 400,
+                       Window::WindowHeight - 40),
+               NK_WINDOW_BORDER | NK_WINDOW_TITLE | NK_WINDOW_MOVABLE |
+                   NK_WINDOW_SCALABLE)) {
+    nk_layout_row_dynamic(Nk, 24, 1);
+    int enabled = ProfileOpcodes;
+    nk_checkbox_label(Nk, "Enabled", &enabled);
+    ProfileOpcodes = enabled;
+
+    char buffer[96];
+    snprintf(buffer, sizeof(buffer), "%llu instructions, %llu expressions",
+             (unsigned long long)InstructionCount,
+             (unsigned long long)ExpressionCount);
+    nk_label(Nk, buffer, NK_TEXT_ALIGN_LEFT);
+
+    nk_layout_row_dynamic(Nk, 24, 3);
+    if (nk_button_label(Nk, "Reset")) ResetStats();
+    if (nk_button_label(Nk, "Save CSV")) WriteProfileCsv("vmprofile.csv");
+    if (nk_button_label(Nk, "Save JSON")) WriteProfileJson("vmprofile.json");
+
+    if (nk_tree_push(Nk, NK_TREE_TAB, "Opcodes", NK_MAXIMIZED)) {
+      nk_layout_row_dynamic(Nk, 20, 1);
+      std::vector<OpcodeProfileEntry> entries = GetOpcodeProfile();
+      int shown = std::min((int)entries.size(), WindowShownOpcodes);
+      for (int i = 0; i < shown; i++) {
+        char name[8];
+        snprintf(name, sizeof(name), "%02X:%02X", entries[i].Group,
+                 entries[i].Opcode);
+        StatsLabel(name, entries[i].Stats);
+      }
+      nk_tree_pop(Nk);
+    }
+
+    if (nk_tree_push(Nk, NK_TREE_TAB, "Scripts", NK_MINIMIZED)) {
+      nk_layout_row_dynamic(Nk, 20, 1);
+      for (int i = 0; i < MaxLoadedScripts; i++) {
+        if (ScriptProfile[i].Count == 0) continue;
+        char name[32];
+        snprintf(name, sizeof(name), "Buffer %d (script %u)", i,
+                 LoadedScriptIds[i]);
+        StatsLabel(name, ScriptProfile[i]);
+      }
+      nk_tree_pop(Nk);
+    }
+
+    if (nk_tree_push(Nk, NK_TREE_TAB, "Threads", NK_MINIMIZED)) {
+      nk_layout_row_dynamic(Nk, 20, 1);
+      for (int i = 0; i < MaxThreads; i++) {
+        if (ThreadProfile[i].Count == 0) continue;
+        char name[16];
+        snprintf(name, sizeof(name), "Thread %d", i);
+        StatsLabel(name, ThreadProfile[i]);
+      }
+      nk_tree_pop(Nk);
+    }
+  }
+  nk_end(Nk);
+}
+
+}  // namespace Vm
+}  // namespace Impacto
\ No newline at end of file
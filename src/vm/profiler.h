@@ -0,0 +1,30 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "vm.h"
+
+namespace Impacto {
+namespace Vm {
+
+struct OpcodeProfileEntry {
+  uint8_t Group;
+  uint8_t Opcode;
+  OpcodeStats Stats;
+};
+
+// Views on the statistics collected while ProfileOpcodes is set
+
+// All opcodes executed since the last ResetStats(), most expensive first
+std::vector<OpcodeProfileEntry> GetOpcodeProfile();
+
+// Write opcode, script buffer and thread totals, return false on failure
+bool WriteProfileCsv(std::string const& fileName);
+bool WriteProfileJson(std::string const& fileName);
+
+// Nuklear profiler window, call between nk_input_end() and rendering
+void ShowProfilerWindow();
+
+}  // namespace Vm
+}  // namespace Impacto
\ No newline at end of file
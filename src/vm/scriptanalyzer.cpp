@@ -0,0 +1,567 @@
+#include "scriptanalyzer.h"
+
+#include <algorithm>
+#include <cstring>
+#include <unordered_set>
+
+#include "expression.h"
+#include "inst_controlflow.h"
+#include "inst_dialogue.h"
+#include "inst_gamespecific.h"
+#include "inst_graphics2d.h"
+#include "inst_graphics3d.h"
+#include "inst_misc.h"
+#include "inst_movie.h"
+#include "inst_sound.h"
+#include "inst_system.h"
+#include "../io/vfs.h"
+#include "../profile/vm.h"
+
+namespace Impacto {
+namespace Vm {
+
+char const* const AssetKindMountpoints[AK_Count] = {"bg",  "chara", "bgm",
+                                                    "se",  "voice", "model"};
+
+// Operand layouts, see the instructions themselves
+enum AssetInstructionForm {
+  AIF_BGload,
+  AIF_CHAload,
+  AIF_CHAload3D,
+  AIF_BGMplay,
+  AIF_SEplay,
+  AIF_SEplayMO6,
+  AIF_Mes
+};
+
+// Operands: b = byte, w = 16-bit word (label, string or number),
+// e = expression. EndsBlock instructions never fall through to the next one.
+struct InstructionLayout {
+  InstructionProc Proc;
+  char const* Operands;
+  bool EndsBlock;
+};
+
+// Instructions with operands depending on earlier ones are in
+// VariableOperands() instead. Anything else, including stubs of unknown layout,
+// stops the walk.
+static InstructionLayout const Layouts[] = {
+    // inst_controlflow
+    {InstJump, "w", true},
+    {InstJumpTable, "ew", true},
+    {InstIf, "bew"},
+    {InstJumpFar, "ew", true},
+    {InstReturn, "", true},
+    {InstReturnIfFlag, "be"},
+    {InstLoop, "we"},
+    {InstFlagOnJump, "bew"},
+    {InstKeyOnJump, "beew"},
+    {InstKeyboardOnJump, "beew"},
+    {InstLoadJump, "ew", true},
+    {InstSwitch, "e"},
+    {InstCase, "ew"},
+    // inst_dialogue
+    {InstSetMesWinPri, "eee"},
+    {InstMesVoiceWait, ""},
+    {InstMesMain, "b"},
+    {InstSetMesModeFormat, "ew"},
+    {InstSetNGmoji, "ww"},
+    {InstMesRev, "b"},
+    {InstSetTextTable, "ew"},
+    {InstEncyclopedia, "e"},
+    // inst_gamespecific
+    {InstUnk0041, ""},
+    {InstUnk0052, "e"},
+    {InstUnk0053, "ee"},
+    {InstUnk0054, "ee"},
+    {InstUnk011F, ""},
+    {InstUnk012D, ""},
+    {InstUnk1037MO7, "b"},
+    {InstUnk1037, "eee"},
+    {InstUnk1038Darling, "bw"},
+    {InstUnk1038MO7, "ee"},
+    {InstDelusionTriggerCHLCC, "b"},
+    // inst_graphics2d
+    {InstCreateSurf, "beee"},
+    {InstReleaseSurf, "e"},
+    {InstLoadPic, "eee"},
+    {InstSurfFill, "eeeee"},
+    {InstSCcapture, "e"},
+    {InstBGload, "ee"},
+    {InstBGswap, "ee"},
+    {InstBGsetColor, "ee"},
+    {InstBGsetLinkOld, "beee"},
+    {InstCHAload, "bee"},
+    {InstCHAswap, "ee"},
+    {InstBGrelease, "e"},
+    {InstBGcopy, "ee"},
+    {InstCHAcopy, "ee"},
+    {InstBGloadEx, "ee"},
+    {InstCHArelease, "e"},
+    {InstGetCharaPause, "ee"},
+    {InstBGfadeExpInit, "e"},
+    // inst_graphics3d
+    {InstCHArelease3D, "e"},
+    {InstUnk0204, "ee"},
+    {InstCHAswap3DMaybe, "ee"},
+    {InstCHAUnk02073D, "eb"},
+    {InstPositionObject, "eeeee"},
+    {InstPositionObject_Dash, "eeeee"},
+    {InstCHAsetAnim3D, "ee"},
+    {InstUnk0210, "be"},
+    {InstUnk0211, "eeeee"},
+    {InstUnk0212, "e"},
+    {InstUnk0214, "bee"},
+    {InstUnk0215, "eeeeeeeeeeeeeeeee"},
+    {InstUnk0217, "b"},
+    {InstUnk0219, "e"},
+    {InstUnk0240, "b"},
+    // inst_misc
+    {InstUPLmenuUI, "b"},
+    {InstUPLxTitle, "b"},
+    {InstPresence, "be"},
+    {InstPresenceMO6, "e"},
+    {InstSetPlayer, "b"},
+    {InstSignIn, ""},
+    {InstAchievementIcon, "b"},
+    {InstSetX360SysMesPos, "e"},
+    {InstSystemMenu, "b"},
+    {InstClearFlagChk, ""},
+    {InstClearFlagChkOld, "b"},
+    {InstOption, "b"},
+    {InstHelp, "b"},
+    {InstAchievementMenu, "b"},
+    {InstSoundMenu, "b"},
+    {InstAllClear, ""},
+    {InstAlbum, "b"},
+    {InstMovieMode, "b"},
+    {InstClistInit, "b"},
+    {InstSaveMenu, "b"},
+    {InstLoadDataOld, "e"},
+    {InstTitleMenu, "b"},
+    {InstTitleMenuNew, "b"},
+    {InstTitleMenuOld, ""},
+    {InstSetPlayMode, "e"},
+    {InstSetEVflag, "e"},
+    {InstSetCutin, "beee"},
+    {InstAchChkTitle, ""},
+    {InstSetSceneViewFlag, "e"},
+    {InstChkClearFlag, ""},
+    // inst_movie
+    {InstPlayMovieOld, "bee"},
+    {InstMovieMain, "b"},
+    {InstLoadMovie, "e"},
+    {InstSFDpause, "b"},
+    // inst_sound
+    {InstBGMstop, "b"},
+    {InstSEplayMO6, "bee"},
+    {InstSEstop, "b"},
+    {InstSSEplay, "e"},
+    {InstSSEstop, ""},
+    {InstBGMflag, "e"},
+    {InstVoicePlay, "bee"},
+    {InstVoicePlayOld, "be"},
+    {InstVoiceStop, "b"},
+    {InstVoiceStopNew, "be"},
+    {InstVoicePlayWait, "b"},
+    {InstSNDpause, "b"},
+    {InstSEplayWait, "b"},
+    {InstResetSoundAll, ""},
+    {InstSNDloadStop, ""},
+    {InstBGMstopWait, ""},
+    {InstSysSeload, ""},
+    // inst_system
+    {InstEnd, "", true},
+    {InstCreateThread, "eew"},
+    {InstKillThread, "e"},
+    {InstReset, "", true},
+    {InstScriptLoad, "ee"},
+    {InstWait, "e"},
+    {InstHalt, "", true},
+    {InstFlagOnWait, "be"},
+    {InstSetFlag, "e"},
+    {InstResetFlag, "e"},
+    {InstCopyFlag, "ee"},
+    {InstKeyWait, "bee"},
+    {InstKeyWaitTimer, "beee"},
+    {InstThreadControl, "ee"},
+    {InstGetSelfPointer, ""},
+    {InstVsync, ""},
+    {InstTest, "e"},
+    {InstThreadControlStore, "b"},
+    {InstPadAct, "eee"},
+    {InstCopyThreadWork, "eeee"},
+    {InstSaveIconLoad, "e"},
+    {InstVoiceTableLoadMaybe, "e"},
+    {InstSetPadCustom, ""},
+    {InstMwait, "ee"},
+    {InstTerminate, "", true},
+    {InstDebugPrint, "ee"},
+    {InstGetNowTime, ""},
+    {InstGetSystemStatus, "e"},
+    {InstReboot, ""},
+    {InstReloadScript, ""},
+    {InstReloadScriptMenu, "b"},
+    {InstDebugEditer, "b"},
+    {InstPadActEx, "eee"},
+    {InstDebugSetup, "e"},
+    {InstGlobalSystemMessage, "e"},
+    {InstMSinit, "e"},
+    {InstSaveSlot, "ee"},
+    {InstSystemMain, ""},
+    {InstGameInfoInit, "b"},
+    {InstSystemDataReset, "b"},
+    {InstDebugData, "b"},
+    {InstLoadFontWidths, "eee"},
+};
+
+struct OpcodeInfo {
+  InstructionProc Proc;
+  char const* Operands;
+  bool EndsBlock;
+  bool IsAsset;
+  AssetInstructionForm Form;
+};
+
+static OpcodeInfo Opcodes[OpcodeGroupCount][256];
+static int8_t OpcodeGroupSlots[0x80];
+
+// Long sections (a whole scene's voices...) are prefetched piecewise, as
+// threads jump through them
+int const MaxPrefetchedAssets = 32;
+
+void ScriptAnalyzerInit(InstructionProc* const* opcodeTables) {
+  struct {
+    InstructionProc Proc;
+    AssetInstructionForm Form;
+  } const forms[] = {{InstBGload, AIF_BGload},
+                     {InstCHAload, AIF_CHAload},
+                     {InstCHAload3D, AIF_CHAload3D},
+                     {InstBGMplay, AIF_BGMplay},
+                     {InstSEplay, AIF_SEplay},
+                     {InstSEplayMO6, AIF_SEplayMO6},
+                     {InstMes, AIF_Mes}};
+
+  memset(Opcodes, 0, sizeof(Opcodes));
+  memset(OpcodeGroupSlots, -1, sizeof(OpcodeGroupSlots));
+  for (int i = 0; i < OpcodeGroupCount; i++) {
+    uint8_t group = OpcodeGroups[i];
+    OpcodeGroupSlots[group] = i;
+    InstructionProc* table = opcodeTables[group];
+    if (!table) continue;
+    for (int opcode = 0; opcode < 256; opcode++) {
+      OpcodeInfo& info = Opcodes[i][opcode];
+      info.Proc = table[opcode];
+      for (auto const& layout : Layouts) {
+        if (info.Proc == layout.Proc) {
+          info.Operands = layout.Operands;
+          info.EndsBlock = layout.EndsBlock;
+          break;
+        }
+      }
+      for (auto const& form : forms) {
+        if (info.Proc == form.Proc) {
+          info.IsAsset = true;
+          info.Form = form.Form;
+          break;
+        }
+      }
+    }
+  }
+}
+
+static bool SkipBytes(uint8_t const*& ip, uint8_t const* end, int count) {
+  if (end - ip < count) return false;
+  ip += count;
+  return true;
+}
+
+static bool SkipExpression(uint8_t const*& ip, uint8_t const* end) {
+  bool isConstant;
+  int value;
+  return ExpressionScan(ip, end, &isConstant, &value);
+}
+
+static bool ConstantId(uint8_t const*& ip, uint8_t const* end, uint32_t* id) {
+  bool isConstant;
+  int value;
+  if (!ExpressionScan(ip, end, &isConstant, &value) || !isConstant ||
+      value < 0) {
+    return false;
+  }
+  *id = value;
+  return true;
+}
+
+// Returns false if the asset of the instruction at ip isn't constant
+static bool DecodeAsset(AssetInstructionForm form, uint8_t const* ip,
+                        uint8_t const* end, AssetRef* out) {
+  ip += 2;
+  switch (form) {
+    case AIF_BGload:
+      out->Kind = AK_Background;
+      return SkipExpression(ip, end) && ConstantId(ip, end, &out->Id);
+    case AIF_CHAload:
+      out->Kind = AK_Character;
+      if (!SkipBytes(ip, end, 1) || !SkipExpression(ip, end) ||
+          !ConstantId(ip, end, &out->Id)) {
+        return false;
+      }
+      // The upper half selects the face
+      out->Id &= 0xFFFF;
+      return true;
+    case AIF_CHAload3D:
+      out->Kind = AK_Model;
+      if (!SkipExpression(ip, end)) return false;
+      if (Profile::Vm::GameInstructionSet == +InstructionSet::RNE &&
+          !SkipExpression(ip, end)) {
+        return false;
+      }
+      return ConstantId(ip, end, &out->Id);
+    case AIF_BGMplay:
+      out->Kind = AK_Bgm;
+      return SkipBytes(ip, end, 1) && ConstantId(ip, end, &out->Id);
+    case AIF_SEplay:
+      out->Kind = AK_Se;
+      // Type 2 has no effect
+      return end - ip >= 2 && ip[1] != 2 && SkipBytes(ip, end, 2) &&
+             ConstantId(ip, end, &out->Id);
+    case AIF_SEplayMO6:
+      out->Kind = AK_Se;
+      return SkipBytes(ip, end, 1) && ConstantId(ip, end, &out->Id);
+    case AIF_Mes:
+      out->Kind = AK_Voice;
+      // Only LoadVoicedDialogue plays its voice
+      return end - ip >= 1 && ip[0] == 3 && SkipBytes(ip, end, 1) &&
+             ConstantId(ip, end, &out->Id);
+  }
+  return false;
+}
+
+// Returns false unless the instruction at ip loads a constant script
+static bool DecodeScriptId(OpcodeInfo const& info, uint8_t const* ip,
+                           uint8_t const* end, uint32_t* out) {
+  ip += 2;
+  if (info.Proc == InstScriptLoad) {
+    return SkipExpression(ip, end) && ConstantId(ip, end, out);
+  }
+  if (info.Proc == InstLoadJump) return ConstantId(ip, end, out);
+  return false;
+}
+
+// Operands of the instruction at ip whose layout isn't fixed, nullptr if they
+// can't be told
+static char const* VariableOperands(OpcodeInfo const& info, uint8_t const* ip,
+                                    uint8_t const* end) {
+  bool const returnIds = Profile::Vm::UseReturnIds;
+  if (info.Proc == InstCall) return returnIds ? "ww" : "w";
+  if (info.Proc == InstCallFar) return returnIds ? "eww" : "ew";
+  if (info.Proc == InstCHAload3D) {
+    return Profile::Vm::GameInstructionSet == +InstructionSet::RNE ? "eee"
+                                                                   : "ee";
+  }
+
+  ip += 2;
+  if (end - ip < 1) return nullptr;
+  uint8_t type = ip[0];
+  if (info.Proc == InstMes) {
+    switch (type) {
+      case 0:
+        return "bew";
+      case 1:
+        return "beew";
+      case 3:
+      case 0x0B:
+        return "beeew";
+    }
+    return nullptr;
+  }
+  if (info.Proc == InstSEplay) {
+    if (end - ip < 2) return nullptr;
+    return ip[1] != 2 ? "bbee" : "bb";
+  }
+  if (info.Proc == InstBGMplay) return type == 2 ? "bee" : "be";
+  if (info.Proc == InstMesCls) {
+    return (type & 0xFE) != 4 && !(type & 1) ? "be" : "b";
+  }
+  if (info.Proc == InstMessWindow) {
+    return type >= 5 && type <= 7 ? "be" : "b";
+  }
+  return nullptr;
+}
+
+static bool SkipOperands(uint8_t const*& ip, uint8_t const* end,
+                         char const* operands) {
+  for (; *operands; operands++) {
+    switch (*operands) {
+      case 'b':
+        if (!SkipBytes(ip, end, 1)) return false;
+        break;
+      case 'w':
+        if (!SkipBytes(ip, end, 2)) return false;
+        break;
+      case 'e':
+        if (!SkipExpression(ip, end)) return false;
+        break;
+    }
+  }
+  return true;
+}
+
+enum DecodeResult {
+  DR_Ok,
+  // A known opcode whose operands can't be told, or at least not here
+  DR_UnknownLayout,
+  // Not the start of an instruction at all
+  DR_Invalid,
+  // Operands don't decode before end
+  DR_Overrun
+};
+
+// Moves ip past the instruction at it. outInfo is set to nullptr for
+// expression statements.
+static DecodeResult DecodeInstruction(uint8_t const*& ip, uint8_t const* end,
+                                      OpcodeInfo const** outInfo) {
+  *outInfo = nullptr;
+  if (*ip == 0xFE) {
+    ip++;
+    return SkipExpression(ip, end) ? DR_Ok : DR_Overrun;
+  }
+  if (end - ip < 2) return DR_Invalid;
+  int8_t slot = OpcodeGroupSlots[ip[0] & 0x7F];
+  if (slot < 0) return DR_Invalid;
+  OpcodeInfo const& info = Opcodes[slot][ip[1]];
+  if (!info.Proc) return DR_Invalid;
+  *outInfo = &info;
+  char const* operands =
+      info.Operands ? info.Operands : VariableOperands(info, ip, end);
+  if (!operands) return DR_UnknownLayout;
+
+  ip += 2;
+  return SkipOperands(ip, end, operands) ? DR_Ok : DR_Overrun;
+}
+
+// Follows instruction boundaries from the label, as the VM would run it
+// without taking any jump, until code that can't be decoded or leaves the label
+static void AnalyzeLabel(uint8_t const* ip, uint8_t const* end,
+                         std::unordered_set<uint64_t>& seen,
+                         ScriptAssetManifest& out) {
+  while (ip < end) {
+    uint8_t const* inst = ip;
+    OpcodeInfo const* info;
+    if (DecodeInstruction(ip, end, &info) != DR_Ok) return;
+    if (!info) continue;
+
+    AssetRef asset;
+    if (info->IsAsset && DecodeAsset(info->Form, inst, ip, &asset) &&
+        seen.insert(((uint64_t)asset.Kind << 32) | asset.Id).second) {
+      out.Assets.push_back(asset);
+    }
+    uint32_t scriptId;
+    if (DecodeScriptId(*info, inst, ip, &scriptId) &&
+        std::find(out.Scripts.begin(), out.Scripts.end(), scriptId) ==
+            out.Scripts.end()) {
+      out.Scripts.push_back(scriptId);
+    }
+    if (info->EndsBlock) return;
+  }
+}
+
+// Labels sorted by address, for LabelEnd()
+static std::vector<uint8_t const*> SortLabels(
+    std::vector<uint8_t*> const& labels) {
+  std::vector<uint8_t const*> sortedLabels(labels.begin(), labels.end());
+  std::sort(sortedLabels.begin(), sortedLabels.end());
+  return sortedLabels;
+}
+
+// The next label in the file or the end of the script
+static uint8_t const* LabelEnd(uint8_t const* data, int64_t size,
+                               std::vector<uint8_t const*> const& sortedLabels,
+                               uint8_t const* label) {
+  auto next =
+      std::upper_bound(sortedLabels.begin(), sortedLabels.end(), label);
+  return next != sortedLabels.end() ? *next : data + size;
+}
+
+void AnalyzeScriptAssets(uint8_t const* data, int64_t size,
+                         std::vector<uint8_t*> const& labels,
+                         ScriptAssetManifest& out) {
+  out.LabelStart.clear();
+  out.LabelStart.reserve(labels.size() + 1);
+  out.LabelStart.push_back(0);
+  out.Assets.clear();
+  out.Scripts.clear();
+
+  std::vector<uint8_t const*> sortedLabels = SortLabels(labels);
+
+  std::unordered_set<uint64_t> seen;
+  for (uint8_t const* label : labels) {
+    uint8_t const* end = LabelEnd(data, size, sortedLabels, label);
+    seen.clear();
+    if (label >= data && label < end) {
+      AnalyzeLabel(label, end, seen, out);
+    }
+    out.LabelStart.push_back(out.Assets.size());
+  }
+}
+
+int64_t CheckScriptLayouts(uint8_t const* data, int64_t size,
+                           std::vector<uint8_t*> const& labels,
+                           std::vector<ScriptLayoutIssue>& out) {
+  std::vector<uint8_t const*> sortedLabels = SortLabels(labels);
+
+  int64_t decoded = 0;
+  for (uint8_t const* label : labels) {
+    uint8_t const* end = LabelEnd(data, size, sortedLabels, label);
+    if (label < data || label >= end) continue;
+
+    uint8_t const* ip = label;
+    // Last instruction of known layout, which the current one should follow
+    uint8_t const* prev = nullptr;
+    while (ip < end) {
+      uint8_t const* inst = ip;
+      OpcodeInfo const* info;
+      DecodeResult result = DecodeInstruction(ip, end, &info);
+      if (result == DR_Overrun && info) {
+        out.push_back({(uint32_t)(inst - data), (uint8_t)(inst[0] & 0x7F),
+                       inst[1], true});
+      } else if (result == DR_Invalid && prev) {
+        out.push_back({(uint32_t)(prev - data), (uint8_t)(prev[0] & 0x7F),
+                       prev[1], false});
+      }
+      if (result != DR_Ok) break;
+      decoded++;
+      if (info && info->EndsBlock) break;
+      prev = info ? inst : nullptr;
+    }
+  }
+  return decoded;
+}
+
+void PrefetchScriptAssets(ScriptAssetManifest const& manifest,
+                          uint32_t labelNum) {
+  if (labelNum + 1 >= manifest.LabelStart.size()) return;
+  uint32_t first = manifest.LabelStart[labelNum];
+  uint32_t last = std::min(manifest.LabelStart[labelNum + 1],
+                           first + MaxPrefetchedAssets);
+  if (first == last) return;
+
+  // Room for characters' layouts
+  uint32_t ids[AK_Count][2 * MaxPrefetchedAssets];
+  int counts[AK_Count] = {};
+  for (uint32_t i = first; i < last; i++) {
+    AssetRef const& asset = manifest.Assets[i];
+    ids[asset.Kind][counts[asset.Kind]++] = asset.Id;
+    if (asset.Kind == AK_Character) {
+      ids[asset.Kind][counts[asset.Kind]++] = asset.Id + 1;
+    }
+  }
+  for (int kind = 0; kind < AK_Count; kind++) {
+    if (counts[kind] == 0) continue;
+    Io::VfsPrefetch(AssetKindMountpoints[kind], ids[kind], counts[kind]);
+  }
+}
+
+}  // namespace Vm
+}  // namespace Impacto
\ No newline at end of file
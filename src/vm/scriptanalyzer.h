@@ -0,0 +1,79 @@
+#pragma once
+
+#include <vector>
+
+#include "vm.h"
+
+namespace Impacto {
+namespace Vm {
+
+enum AssetKind : uint8_t {
+  AK_Background,
+  AK_Character,
+  AK_Bgm,
+  AK_Se,
+  AK_Voice,
+  AK_Model,
+  AK_Count
+};
+
+// VFS mountpoint of each AssetKind
+extern char const* const AssetKindMountpoints[AK_Count];
+
+struct AssetRef {
+  AssetKind Kind;
+  // File ID within the mountpoint (characters: the texture, their layout is
+  // the next file)
+  uint32_t Id;
+};
+
+// Assets loaded with constant IDs by the straight-line code of each label, at
+// most up to the next one in the file, in script order without duplicates
+struct ScriptAssetManifest {
+  // Label i's assets are Assets[LabelStart[i]] to Assets[LabelStart[i + 1]]
+  std::vector<uint32_t> LabelStart;
+  std::vector<AssetRef> Assets;
+  // Scripts loaded or jumped to with constant IDs (ScriptLoad, LoadJump) by any
+  // label, in script order without duplicates
+  std::vector<uint32_t> Scripts;
+};
+
+// Picks the asset loading instructions out of the opcode tables of the
+// current instruction set. Call once before analyzing any script.
+void ScriptAnalyzerInit(InstructionProc* const* opcodeTables);
+
+// Scans script bytecode for asset and script loading instructions without
+// executing it.
+// Each label's code is decoded instruction by instruction up to the first jump,
+// return or instruction of unknown layout, so data is never mistaken for code
+// but assets after that point are missed - manifests are only good for
+// prefetching. Safe to call from worker threads.
+void AnalyzeScriptAssets(uint8_t const* data, int64_t size,
+                         std::vector<uint8_t*> const& labels,
+                         ScriptAssetManifest& out);
+
+// An instruction whose operand layout (as the analyzer knows it) is wrong
+struct ScriptLayoutIssue {
+  // From the start of the script
+  uint32_t Offset;
+  uint8_t Group;
+  uint8_t Opcode;
+  // Its operands ran past the next label, otherwise it was followed by
+  // something that isn't an instruction
+  bool Overrun;
+};
+
+// Decodes every label like AnalyzeScriptAssets() and checks that each
+// instruction of known layout ends on the start of another instruction (or the
+// next label). Returns the number of instructions decoded. For catching
+// analyzer layouts that drifted from their instructions, not needed otherwise.
+int64_t CheckScriptLayouts(uint8_t const* data, int64_t size,
+                           std::vector<uint8_t*> const& labels,
+                           std::vector<ScriptLayoutIssue>& out);
+
+// Io::VfsPrefetch() the first assets of a label
+void PrefetchScriptAssets(ScriptAssetManifest const& manifest,
+                          uint32_t labelNum);
+
+}  // namespace Vm
+}  // namespace Impacto
\ No newline at end of file
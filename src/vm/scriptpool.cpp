@@ -0,0 +1,268 @@
+#include "scriptpool.h"
+
+#include "../log.h"
+#include "../workqueue.h"
+#include "../io/vfs.h"
+
+namespace Impacto {
+namespace Vm {
+
+struct ScriptLoadJob {
+  uint32_t ScriptId;
+  WorkQueue::WorkHandle Handle;
+  // Posted by the worker once the results below are set
+  SDL_sem* Done;
+  bool Ok;
+  Io::VfsView View;
+  ScriptTables Tables;
+  ScriptAssetManifest Assets;
+};
+
+static std::vector<ResidentScript*> Scripts;
+static uint64_t UseCounter = 0;
+
+static ResidentScript* Find(uint32_t scriptId) {
+  for (ResidentScript* script : Scripts) {
+    if (script->ScriptId == scriptId) return script;
+  }
+  return NULL;
+}
+
+static void Remove(ResidentScript* script) {
+  for (auto it = Scripts.begin(); it != Scripts.end(); it++) {
+    if (*it == script) {
+      Scripts.erase(it);
+      break;
+    }
+  }
+  Io::VfsReleaseView(&script->View);
+  delete script;
+}
+
+static void Trim() {
+  for (;;) {
+    int spareCount = 0;
+    ResidentScript* oldest = NULL;
+    for (ResidentScript* script : Scripts) {
+      if (script->Status == RSS_Loading || script->Users > 0) continue;
+      spareCount++;
+      if (!oldest || script->LastUse < oldest->LastUse) oldest = script;
+    }
+    if (spareCount <= MaxSpareScripts) return;
+    ImpLogSlow(LL_Debug, LC_VM, "Dropping %s script %u\n",
+               oldest->Status == RSS_Failed ? "failed" : "resident",
+               oldest->ScriptId);
+    Remove(oldest);
+  }
+}
+
+// Resolves entries of the header table at tableOffset up to the next table or
+// the start of code, stopping early at anything outside the file - lookups past
+// what was resolved read the table directly
+static void ResolveScriptTable(uint8_t* scriptBufferAdr, int64_t size,
+                               uint32_t tableOffset,
+                               std::vector<uint8_t*>& out) {
+  out.clear();
+  if (size < 16 || tableOffset >= size) return;
+
+  int64_t end = size;
+  uint32_t boundaries[] = {ScriptReadU32(scriptBufferAdr, 4),
+                           ScriptReadU32(scriptBufferAdr, 8),
+                           ScriptReadU32(scriptBufferAdr, 12)};
+  for (uint32_t boundary : boundaries) {
+    if (boundary > tableOffset && boundary < end) end = boundary;
+  }
+
+  out.reserve((end - tableOffset) / 4);
+  for (int64_t entry = tableOffset; entry + 4 <= end; entry += 4) {
+    uint32_t address = ScriptReadU32(scriptBufferAdr, entry);
+    if (address >= size) break;
+    out.push_back(&scriptBufferAdr[address]);
+  }
+}
+
+static void ResolveScriptTables(uint8_t* data, int64_t size,
+                                ScriptTables& tables) {
+  ResolveScriptTable(data, size, 12, tables.Labels);
+  if (size >= 16) {
+    ResolveScriptTable(data, size, ScriptReadU32(data, 4), tables.Strings);
+    ResolveScriptTable(data, size, ScriptReadU32(data, 8), tables.Returns);
+  } else {
+    tables.Strings.clear();
+    tables.Returns.clear();
+  }
+}
+
+// Scripts stored as-is in a memory-backed archive are used in place, see
+// VfsSlurpView()
+static bool ReadScript(uint32_t scriptId, Io::VfsView* outView,
+                       ScriptTables& tables, ScriptAssetManifest& assets) {
+  IoError err = Io::VfsSlurpView("script", scriptId, outView);
+  if (err != IoError_OK) return false;
+  // The VM never writes to script buffers
+  uint8_t* data = (uint8_t*)outView->Memory;
+  ResolveScriptTables(data, outView->Size, tables);
+  AnalyzeScriptAssets(data, outView->Size, tables.Labels, assets);
+  return true;
+}
+
+// Takes over view
+static void SetScriptData(ResidentScript* script, Io::VfsView* view) {
+  script->View = *view;
+  *view = Io::VfsView();
+  script->Data = (uint8_t*)script->View.Memory;
+  script->Size = script->View.Size;
+}
+
+static void LoadWorker(void* ptr) {
+  ScriptLoadJob* job = (ScriptLoadJob*)ptr;
+  job->Ok = ReadScript(job->ScriptId, &job->View, job->Tables, job->Assets);
+  SDL_SemPost(job->Done);
+}
+
+static void DeleteJob(ScriptLoadJob* job) {
+  Io::VfsReleaseView(&job->View);
+  SDL_DestroySemaphore(job->Done);
+  delete job;
+}
+
+// Moves the results of a finished background read into its script
+static void FinishLoad(ResidentScript* script) {
+  ScriptLoadJob* job = script->Job;
+  script->Job = NULL;
+  if (job->Ok) {
+    script->Status = RSS_Resident;
+    SetScriptData(script, &job->View);
+    script->Tables.Labels.swap(job->Tables.Labels);
+    script->Tables.Strings.swap(job->Tables.Strings);
+    script->Tables.Returns.swap(job->Tables.Returns);
+    script->Assets.LabelStart.swap(job->Assets.LabelStart);
+    script->Assets.Assets.swap(job->Assets.Assets);
+    script->Assets.Scripts.swap(job->Assets.Scripts);
+  } else {
+    script->Status = RSS_Failed;
+  }
+  script->LastUse = ++UseCounter;
+}
+
+static void OnLoaded(void* ptr) {
+  ScriptLoadJob* job = (ScriptLoadJob*)ptr;
+  ResidentScript* script = Find(job->ScriptId);
+  // Otherwise ScriptPoolAcquire() already waited for it
+  if (script && script->Job == job) {
+    FinishLoad(script);
+    Trim();
+  }
+  DeleteJob(job);
+}
+
+bool ScriptPoolRequest(uint32_t scriptId) {
+  ResidentScript* script = Find(scriptId);
+  if (script) return script->Status != RSS_Loading;
+
+  script = new ResidentScript;
+  script->ScriptId = scriptId;
+  script->Status = RSS_Loading;
+  script->Job = NULL;
+  script->Data = 0;
+  script->Size = 0;
+  script->Users = 0;
+  script->LastUse = 0;
+  Scripts.push_back(script);
+
+  ScriptLoadJob* job = new ScriptLoadJob;
+  job->ScriptId = scriptId;
+  job->Done = SDL_CreateSemaphore(0);
+  job->Ok = false;
+  script->Job = job;
+  job->Handle =
+      WorkQueue::Push(job, &LoadWorker, &OnLoaded, WorkQueue::WP_Script);
+  return false;
+}
+
+ResidentScript* ScriptPoolAcquire(uint32_t scriptId) {
+  ResidentScript* script = Find(scriptId);
+  if (script && script->Status == RSS_Loading) {
+    ScriptLoadJob* job = script->Job;
+    if (WorkQueue::Cancel(job->Handle)) {
+      // Not picked up yet, so read it right here instead
+      script->Job = NULL;
+      DeleteJob(job);
+    } else {
+      // Already being read, reading it again would only take longer. The
+      // completion callback still runs and deletes the job.
+      ImpLogSlow(LL_Debug, LC_VM,
+                 "Waiting for background read of script %u\n", scriptId);
+      SDL_SemWait(job->Done);
+      FinishLoad(script);
+      if (script->Status == RSS_Failed) {
+        Remove(script);
+        return NULL;
+      }
+    }
+  }
+  // Failed earlier, so it is worth another try
+  if (script && script->Status == RSS_Failed) {
+    Remove(script);
+    script = NULL;
+  }
+
+  if (!script || script->Status == RSS_Loading) {
+    Io::VfsView view;
+    ScriptTables tables;
+    ScriptAssetManifest assets;
+    if (!ReadScript(scriptId, &view, tables, assets)) {
+      return NULL;
+    }
+
+    if (!script) {
+      script = new ResidentScript;
+      script->ScriptId = scriptId;
+      script->Job = NULL;
+      script->Users = 0;
+      Scripts.push_back(script);
+    }
+    script->Status = RSS_Resident;
+    SetScriptData(script, &view);
+    script->Tables.Labels.swap(tables.Labels);
+    script->Tables.Strings.swap(tables.Strings);
+    script->Tables.Returns.swap(tables.Returns);
+    script->Assets.LabelStart.swap(assets.LabelStart);
+    script->Assets.Assets.swap(assets.Assets);
+    script->Assets.Scripts.swap(assets.Scripts);
+  }
+
+  script->PrefetchedLabels.assign(script->Tables.Labels.size(), false);
+  script->Users++;
+  script->LastUse = ++UseCounter;
+  return script;
+}
+
+void ScriptPoolRelease(ResidentScript* script) {
+  assert(script->Users > 0);
+  script->Users--;
+  script->LastUse = ++UseCounter;
+  Trim();
+}
+
+void ScriptPoolPredict(ResidentScript const* script) {
+  int count = 0;
+  for (uint32_t scriptId : script->Assets.Scripts) {
+    if (count == MaxPredictedScripts) break;
+    if (scriptId == script->ScriptId) continue;
+    ScriptPoolRequest(scriptId);
+    count++;
+  }
+}
+
+void ScriptPoolPrefetchLabel(ResidentScript* script, uint32_t labelNum) {
+  if (labelNum >= script->PrefetchedLabels.size() ||
+      script->PrefetchedLabels[labelNum]) {
+    return;
+  }
+  script->PrefetchedLabels[labelNum] = true;
+  PrefetchScriptAssets(script->Assets, labelNum);
+}
+
+}  // namespace Vm
+}  // namespace Impacto
\ No newline at end of file
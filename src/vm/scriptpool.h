@@ -0,0 +1,73 @@
+#pragma once
+
+#include <vector>
+
+#include "../impacto.h"
+#include "scriptanalyzer.h"
+#include "../io/vfs.h"
+
+namespace Impacto {
+namespace Vm {
+
+inline uint32_t ScriptReadU32(uint8_t const* scriptBufferAdr, uint32_t offset) {
+  return SDL_SwapLE32(*(uint32_t const*)&scriptBufferAdr[offset]);
+}
+
+// Label, string and return addresses of a script, resolved from its header
+// tables at load time
+struct ScriptTables {
+  std::vector<uint8_t*> Labels;
+  std::vector<uint8_t*> Strings;
+  std::vector<uint8_t*> Returns;
+};
+
+enum ResidentScriptStatus { RSS_Loading, RSS_Resident, RSS_Failed };
+
+struct ScriptLoadJob;
+
+struct ResidentScript {
+  uint32_t ScriptId;
+  ResidentScriptStatus Status;
+  // Background read in flight while Status is RSS_Loading
+  ScriptLoadJob* Job;
+  // View.Memory, which may point into the script archive
+  uint8_t* Data;
+  int64_t Size;
+  Io::VfsView View;
+  ScriptTables Tables;
+  ScriptAssetManifest Assets;
+  // Labels whose assets were prefetched since the script was last acquired
+  std::vector<bool> PrefetchedLabels;
+  // Number of script buffers holding this script
+  int Users;
+  uint64_t LastUse;
+};
+
+// Scripts are read and resolved by background workers and stay resident after
+// their script buffer moves on, up to MaxSpareScripts unused ones (least
+// recently used are dropped first, failed loads included), so jumping back to a
+// script is free.
+//
+// Main thread only.
+
+int const MaxSpareScripts = 8;
+int const MaxPredictedScripts = 4;
+
+// Returns true if scriptId can be acquired without blocking, i.e. it is
+// resident or failed to load (so the caller goes on to report that).
+// Otherwise it starts loading it in the background, if it isn't already.
+bool ScriptPoolRequest(uint32_t scriptId);
+// Returns the resident script with a user added, or NULL if it can't be read.
+// Waits for a background read already running, otherwise reads it
+// synchronously if it isn't resident yet.
+ResidentScript* ScriptPoolAcquire(uint32_t scriptId);
+void ScriptPoolRelease(ResidentScript* script);
+// Requests up to MaxPredictedScripts of the scripts the given one loads with
+// constant IDs, see ScriptAssetManifest::Scripts
+void ScriptPoolPredict(ResidentScript const* script);
+// Prefetches the assets of a label the first time it is reached after the
+// script is acquired
+void ScriptPoolPrefetchLabel(ResidentScript* script, uint32_t labelNum);
+
+}  // namespace Vm
+}  // namespace Impacto
\ No newline at end of file
@@ -1,6 +1,8 @@
 #include "vm.h"
 
 #include "expression.h"
+#include "scriptpool.h"
+#include "scriptanalyzer.h"
 #include "../log.h"
 #include "../io/vfs.h"
 #include "../io/io.h"
@@ -21,6 +23,8 @@
 #include "../profile/scriptinput.h"
 #include "../profile/scriptvars.h"
 #include "../window.h"
+#include "../rng.h"
+
 
 namespace Impacto {
 namespace Vm {
@@ -28,10 +32,16 @@ namespace Vm {
 using namespace Profile::ScriptVars;
 
 uint8_t* ScriptBuffers[MaxLoadedScripts];
+uint32_t LoadedScriptIds[MaxLoadedScripts];
 bool BlockCurrentScriptThread;
 uint32_t SwitchValue;
 
-static uint32_t LoadedScriptIds[MaxLoadedScripts];
+uint64_t InstructionCount;
+uint64_t ExpressionCount;
+bool ProfileOpcodes = false;
+OpcodeStats OpcodeProfile[OpcodeGroupCount][256];
+OpcodeStats ScriptProfile[MaxLoadedScripts];
+OpcodeStats ThreadProfile[MaxThreads];
 
 Sc3VmThread ThreadPool[MaxThreads];  // Main thread pool where all the
                                      // thread objects are stored
@@ -52,11 +62,44 @@ static Sc3VmThread*
 static Sc3VmThread* NextFreeThreadCtx;  // Next free thread context in the
                                         // thread pool
 
+// The exec and draw tables are kept sorted between frames. Every frame only
+// their membership is refreshed from the thread group lists, and the table is
+// re-sorted with an insertion sort, which is linear unless priorities changed.
+// Ties are broken by position in the group list walk, so the result is the
+// same as stably sorting the walk by priority.
+struct SortedThreadTable {
+  Sc3VmThread* Threads[MaxThreads];
+  int Count;
+};
+static SortedThreadTable ExecTable;
+static SortedThreadTable DrawTable;
+
+// Threads found by the current group list walk, in walk order
+static Sc3VmThread* WalkedThreads[MaxThreads];
+static int WalkedThreadCount;
+// Incremented for every walk, ThreadWalkStamp[id] == WalkStamp marks a thread
+// as part of the current walk at position ThreadWalkRank[id]
+static uint32_t WalkStamp;
+static uint32_t ThreadWalkStamp[MaxThreads];
+static int ThreadWalkRank[MaxThreads];
+static uint32_t ThreadPlacedStamp[MaxThreads];
+
 static InstructionProc* OpcodeTableSystem;
 static InstructionProc* OpcodeTableUser1;
 static InstructionProc* OpcodeTableGraph;
 static InstructionProc* OpcodeTableGraph3D;
 
+// Indexed by opcode group without the "no expressions" bit, NULL for groups
+// the game doesn't have
+static InstructionProc* OpcodeTables[0x80];
+// OpcodeProfile index of each opcode group, -1 for groups without a table
+static int8_t OpcodeGroupSlots[0x80];
+
+// Resident scripts in the script buffers, ScriptBuffers[i] is
+// LoadedScripts[i]->Data
+static ResidentScript* LoadedScripts[MaxLoadedScripts];
+static int64_t ScriptBufferSizes[MaxLoadedScripts];
+
 static void CreateThreadExecTable();
 static void SortThreadExecTable();
 static void CreateThreadDrawTable();
@@ -125,6 +168,19 @@ void Init() {
     }
   }
 
+  memset(OpcodeTables, 0, sizeof(OpcodeTables));
+  OpcodeTables[0x00] = OpcodeTableSystem;
+  OpcodeTables[0x01] = OpcodeTableGraph;
+  OpcodeTables[0x02] = OpcodeTableGraph3D;
+  OpcodeTables[0x10] = OpcodeTableUser1;
+
+  memset(OpcodeGroupSlots, -1, sizeof(OpcodeGroupSlots));
+  for (int i = 0; i < OpcodeGroupCount; i++) {
+    OpcodeGroupSlots[OpcodeGroups[i]] = i;
+  }
+  ResetStats();
+  ScriptAnalyzerInit(OpcodeTables);
+
   for (int i = 0; i < MaxThreads - 1; i++) {
     memset(&ThreadPool[i], 0, sizeof(Sc3VmThread));
     ThreadPool[i].NextFreeContext = &ThreadPool[i + 1];
@@ -149,8 +205,8 @@ void Init() {
     Sc3VmThread* startupThd = CreateThread(0);
     startupThd->GroupId = 0;
     startupThd->ScriptBufferId = Profile::Vm::StartScriptBuffer;
-    uint8_t* scrBuf = ScriptBuffers[Profile::Vm::StartScriptBuffer];
-    startupThd->Ip = ScriptGetLabelAddress(scrBuf, 0);
+    startupThd->Ip = ScriptGetLabelAddress(Profile::Vm::StartScriptBuffer, 0);
+    PrefetchLabelAssets(Profile::Vm::StartScriptBuffer, 0);
   }
 
   ScrWork[2200] = 1;  // Global animation multiplier maybe?... Set in GameInit()
@@ -158,23 +214,46 @@ void Init() {
   //        1);  // Force skip mode for now
 }
 
+bool RequestScript(uint32_t scriptId) {
+  if (ScriptPoolRequest(scriptId)) return true;
+  ImpLogSlow(LL_Debug, LC_VM, "Waiting for script %u\n", scriptId);
+  return false;
+}
+
+static void InstallScript(uint32_t bufferId, ResidentScript* script) {
+  if (LoadedScripts[bufferId]) ScriptPoolRelease(LoadedScripts[bufferId]);
+  LoadedScripts[bufferId] = script;
+
+  ScriptBuffers[bufferId] = script->Data;
+  ScriptBufferSizes[bufferId] = script->Size;
+  LoadedScriptIds[bufferId] = script->ScriptId;
+  ExpressionCacheReset(bufferId, script->Size);
+  ScrWork[SW_SCRIPTNO0 + bufferId] = script->ScriptId;
+
+  // Whatever the script itself loads is the likeliest script to be loaded next
+  ScriptPoolPredict(script);
+}
+
 bool LoadScript(uint32_t bufferId, uint32_t scriptId) {
-  Io::FileMeta meta;
-  Io::VfsGetMeta("script", scriptId, &meta);
-  ImpLogSlow(LL_Debug, LC_VM, "Loading script \"%s\"\n", meta.FileName.c_str());
-
-  void* file;
-  int64_t fileSize;
-  IoError err = Io::VfsSlurp("script", scriptId, &file, &fileSize);
-  if (err != IoError_OK) {
+  ImpLogSlow(LL_Debug, LC_VM, "Loading script %u into buffer %u\n", scriptId,
+             bufferId);
+
+  ResidentScript* script = ScriptPoolAcquire(scriptId);
+  if (!script) {
     ImpLog(LL_Error, LC_VM, "Could not read script file for %d\n", scriptId);
     return false;
   }
-  ScriptBuffers[bufferId] = (uint8_t*)file;
-  ScrWork[SW_SCRIPTNO0 + bufferId] = scriptId;
+  InstallScript(bufferId, script);
   return true;
 }
 
+void PrefetchLabelAssets(uint32_t scriptBufferId, uint32_t labelNum) {
+  if (scriptBufferId >= MaxLoadedScripts || !LoadedScripts[scriptBufferId]) {
+    return;
+  }
+  ScriptPoolPrefetchLabel(LoadedScripts[scriptBufferId], labelNum);
+}
+
 Sc3VmThread* CreateThread(uint32_t groupId) {
   if (!NextFreeThreadCtx) return 0;
   Sc3VmThread* thread = NextFreeThreadCtx;
@@ -195,10 +274,148 @@ Sc3VmThread* CreateThread(uint32_t groupId) {
   return thread;
 }
 
+static void BeginThreadWalk() {
+  WalkStamp++;
+  WalkedThreadCount = 0;
+}
+
+static void AddWalkedThread(Sc3VmThread* thread) {
+  ThreadWalkStamp[thread->Id] = WalkStamp;
+  ThreadWalkRank[thread->Id] = WalkedThreadCount;
+  WalkedThreads[WalkedThreadCount++] = thread;
+}
+
+// Brings table up to date with the current walk and copies it to ThreadTable
+static void SortThreadTable(SortedThreadTable* table,
+                            uint32_t Sc3VmThread::*priority) {
+  // Keep the previous order of threads that are still there...
+  int count = 0;
+  for (int i = 0; i < table->Count; i++) {
+    Sc3VmThread* thread = table->Threads[i];
+    if (ThreadWalkStamp[thread->Id] == WalkStamp &&
+        ThreadPlacedStamp[thread->Id] != WalkStamp) {
+      ThreadPlacedStamp[thread->Id] = WalkStamp;
+      table->Threads[count++] = thread;
+    }
+  }
+  // ...and append the new ones
+  for (int i = 0; i < WalkedThreadCount; i++) {
+    Sc3VmThread* thread = WalkedThreads[i];
+    if (ThreadPlacedStamp[thread->Id] != WalkStamp) {
+      ThreadPlacedStamp[thread->Id] = WalkStamp;
+      table->Threads[count++] = thread;
+    }
+  }
+  table->Count = count;
+
+  for (int i = 1; i < count; i++) {
+    Sc3VmThread* thread = table->Threads[i];
+    uint32_t threadPriority = thread->*priority;
+    int threadRank = ThreadWalkRank[thread->Id];
+    int j = i - 1;
+    while (j >= 0) {
+      Sc3VmThread* other = table->Threads[j];
+      if (other->*priority < threadPriority ||
+          (other->*priority == threadPriority &&
+           ThreadWalkRank[other->Id] < threadRank)) {
+        break;
+      }
+      table->Threads[j + 1] = other;
+      j--;
+    }
+    table->Threads[j + 1] = thread;
+  }
+
+  memcpy(ThreadTable, table->Threads, count * sizeof(Sc3VmThread*));
+  ThreadTable[count] = 0;
+}
+
+// How the exec and draw tables were sorted before they were kept sorted: a
+// stable bubble sort of the group list walk
+static void BubbleSortThreads(Sc3VmThread** threads, int count,
+                              uint32_t Sc3VmThread::*priority) {
+  for (int i = 0; i < count; i++) {
+    for (int j = 0; j + i < count && j + 1 < count; j++) {
+      if (threads[j]->*priority > threads[j + 1]->*priority) {
+        Sc3VmThread* temp = threads[j];
+        threads[j] = threads[j + 1];
+        threads[j + 1] = temp;
+      }
+    }
+  }
+}
+
+bool CheckThreadTableOrder(int iterations) {
+  // Our own threads and table, only the walk bookkeeping and ThreadTable are
+  // shared with the running VM
+  static Sc3VmThread threads[MaxThreads];
+  static SortedThreadTable table;
+  bool present[MaxThreads];
+  int walkOrder[MaxThreads];
+  Sc3VmThread* expected[MaxThreads];
+  RNG rng(0x5eed, 1);
+
+  for (int i = 0; i < MaxThreads; i++) {
+    memset(&threads[i], 0, sizeof(Sc3VmThread));
+    threads[i].Id = i;
+    present[i] = rng.UintBetween(0, 2) == 0;
+    walkOrder[i] = i;
+  }
+  table.Count = 0;
+
+  for (int iteration = 0; iteration < iterations; iteration++) {
+    // Usually a few changes per frame like in a running game, sometimes a
+    // complete reshuffle. Priorities come from a small range so there are
+    // plenty of ties.
+    bool reshuffle = rng.UintBetween(0, 16) == 0;
+    int changes = reshuffle ? MaxThreads : rng.UintBetween(0, 4);
+    for (int i = 0; i < changes; i++) {
+      threads[rng.UintBetween(0, MaxThreads)].ExecPriority =
+          rng.UintBetween(0, 8);
+    }
+    changes = reshuffle ? MaxThreads : rng.UintBetween(0, 3);
+    for (int i = 0; i < changes; i++) {
+      int id = rng.UintBetween(0, MaxThreads);
+      present[id] = !present[id];
+    }
+    // Threads moving between groups, or destroyed and recreated elsewhere,
+    // change their position in the walk
+    changes = reshuffle ? MaxThreads : rng.UintBetween(0, 2);
+    for (int i = 0; i < changes; i++) {
+      int a = rng.UintBetween(0, MaxThreads);
+      int b = rng.UintBetween(0, MaxThreads);
+      int temp = walkOrder[a];
+      walkOrder[a] = walkOrder[b];
+      walkOrder[b] = temp;
+    }
+
+    BeginThreadWalk();
+    int count = 0;
+    for (int i = 0; i < MaxThreads; i++) {
+      if (!present[walkOrder[i]]) continue;
+      AddWalkedThread(&threads[walkOrder[i]]);
+      expected[count++] = &threads[walkOrder[i]];
+    }
+    SortThreadTable(&table, &Sc3VmThread::ExecPriority);
+    BubbleSortThreads(expected, count, &Sc3VmThread::ExecPriority);
+
+    if (table.Count != count ||
+        memcmp(ThreadTable, expected, count * sizeof(Sc3VmThread*)) != 0 ||
+        ThreadTable[count] != 0) {
+      ImpLog(LL_Error, LC_VM,
+             "Thread table order differs from a stable sort after %d "
+             "iterations\n",
+             iteration + 1);
+      return false;
+    }
+  }
+  return true;
+}
+
 // This also destroys thread groups and threads that have the TF_Destroy flag
 // set before building the execution table
 static void CreateThreadExecTable() {
-  int tblIndex = 0;
+  BeginThreadWalk();
 
   for (int i = 0; i < MaxThreadGroups; i++) {
     if (ThreadGroupState[i] & TF_Destroy) {
@@ -213,7 +430,7 @@ static void CreateThreadExecTable() {
           DestroyThread(groupThread);
           groupThread = next;
         } else if (!(groupThread->Flags & TF_Pause)) {
-          ThreadTable[tblIndex++] = groupThread;
+          AddWalkedThread(groupThread);
           groupThread = groupThread->NextContext;
         } else {
           groupThread = groupThread->NextContext;
@@ -221,23 +438,10 @@ static void CreateThreadExecTable() {
       } while (groupThread != NULL);
     }
   }
-  ThreadTable[tblIndex] = 0;
 }
 
 static void SortThreadExecTable() {
-  int i = 0;
-  while (ThreadTable[i]) {
-    int j = 0;
-    while (ThreadTable[j + i] && ThreadTable[j + 1]) {
-      if (ThreadTable[j]->ExecPriority > ThreadTable[j + 1]->ExecPriority) {
-        Sc3VmThread* temp = ThreadTable[j];
-        ThreadTable[j] = ThreadTable[j + 1];
-        ThreadTable[j + 1] = temp;
-      }
-      j++;
-    }
-    i++;
-  }
+  SortThreadTable(&ExecTable, &Sc3VmThread::ExecPriority);
 }
 
 void Update() {
@@ -270,7 +474,7 @@ void Update() {
 }
 
 static void CreateThreadDrawTable() {
-  int tblIndex = 0;
+  BeginThreadWalk();
 
   for (int i = 0; i < MaxThreadGroups; i++) {
     if (ThreadGroupState[i] & TF_Display) {
@@ -278,29 +482,16 @@ static void CreateThreadDrawTable() {
       if (groupThread == NULL) continue;
       do {
         if (groupThread->Flags & TF_Display) {
-          ThreadTable[tblIndex++] = groupThread;
+          AddWalkedThread(groupThread);
         }
         groupThread = groupThread->NextContext;
       } while (groupThread != NULL);
     }
   }
-  ThreadTable[tblIndex] = 0;
 }
 
 static void SortThreadDrawTable() {
-  int i = 0;
-  while (ThreadTable[i]) {
-    int j = 0;
-    while (ThreadTable[j + i] && ThreadTable[j + 1]) {
-      if (ThreadTable[j]->DrawPriority > ThreadTable[j + 1]->DrawPriority) {
-        Sc3VmThread* temp = ThreadTable[j];
-        ThreadTable[j] = ThreadTable[j + 1];
-        ThreadTable[j + 1] = temp;
-      }
-      j++;
-    }
-    i++;
-  }
+  SortThreadTable(&DrawTable, &Sc3VmThread::DrawPriority);
 }
 
 static void DrawAllThreads() {
@@ -401,6 +592,7 @@ void RunThread(Sc3VmThread* thread) {
   do {
     scrVal = thread->Ip;
     opcodeGrp = *scrVal;
+    InstructionCount++;
     if ((uint8_t)opcodeGrp == 0xFE) {
       thread->Ip += 1;
       ExpressionEval(thread, &calDummy);
@@ -412,14 +604,24 @@ void RunThread(Sc3VmThread* thread) {
              "Address: %016X Opcode: %02X:%02X ScriptBuffer: %i\n", thread->Ip,
              opcodeGrp1, opcode, thread->ScriptBufferId);
 
-      if (opcodeGrp1 == 0x10) {
-        OpcodeTableUser1[opcode](thread);
-      } else if (opcodeGrp1 == 0x02) {
-        OpcodeTableGraph3D[opcode](thread);
-      } else if (opcodeGrp1 == 0x01) {
-        OpcodeTableGraph[opcode](thread);
-      } else if (!opcodeGrp1) {
-        OpcodeTableSystem[opcode](thread);
+      InstructionProc* opcodeTable = OpcodeTables[opcodeGrp1];
+      if (opcodeTable && ProfileOpcodes) {
+        // The instruction may jump to another script buffer
+        uint32_t scriptBufferId = thread->ScriptBufferId;
+        uint64_t start = SDL_GetPerformanceCounter();
+        opcodeTable[opcode](thread);
+        uint64_t ticks = SDL_GetPerformanceCounter() - start;
+
+        OpcodeStats& stats =
+            OpcodeProfile[OpcodeGroupSlots[opcodeGrp1]][opcode];
+        stats.Count++;
+        stats.Ticks += ticks;
+        ScriptProfile[scriptBufferId].Count++;
+        ScriptProfile[scriptBufferId].Ticks += ticks;
+        ThreadProfile[thread->Id].Count++;
+        ThreadProfile[thread->Id].Ticks += ticks;
+      } else if (opcodeTable) {
+        opcodeTable[opcode](thread);
       } else {
         ImpLog(LL_Error, LC_VM,
                "Thread CRASH! Unknown opcode. Attempting recovery. Address: "
@@ -444,30 +646,290 @@ void RunThread(Sc3VmThread* thread) {
   } while (!BlockCurrentScriptThread);
 }
 
-uint8_t* ScriptGetLabelAddress(uint8_t* scriptBufferAdr, uint32_t labelNum) {
-  uint32_t* labelTableAdr = (uint32_t*)&scriptBufferAdr[12];
-  uint32_t labelAdrRel = SDL_SwapLE32(labelTableAdr[labelNum]);
-  return &scriptBufferAdr[labelAdrRel];
+static uint32_t ScriptOffset(uint32_t scriptBufferId, uint8_t* address) {
+  if (scriptBufferId >= MaxLoadedScripts || !address) return NoScriptOffset;
+  uint8_t* buffer = ScriptBuffers[scriptBufferId];
+  if (!buffer || address < buffer ||
+      address >= buffer + ScriptBufferSizes[scriptBufferId]) {
+    return NoScriptOffset;
+  }
+  return (uint32_t)(address - buffer);
+}
+
+static bool ScriptAddress(uint8_t* const* buffers, int64_t const* sizes,
+                          uint32_t scriptBufferId, uint32_t offset,
+                          uint8_t** out) {
+  if (scriptBufferId >= MaxLoadedScripts) return false;
+  if (offset == NoScriptOffset) {
+    *out = NULL;
+    return true;
+  }
+  if (!buffers[scriptBufferId] || offset >= sizes[scriptBufferId]) {
+    return false;
+  }
+  *out = buffers[scriptBufferId] + offset;
+  return true;
 }
 
-uint32_t ScriptGetLabelAddressNum(uint8_t* scriptBufferAdr, uint32_t labelNum) {
-  uint32_t* labelTableAdr = (uint32_t*)&scriptBufferAdr[12];
-  uint32_t labelAdrRel = SDL_SwapLE32(labelTableAdr[labelNum]);
-  return labelAdrRel;
+static int32_t ThreadIndex(Sc3VmThread* thread) {
+  return thread ? (int32_t)thread->Id : -1;
 }
 
-uint8_t* ScriptGetStrAddress(uint8_t* scriptBufferAdr, uint32_t mesNum) {
-  uint32_t stringTableAdrRel = SDL_SwapLE32(*(uint32_t*)&scriptBufferAdr[4]);
-  uint32_t* stringTableAdr = (uint32_t*)&scriptBufferAdr[stringTableAdrRel];
-  uint32_t stringAdrRel = SDL_SwapLE32(stringTableAdr[mesNum]);
-  return &scriptBufferAdr[stringAdrRel];
+static bool ThreadPointer(int32_t index, Sc3VmThread** out) {
+  if (index < -1 || index >= MaxThreads) return false;
+  *out = index == -1 ? NULL : &ThreadPool[index];
+  return true;
+}
+
+void CaptureState(VmState* out) {
+  memset(out, 0, sizeof(VmState));
+
+  for (int i = 0; i < MaxLoadedScripts; i++) {
+    out->ScriptIds[i] = ScriptBuffers[i] ? LoadedScriptIds[i] : NoScriptId;
+  }
+
+  for (int i = 0; i < MaxThreads; i++) {
+    Sc3VmThread const& thread = ThreadPool[i];
+    ThreadState& state = out->Threads[i];
+    state.Flags = thread.Flags;
+    state.ExecPriority = thread.ExecPriority;
+    state.ScriptBufferId = thread.ScriptBufferId;
+    state.GroupId = thread.GroupId;
+    state.WaitCounter = thread.WaitCounter;
+    state.ScriptParam = thread.ScriptParam;
+    state.IpOffset = ScriptOffset(thread.ScriptBufferId, thread.Ip);
+    state.LoopCounter = thread.LoopCounter;
+    state.LoopLabelNum = thread.LoopLabelNum;
+    state.CallStackDepth = thread.CallStackDepth;
+    for (int j = 0; j < MaxCallStackDepth; j++) {
+      state.ReturnScriptBufferIds[j] = thread.ReturnScriptBufferIds[j];
+      state.ReturnOffsets[j] = ScriptOffset(thread.ReturnScriptBufferIds[j],
+                                            thread.ReturnAdresses[j]);
+    }
+    state.DrawPriority = thread.DrawPriority;
+    state.DrawType = thread.DrawType;
+    state.Alpha = thread.Alpha;
+    state.Temp1 = thread.Temp1;
+    state.Temp2 = thread.Temp2;
+    memcpy(state.Variables, thread.Variables, sizeof(state.Variables));
+    state.DialoguePageId = thread.DialoguePageId;
+    state.PreviousContext = ThreadIndex(thread.PreviousContext);
+    state.NextContext = ThreadIndex(thread.NextContext);
+    state.NextFreeContext = ThreadIndex(thread.NextFreeContext);
+  }
+
+  for (int i = 0; i < MaxThreadGroups; i++) {
+    out->ThreadGroupState[i] = ThreadGroupState[i];
+    out->ThreadGroupCount[i] = ThreadGroupCount[i];
+    out->ThreadGroupHeads[i] = ThreadIndex(ThreadGroupHeads[i]);
+    out->ThreadGroupTails[i] = ThreadIndex(ThreadGroupTails[i]);
+  }
+  out->NextFreeThread = ThreadIndex(NextFreeThreadCtx);
+
+  out->ExecCount = ExecTable.Count;
+  for (int i = 0; i < ExecTable.Count; i++) {
+    out->ExecOrder[i] = ExecTable.Threads[i]->Id;
+  }
+  out->DrawCount = DrawTable.Count;
+  for (int i = 0; i < DrawTable.Count; i++) {
+    out->DrawOrder[i] = DrawTable.Threads[i]->Id;
+  }
+
+  out->SwitchValue = SwitchValue;
+}
+
+static bool RestoreThreadTable(int32_t const* order, int32_t count,
+                               SortedThreadTable* out) {
+  if (count < 0 || count > MaxThreads) return false;
+  for (int i = 0; i < count; i++) {
+    if (!ThreadPointer(order[i], &out->Threads[i]) || !out->Threads[i]) {
+      return false;
+    }
+  }
+  out->Count = count;
+  return true;
+}
+
+// VM state decoded from a VmState, ready to be copied in
+struct DecodedVmState {
+  Sc3VmThread Threads[MaxThreads];
+  Sc3VmThread* GroupHeads[MaxThreadGroups];
+  Sc3VmThread* GroupTails[MaxThreadGroups];
+  Sc3VmThread* NextFreeThread;
+  SortedThreadTable ExecTable;
+  SortedThreadTable DrawTable;
+};
+
+// Checks every index and script offset in state against the scripts in
+// buffers before using it
+static bool DecodeState(VmState const& state, uint8_t* const* buffers,
+                        int64_t const* sizes, DecodedVmState* out) {
+  for (int i = 0; i < MaxThreads; i++) {
+    ThreadState const& in = state.Threads[i];
+    Sc3VmThread& thread = out->Threads[i];
+    memset(&thread, 0, sizeof(thread));
+    if (in.ScriptBufferId >= MaxLoadedScripts ||
+        in.GroupId >= MaxThreadGroups ||
+        in.CallStackDepth > MaxCallStackDepth ||
+        in.LoopLabelNum > UINT16_MAX || in.DrawType > UINT8_MAX) {
+      return false;
+    }
+
+    thread.Id = i;
+    thread.Flags = in.Flags;
+    thread.ExecPriority = in.ExecPriority;
+    thread.ScriptBufferId = in.ScriptBufferId;
+    thread.GroupId = in.GroupId;
+    thread.WaitCounter = in.WaitCounter;
+    thread.ScriptParam = in.ScriptParam;
+    if (!ScriptAddress(buffers, sizes, in.ScriptBufferId, in.IpOffset,
+                       &thread.Ip)) {
+      return false;
+    }
+    thread.LoopCounter = in.LoopCounter;
+    thread.LoopLabelNum = (uint16_t)in.LoopLabelNum;
+    thread.CallStackDepth = in.CallStackDepth;
+    for (int j = 0; j < MaxCallStackDepth; j++) {
+      thread.ReturnScriptBufferIds[j] = in.ReturnScriptBufferIds[j];
+      if (!ScriptAddress(buffers, sizes, in.ReturnScriptBufferIds[j],
+                         in.ReturnOffsets[j], &thread.ReturnAdresses[j])) {
+        return false;
+      }
+    }
+    thread.DrawPriority = in.DrawPriority;
+    thread.DrawType = (Game::DrawComponentType)in.DrawType;
+    thread.Alpha = in.Alpha;
+    thread.Temp1 = in.Temp1;
+    thread.Temp2 = in.Temp2;
+    memcpy(thread.Variables, in.Variables, sizeof(thread.Variables));
+    thread.DialoguePageId = in.DialoguePageId;
+    if (!ThreadPointer(in.PreviousContext, &thread.PreviousContext) ||
+        !ThreadPointer(in.NextContext, &thread.NextContext) ||
+        !ThreadPointer(in.NextFreeContext, &thread.NextFreeContext)) {
+      return false;
+    }
+  }
+
+  for (int i = 0; i < MaxThreadGroups; i++) {
+    if (!ThreadPointer(state.ThreadGroupHeads[i], &out->GroupHeads[i]) ||
+        !ThreadPointer(state.ThreadGroupTails[i], &out->GroupTails[i])) {
+      return false;
+    }
+  }
+  if (!ThreadPointer(state.NextFreeThread, &out->NextFreeThread)) {
+    return false;
+  }
+
+  return RestoreThreadTable(state.ExecOrder, state.ExecCount,
+                            &out->ExecTable) &&
+         RestoreThreadTable(state.DrawOrder, state.DrawCount, &out->DrawTable);
+}
+
+bool RestoreState(VmState const& state) {
+  // Acquire the scripts the state needs without putting them in their buffers
+  // yet, so running threads keep pointing into the current scripts until the
+  // state is known to be good
+  ResidentScript* acquired[MaxLoadedScripts] = {};
+  uint8_t* buffers[MaxLoadedScripts];
+  int64_t sizes[MaxLoadedScripts];
+  memcpy(buffers, ScriptBuffers, sizeof(buffers));
+  memcpy(sizes, ScriptBufferSizes, sizeof(sizes));
+
+  bool ok = true;
+  for (int i = 0; i < MaxLoadedScripts && ok; i++) {
+    uint32_t scriptId = state.ScriptIds[i];
+    if (scriptId == NoScriptId) continue;
+    if (ScriptBuffers[i] && LoadedScriptIds[i] == scriptId) continue;
+    acquired[i] = ScriptPoolAcquire(scriptId);
+    if (!acquired[i]) {
+      ImpLog(LL_Error, LC_VM, "Could not read script file for %u\n",
+             scriptId);
+      ok = false;
+      break;
+    }
+    buffers[i] = acquired[i]->Data;
+    sizes[i] = acquired[i]->Size;
+  }
+
+  // Decode into scratch space first so a bad state can't leave the VM half
+  // restored
+  static DecodedVmState decoded;
+  if (ok) ok = DecodeState(state, buffers, sizes, &decoded);
+
+  if (!ok) {
+    for (int i = 0; i < MaxLoadedScripts; i++) {
+      if (acquired[i]) ScriptPoolRelease(acquired[i]);
+    }
+    return false;
+  }
+
+  for (int i = 0; i < MaxLoadedScripts; i++) {
+    if (acquired[i]) InstallScript(i, acquired[i]);
+  }
+
+  // The scratch threads point into ThreadPool and the new buffers already
+  memcpy(ThreadPool, decoded.Threads, sizeof(ThreadPool));
+  memcpy(ThreadGroupState, state.ThreadGroupState, sizeof(ThreadGroupState));
+  memcpy(ThreadGroupCount, state.ThreadGroupCount, sizeof(ThreadGroupCount));
+  memcpy(ThreadGroupHeads, decoded.GroupHeads, sizeof(ThreadGroupHeads));
+  memcpy(ThreadGroupTails, decoded.GroupTails, sizeof(ThreadGroupTails));
+  NextFreeThreadCtx = decoded.NextFreeThread;
+  ExecTable = decoded.ExecTable;
+  DrawTable = decoded.DrawTable;
+  SwitchValue = state.SwitchValue;
+
+  return true;
+}
+
+void ResetStats() {
+  InstructionCount = 0;
+  ExpressionCount = 0;
+  memset(OpcodeProfile, 0, sizeof(OpcodeProfile));
+  memset(ScriptProfile, 0, sizeof(ScriptProfile));
+  memset(ThreadProfile, 0, sizeof(ThreadProfile));
+}
+
+uint8_t* ScriptGetLabelAddress(uint32_t scriptBufferId, uint32_t labelNum) {
+  ScriptTables const& tables = LoadedScripts[scriptBufferId]->Tables;
+  if (labelNum < tables.Labels.size()) {
+    return tables.Labels[labelNum];
+  }
+
+  uint8_t* scriptBufferAdr = ScriptBuffers[scriptBufferId];
+  return &scriptBufferAdr[ScriptReadU32(scriptBufferAdr, 12 + 4 * labelNum)];
+}
+
+uint32_t ScriptGetLabelAddressNum(uint32_t scriptBufferId, uint32_t labelNum) {
+  return ScriptGetLabelAddress(scriptBufferId, labelNum) -
+         ScriptBuffers[scriptBufferId];
+}
+
+uint8_t* ScriptGetStrAddress(uint32_t scriptBufferId, uint32_t mesNum) {
+  ScriptTables const& tables = LoadedScripts[scriptBufferId]->Tables;
+  if (mesNum < tables.Strings.size()) {
+    return tables.Strings[mesNum];
+  }
+
+  uint8_t* scriptBufferAdr = ScriptBuffers[scriptBufferId];
+  uint32_t stringTableAdrRel = ScriptReadU32(scriptBufferAdr, 4);
+  return &scriptBufferAdr[ScriptReadU32(scriptBufferAdr,
+                                        stringTableAdrRel + 4 * mesNum)];
+}
+
+uint8_t* ScriptGetRetAddress(uint32_t scriptBufferId, uint32_t retNum) {
+  ScriptTables const& tables = LoadedScripts[scriptBufferId]->Tables;
+  if (retNum < tables.Returns.size()) {
+    return tables.Returns[retNum];
+  }
+
+  uint8_t* scriptBufferAdr = ScriptBuffers[scriptBufferId];
+  uint32_t returnTableAdrRel = ScriptReadU32(scriptBufferAdr, 8);
+  return &scriptBufferAdr[ScriptReadU32(scriptBufferAdr,
+                                        returnTableAdrRel + 4 * retNum)];
 }
 
-uint8_t* ScriptGetRetAddress(uint8_t* scriptBufferAdr, uint32_t retNum) {
-  uint32_t returnTableAdrRel = SDL_SwapLE32(*(uint32_t*)&scriptBufferAdr[8]);
-  uint32_t* returnTableAdr = (uint32_t*)&scriptBufferAdr[returnTableAdrRel];
-  uint32_t returnAdrRel = SDL_SwapLE32(returnTableAdr[retNum]);
-  return &scriptBufferAdr[returnAdrRel];
+int64_t ScriptGetBufferSize(uint32_t scriptBufferId) {
+  return ScriptBufferSizes[scriptBufferId];
 }
 
 }  // namespace Vm
@@ -12,19 +12,100 @@ BETTER_ENUM(InstructionSet, int, RNE, Darling, CHLCC, MO6TW, MO7, Dash, CC)
 
 typedef void (*InstructionProc)(Sc3VmThread* thread);
 
+// Opcode groups (without the "no expressions" bit) that can have an opcode
+// table, OpcodeProfile is indexed by position in this list
+uint8_t const OpcodeGroups[] = {0x00, 0x01, 0x02, 0x10};
+int const OpcodeGroupCount = sizeof(OpcodeGroups);
+
+struct OpcodeStats {
+  uint64_t Count;
+  // SDL performance counter ticks spent in the instruction
+  uint64_t Ticks;
+};
+
 int const MaxLoadedScripts = 16;
 int const MaxThreads = 100;
 int const MaxThreadGroups = 12;
 
-uint8_t* ScriptGetLabelAddress(uint8_t* scriptBufferAdr, uint32_t labelNum);
-uint32_t ScriptGetLabelAddressNum(uint8_t* scriptBufferAdr, uint32_t labelNum);
-uint8_t* ScriptGetStrAddress(uint8_t* scriptBufferAdr, uint32_t strNum);
-uint8_t* ScriptGetRetAddress(uint8_t* scriptBufferAdr, uint32_t retNum);
+// Lookups in the header tables of a loaded script. These are resolved when the
+// script is loaded, so they are just an array access.
+uint8_t* ScriptGetLabelAddress(uint32_t scriptBufferId, uint32_t labelNum);
+uint32_t ScriptGetLabelAddressNum(uint32_t scriptBufferId, uint32_t labelNum);
+uint8_t* ScriptGetStrAddress(uint32_t scriptBufferId, uint32_t strNum);
+uint8_t* ScriptGetRetAddress(uint32_t scriptBufferId, uint32_t retNum);
+int64_t ScriptGetBufferSize(uint32_t scriptBufferId);
+
+// Script addresses are stored as offsets into their script buffer, and thread
+// pointers as ThreadPool indices, so this can be restored into any session
+// running the same game
+uint32_t const NoScriptOffset = 0xFFFFFFFF;
+uint32_t const NoScriptId = 0xFFFFFFFF;
+
+struct ThreadState {
+  uint32_t Flags;
+  uint32_t ExecPriority;
+  uint32_t ScriptBufferId;
+  uint32_t GroupId;
+  uint32_t WaitCounter;
+  uint32_t ScriptParam;
+  uint32_t IpOffset;
+  uint32_t LoopCounter;
+  uint32_t LoopLabelNum;
+  uint32_t CallStackDepth;
+  uint32_t ReturnOffsets[MaxCallStackDepth];
+  uint32_t ReturnScriptBufferIds[MaxCallStackDepth];
+  uint32_t DrawPriority;
+  uint32_t DrawType;
+  uint32_t Alpha;
+  uint32_t Temp1;
+  uint32_t Temp2;
+  uint32_t Variables[MaxThreadVars];
+  uint32_t DialoguePageId;
+  // -1 for NULL
+  int32_t PreviousContext;
+  int32_t NextContext;
+  int32_t NextFreeContext;
+};
+
+// Complete runtime state of the VM except ScrWork/FlagWork
+struct VmState {
+  uint32_t ScriptIds[MaxLoadedScripts];
+  ThreadState Threads[MaxThreads];
+  uint32_t ThreadGroupState[MaxThreadGroups];
+  uint32_t ThreadGroupCount[MaxThreadGroups];
+  int32_t ThreadGroupHeads[MaxThreadGroups];
+  int32_t ThreadGroupTails[MaxThreadGroups];
+  int32_t NextFreeThread;
+  // Previous frame's order of the exec and draw tables, which breaks ties
+  int32_t ExecOrder[MaxThreads];
+  int32_t ExecCount;
+  int32_t DrawOrder[MaxThreads];
+  int32_t DrawCount;
+  uint32_t SwitchValue;
+};
 
 void Init();
 void Update();
 
+// Runs the exec/draw table sort over random priority, membership and group
+// order changes and compares every result with a stable sort of the walk, as
+// the tables used to be built. For impacto-headless --thread-order-check.
+bool CheckThreadTableOrder(int iterations);
+
+void CaptureState(VmState* out);
+// Loads scripts that are not in their buffer yet (synchronously). Returns false
+// and leaves the scripts and threads untouched if a script can't be read or the
+// state doesn't fit those scripts.
+bool RestoreState(VmState const& state);
+
+// Reads the script synchronously unless it is resident already
 bool LoadScript(uint32_t bufferId, uint32_t scriptId);
+// Returns true if LoadScript(scriptId) won't block, otherwise starts loading
+// it in the background - block the thread and retry in that case
+bool RequestScript(uint32_t scriptId);
+// Warms the caches for the assets the code at a label loads, call when a
+// thread is about to run from there
+void PrefetchLabelAssets(uint32_t scriptBufferId, uint32_t labelNum);
 
 Sc3VmThread* CreateThread(uint32_t groupId);
 void ControlThreadGroup(ThreadGroupControlType controlType, uint32_t groupId);
@@ -32,9 +113,22 @@ void DestroyThread(Sc3VmThread* thread);
 void RunThread(Sc3VmThread* thread);
 
 extern uint8_t* ScriptBuffers[MaxLoadedScripts];
+extern uint32_t LoadedScriptIds[MaxLoadedScripts];
 
 extern Sc3VmThread ThreadPool[MaxThreads];
 
+// Instructions (including expression statements) and expressions executed
+// since the last ResetStats()
+extern uint64_t InstructionCount;
+extern uint64_t ExpressionCount;
+// When set, RunThread() times every instruction into OpcodeProfile, and into
+// the totals of the script buffer it is in and the thread running it
+extern bool ProfileOpcodes;
+extern OpcodeStats OpcodeProfile[OpcodeGroupCount][256];
+extern OpcodeStats ScriptProfile[MaxLoadedScripts];
+extern OpcodeStats ThreadProfile[MaxThreads];
+void ResetStats();
+
 extern bool BlockCurrentScriptThread;
 extern uint32_t SwitchValue;  // Used in InstSwitch and InstCase
 
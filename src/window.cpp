@@ -28,6 +28,8 @@ GraphicsApi GraphicsApiHint = GfxApi_ForceNativeGLES;
 GraphicsApi ActualGraphicsApi;
 
 bool GLDebug = false;
+bool Hidden = false;
+bool NoGL = false;
 
 GLuint DrawRT = 0;
 GLuint ReadRT = 0;
@@ -171,6 +173,7 @@ static void TryCreateGL(GraphicsApi api) {
 #if IMPACTO_USE_SDL_HIGHDPI
   windowFlags |= SDL_WINDOW_ALLOW_HIGHDPI;
 #endif
+  if (Hidden) windowFlags |= SDL_WINDOW_HIDDEN;
 
   SDLWindow =
       SDL_CreateWindow("ROBOTICS;NOTES PC (Alpha r4)", SDL_WINDOWPOS_UNDEFINED,
@@ -194,9 +197,21 @@ static void TryCreateGL(GraphicsApi api) {
 
 void Init() {
   assert(IsInit == false);
-  ImpLog(LL_Info, LC_General, "Creating window\n");
   IsInit = true;
 
+  if (NoGL) {
+    // Still needed for the event queue the work queue posts to
+    ImpLog(LL_Info, LC_General, "Running without a window\n");
+    if (SDL_Init(SDL_INIT_EVENTS) != 0) {
+      ImpLog(LL_Fatal, LC_General, "SDL initialisation failed: %s\n",
+             SDL_GetError());
+      Shutdown();
+    }
+    return;
+  }
+
+  ImpLog(LL_Info, LC_General, "Creating window\n");
+
   if (SDL_Init(SDL_INIT_VIDEO | SDL_INIT_GAMECONTROLLER) != 0) {
     ImpLog(LL_Fatal, LC_General, "SDL initialisation failed: %s\n",
            SDL_GetError());
@@ -34,6 +34,11 @@ extern SDL_GLContext GLContext;
 extern GraphicsApi GraphicsApiHint;
 extern GraphicsApi ActualGraphicsApi;
 extern bool GLDebug;
+// Create the window hidden (for headless runs), set before Init()
+extern bool Hidden;
+// Create no window or GL context at all (for headless runs without a display),
+// set before Init(). Textures are then never uploaded and nothing is drawn
+extern bool NoGL;
 
 // Raw dimensions without aspect ratio correction. Only use for
 // setting/determining resolution and drawing to window framebuffer!
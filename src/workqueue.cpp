@@ -1,4 +1,5 @@
 #include <deque>
+#include <vector>
 
 #include "workqueue.h"
 
@@ -10,57 +11,110 @@ struct WorkItem {
   void* Data;
   WorkProc Perform;
   WorkCompletionCallbackProc OnComplete;
+  WorkHandle Handle;
 
-  void Handle();
+  void Run();
 };
 
 static int WorkCompletedEventType = -1;
 
-static void InitEventType() {
+// Finished work waiting for HandleEvent(), only one completion event is in
+// flight while this is non-empty
+static std::vector<WorkItem> Completed;
+static std::vector<WorkItem> Delivering;
+static SDL_mutex* CompletedLock;
+
+static WorkHandle NextHandle = 1;
+
+static void InitCompletion() {
   assert(WorkCompletedEventType == -1);
   WorkCompletedEventType = SDL_RegisterEvents(1);
   assert(WorkCompletedEventType != -1);
+  CompletedLock = SDL_CreateMutex();
+}
+
+static WorkHandle MakeHandle() {
+  WorkHandle handle = NextHandle++;
+  if (NextHandle == 0) NextHandle = 1;
+  return handle;
 }
 
 #if IMPACTO_HAVE_THREADS
 
-static std::deque<WorkItem> WorkQueue;
+static int const MaxWorkers = 4;
+
+static std::deque<WorkItem> Queues[WP_Count];
 static SDL_mutex* Lock;
 static SDL_cond* WorkSubmitted;
 
 static int WorkerThread(void* unused) {
   for (;;) {
     SDL_LockMutex(Lock);
-    if (WorkQueue.empty()) {
+    WorkItem item;
+    bool found = false;
+    for (int i = 0; i < WP_Count; i++) {
+      if (!Queues[i].empty()) {
+        item = Queues[i].front();
+        Queues[i].pop_front();
+        found = true;
+        break;
+      }
+    }
+    if (!found) {
       SDL_CondWait(WorkSubmitted, Lock);
       SDL_UnlockMutex(Lock);
     } else {
-      WorkItem item = WorkQueue.front();
-      WorkQueue.pop_front();
       SDL_UnlockMutex(Lock);
 
-      item.Handle();
+      item.Run();
     }
   }
 }
 
 void Init() {
-  InitEventType();
+  InitCompletion();
   Lock = SDL_CreateMutex();
   WorkSubmitted = SDL_CreateCond();
-  SDL_CreateThread(&WorkerThread, "Worker thread", NULL);
+
+  // Leave one core for the main thread
+  int workerCount = SDL_GetCPUCount() - 1;
+  if (workerCount < 1) workerCount = 1;
+  if (workerCount > MaxWorkers) workerCount = MaxWorkers;
+  for (int i = 0; i < workerCount; i++) {
+    SDL_CreateThread(&WorkerThread, "Worker thread", NULL);
+  }
 }
 
-void Push(void* data, WorkProc worker,
-          WorkCompletionCallbackProc completionCallback) {
+WorkHandle Push(void* data, WorkProc worker,
+                WorkCompletionCallbackProc completionCallback,
+                WorkPriority priority) {
   SDL_LockMutex(Lock);
   WorkItem item;
   item.Data = data;
   item.Perform = worker;
   item.OnComplete = completionCallback;
-  WorkQueue.push_back(item);
+  item.Handle = MakeHandle();
+  Queues[priority].push_back(item);
   SDL_CondSignal(WorkSubmitted);
   SDL_UnlockMutex(Lock);
+  return item.Handle;
+}
+
+bool Cancel(WorkHandle handle) {
+  if (handle == 0) return false;
+  bool result = false;
+  SDL_LockMutex(Lock);
+  for (int i = 0; i < WP_Count && !result; i++) {
+    for (auto it = Queues[i].begin(); it != Queues[i].end(); it++) {
+      if (it->Handle == handle) {
+        Queues[i].erase(it);
+        result = true;
+        break;
+      }
+    }
+  }
+  SDL_UnlockMutex(Lock);
+  return result;
 }
 
 #else
@@ -68,38 +122,50 @@ void Push(void* data, WorkProc worker,
 // If we don't have threads (i.e. on web), do each item right as it comes in for
 // now, no actual queue involved.
 
-void Init() { InitEventType(); }
-void Push(void* data, WorkProc worker,
-          WorkCompletionCallbackProc completionCallback) {
+void Init() { InitCompletion(); }
+WorkHandle Push(void* data, WorkProc worker,
+                WorkCompletionCallbackProc completionCallback,
+                WorkPriority priority) {
   WorkItem item;
   item.Data = data;
   item.Perform = worker;
   item.OnComplete = completionCallback;
-  item.Handle();
+  item.Handle = MakeHandle();
+  item.Run();
+  return item.Handle;
 }
 
+bool Cancel(WorkHandle handle) { return false; }
+
 #endif
 
-void WorkItem::Handle() {
+void WorkItem::Run() {
   Perform(Data);
 
-  WorkItem* copy = (WorkItem*)malloc(sizeof(WorkItem));
-  memcpy(copy, this, sizeof(WorkItem));
+  SDL_LockMutex(CompletedLock);
+  bool needEvent = Completed.empty();
+  Completed.push_back(*this);
+  SDL_UnlockMutex(CompletedLock);
 
-  SDL_Event evt;
-  memset(&evt, 0, sizeof(evt));
-  evt.type = WorkCompletedEventType;
-  evt.user.data1 = copy;
-  SDL_PushEvent(&evt);
+  if (needEvent) {
+    SDL_Event evt;
+    memset(&evt, 0, sizeof(evt));
+    evt.type = WorkCompletedEventType;
+    SDL_PushEvent(&evt);
+  }
 }
 
 bool HandleEvent(SDL_Event* evt) {
   if (evt->type != WorkCompletedEventType) return false;
 
-  WorkItem* item = (WorkItem*)evt->user.data1;
-  item->OnComplete(item->Data);
+  SDL_LockMutex(CompletedLock);
+  Delivering.swap(Completed);
+  SDL_UnlockMutex(CompletedLock);
 
-  free(item);
+  for (auto const& item : Delivering) {
+    item.OnComplete(item.Data);
+  }
+  Delivering.clear();
 
   return true;
 }
@@ -7,15 +7,36 @@ namespace WorkQueue {
 typedef void (*WorkProc)(void* data);
 typedef void (*WorkCompletionCallbackProc)(void* data);
 
+// Workers always pick up the highest priority (lowest value) pending work
+// first, work of the same priority is started in FIFO order
+enum WorkPriority {
+  WP_Audio = 0,
+  WP_Script = 1,
+  WP_Background = 2,
+  WP_Character = 3,
+  WP_Model = 4,
+  WP_Default = 5,
+  WP_Count
+};
+
+// 0 is never a valid handle
+typedef uint32_t WorkHandle;
+
 void Init();
-// Push work onto the background thread. worker(data) will be called on the
-// background thread in FIFO fashion. Completion will be posted onto SDL's event
-// queue.
-void Push(void* data, WorkProc worker,
-          WorkCompletionCallbackProc completionCallback);
+// Push work onto the background worker pool. worker(data) will be called on one
+// of the worker threads, so work items of any priority may run concurrently
+// with each other. Completion will be posted onto SDL's event queue.
+WorkHandle Push(void* data, WorkProc worker,
+                WorkCompletionCallbackProc completionCallback,
+                WorkPriority priority = WP_Default);
+// Remove work that has not been picked up by a worker yet. Returns true if it
+// was, in which case neither worker nor completionCallback will be called for
+// it. Work that is already running or done cannot be cancelled.
+bool Cancel(WorkHandle handle);
 // Call this in the event loop to perform work completion callbacks on the main
-// thread at the start of every frame. Returns true if event was handled, false
-// if not.
+// thread at the start of every frame. Completions of all work finished since
+// the last call are delivered by a single event. Returns true if event was
+// handled, false if not.
 bool HandleEvent(SDL_Event* evt);
 }  // namespace WorkQueue
 }  // namespace Impacto
\ No newline at end of file